@@ -0,0 +1,136 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Per-request memory arena.
+ *
+ * rpc.squared decodes arguments into memory from an arena, and some
+ * procedures take their results from there as well. Nothing is freed
+ * individually; when the reply has been sent, the dispatcher releases
+ * everything at once. Every thread has an arena of its own, which is
+ * only open while the thread is serving a call. Outside of that,
+ * rpctest_arena_alloc returns NULL, and callers fall back to malloc.
+ *
+ * If a request needed more than one chunk, the chunks are replaced by a
+ * single one that is big enough for all of them, so that in a steady
+ * state we do not allocate anything at all. Chunks larger than
+ * ARENA_KEEP_MAX are not kept, so that one huge call doesn't pin its
+ * memory forever.
+ */
+#include "rpctest.h"
+
+#define ARENA_CHUNK_MIN		(64 * 1024)
+#define ARENA_KEEP_MAX		(4 * 1024 * 1024)
+#define ARENA_ALIGN		16
+
+struct arena_chunk {
+	struct arena_chunk *	next;
+	size_t			size;
+	size_t			used;
+	char			data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+struct arena {
+	int			open;
+	struct arena_chunk *	chunks;
+};
+
+static __thread struct arena	rpctest_arena;
+
+static struct arena_chunk *
+__arena_chunk_new(size_t size)
+{
+	struct arena_chunk *c;
+
+	if ((c = malloc(sizeof(*c) + size)) == NULL)
+		return NULL;
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	return c;
+}
+
+void
+rpctest_arena_begin(void)
+{
+	rpctest_arena.open = 1;
+}
+
+/*
+ * Release everything allocated since rpctest_arena_begin
+ */
+void
+rpctest_arena_end(void)
+{
+	struct arena *a = &rpctest_arena;
+	struct arena_chunk *c, *next;
+	size_t total = 0;
+
+	a->open = 0;
+	if ((c = a->chunks) == NULL)
+		return;
+
+	if (c->next == NULL && c->size <= ARENA_KEEP_MAX) {
+		c->used = 0;
+		return;
+	}
+
+	for (; c; c = next) {
+		next = c->next;
+		total += c->size;
+		free(c);
+	}
+
+	if (total > ARENA_KEEP_MAX)
+		total = ARENA_CHUNK_MIN;
+	a->chunks = __arena_chunk_new(total);
+}
+
+void *
+rpctest_arena_alloc(size_t size)
+{
+	struct arena *a = &rpctest_arena;
+	struct arena_chunk *c;
+	void *p;
+
+	if (!a->open)
+		return NULL;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+	c = a->chunks;
+	if (c == NULL || c->size - c->used < size) {
+		size_t chunk_size = ARENA_CHUNK_MIN;
+
+		if (c && chunk_size < 2 * c->size)
+			chunk_size = 2 * c->size;
+		if (chunk_size < size)
+			chunk_size = size;
+
+		if ((c = __arena_chunk_new(chunk_size)) == NULL)
+			return NULL;
+		c->next = a->chunks;
+		a->chunks = c;
+	}
+
+	p = c->data + c->used;
+	c->used += size;
+	return p;
+}
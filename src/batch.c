@@ -0,0 +1,299 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Batching benchmark.
+ *
+ * Compares N single SQUAREPROC calls with one SQUAREVPROC call that
+ * squares N numbers at once, for a range of N and on every transport.
+ * Fitting the SQUAREVPROC times to a + b * N gives the fixed cost of an
+ * RPC (a) and the cost per item (b). We report the smallest batch size
+ * that is faster than the single calls, and the size beyond which the
+ * fixed cost per item drops below the cost of the item itself.
+ *
+ * Try this:
+ *  ./rpc.squared -T udp -T tcp -T local
+ *  ./square batch sizes=1,2,4,8,16,64,256,1024 runtime=2
+ */
+
+#include "rpctest.h"
+
+#define BATCH_MAX_NETIDS	8
+#define BATCH_MAX_SIZES		32
+
+struct batch_opts {
+	double			runtime;
+
+	unsigned int		num_netids;
+	const char *		netids[BATCH_MAX_NETIDS];
+
+	unsigned int		num_sizes;
+	unsigned int		sizes[BATCH_MAX_SIZES];
+};
+
+struct batch_result {
+	unsigned int		size;
+	double			usec;
+};
+
+static struct timeval	batch_call_timeout = { 25, 0 };
+
+static int
+batch_opts_set(struct batch_opts *opt, int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		char *name = argv[i];
+		char *value, *s;
+
+		if ((value = strchr(name, '=')) != NULL)
+			*value++ = '\0';
+
+		if (value == NULL) {
+			log_error("missing value to %s argument", name);
+			return -1;
+		}
+
+		if (!strcmp(name, "runtime")) {
+			opt->runtime = strtod(value, &s);
+			if (*s || opt->runtime <= 0) {
+				log_error("cannot parse numeric value to %s=%s", name, value);
+				return -1;
+			}
+		} else
+		if (!strcmp(name, "netid")) {
+			opt->num_netids = 0;
+			for (s = strtok(value, ","); s; s = strtok(NULL, ",")) {
+				if (opt->num_netids >= BATCH_MAX_NETIDS) {
+					log_error("too many values in netid=");
+					return -1;
+				}
+				opt->netids[opt->num_netids++] = s;
+			}
+		} else
+		if (!strcmp(name, "sizes")) {
+			opt->num_sizes = 0;
+			for (s = strtok(value, ","); s; s = strtok(NULL, ",")) {
+				unsigned long size;
+				char *end;
+
+				if (opt->num_sizes >= BATCH_MAX_SIZES) {
+					log_error("too many values in sizes=");
+					return -1;
+				}
+				size = strtoul(s, &end, 0);
+				if (*end || size == 0) {
+					log_error("cannot parse sizes=%s", s);
+					return -1;
+				}
+				opt->sizes[opt->num_sizes++] = size;
+			}
+		} else {
+			log_error("unknown argument \"%s\"", name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Mean time of a single SQUAREPROC call, in usec
+ */
+static double
+batch_measure_single(CLIENT *clnt, double runtime)
+{
+	unsigned long ncalls = 0;
+	double t0, elapsed;
+	square_in in;
+	square_out out;
+
+	in.arg1 = 0;
+	t0 = rpctest_time();
+	do {
+		if (clnt_call(clnt, SQUAREPROC,
+				(xdrproc_t) xdr_square_in, (caddr_t) &in,
+				(xdrproc_t) xdr_square_out, (caddr_t) &out,
+				batch_call_timeout) != RPC_SUCCESS) {
+			log_error("%s", clnt_sperror(clnt, "SQUAREPROC"));
+			return -1;
+		}
+		if (out.res1 != in.arg1 * in.arg1) {
+			log_error("SQUAREPROC returned a wrong result");
+			return -1;
+		}
+		/* Keep the square within the 32 bits of xdr_long */
+		in.arg1 = (in.arg1 + 1) & 0xffff;
+		ncalls++;
+	} while ((elapsed = rpctest_time() - t0) < runtime);
+
+	return 1e6 * elapsed / ncalls;
+}
+
+/*
+ * Mean time of a SQUAREVPROC call with size items, in usec
+ */
+static double
+batch_measure_vector(CLIENT *clnt, unsigned int size, double runtime)
+{
+	unsigned long ncalls = 0;
+	double t0, elapsed, usec = -1;
+	square_vec in, out;
+	unsigned int i;
+
+	in.square_vec_len = size;
+	in.square_vec_val = calloc(size, sizeof(long));
+	for (i = 0; i < size; ++i)
+		in.square_vec_val[i] = i;
+
+	t0 = rpctest_time();
+	do {
+		memset(&out, 0, sizeof(out));
+		if (clnt_call(clnt, SQUAREVPROC,
+				(xdrproc_t) xdr_square_vec, (caddr_t) &in,
+				(xdrproc_t) xdr_square_vec, (caddr_t) &out,
+				batch_call_timeout) != RPC_SUCCESS) {
+			log_error("%s", clnt_sperror(clnt, "SQUAREVPROC"));
+			goto out;
+		}
+		for (i = 0; i < size; ++i) {
+			if (out.square_vec_len != size
+			 || out.square_vec_val[i] != in.square_vec_val[i] * in.square_vec_val[i]) {
+				log_error("SQUAREVPROC returned a wrong result");
+				xdr_free((xdrproc_t) xdr_square_vec, (char *) &out);
+				goto out;
+			}
+		}
+		xdr_free((xdrproc_t) xdr_square_vec, (char *) &out);
+		ncalls++;
+	} while ((elapsed = rpctest_time() - t0) < runtime);
+
+	usec = 1e6 * elapsed / ncalls;
+
+out:
+	free(in.square_vec_val);
+	return usec;
+}
+
+static int
+batch_run_netid(const char *hostname, const char *netid, const struct batch_opts *opt)
+{
+	struct batch_result results[BATCH_MAX_SIZES];
+	unsigned int i, n = 0, breakeven = 0;
+	double single, sx = 0, sy = 0, sxx = 0, sxy = 0;
+	CLIENT *clnt;
+
+	clnt = clnt_create(hostname, SQUARE_PROG, SQUARE_VERS, netid);
+	if (clnt == NULL) {
+		log_error("%s: %s", netid, clnt_spcreateerror("unable to create client"));
+		return -1;
+	}
+
+	if ((single = batch_measure_single(clnt, opt->runtime)) < 0) {
+		clnt_destroy(clnt);
+		return -1;
+	}
+
+	for (i = 0; i < opt->num_sizes; ++i) {
+		struct batch_result *r = &results[n];
+
+		r->size = opt->sizes[i];
+		if ((r->usec = batch_measure_vector(clnt, r->size, opt->runtime)) < 0) {
+			/* Most likely, the call did not fit into a datagram */
+			log_error("%s: giving up at %u items", netid, r->size);
+			break;
+		}
+
+		printf("%-6s %8u %12.1f %12.1f %10.2f %8.2f\n",
+				netid, r->size, r->size * single, r->usec,
+				r->usec / r->size, r->size * single / r->usec);
+		fflush(stdout);
+
+		if (!breakeven && r->size > 1 && r->usec < r->size * single)
+			breakeven = r->size;
+
+		sx += r->size;
+		sy += r->usec;
+		sxx += (double) r->size * r->size;
+		sxy += r->size * r->usec;
+		n++;
+	}
+	clnt_destroy(clnt);
+
+	printf("%-6s single call: %.1f us\n", netid, single);
+
+	/* Least squares fit of usec = a + b * size */
+	if (n >= 2 && n * sxx - sx * sx > 0) {
+		double b = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+		double a = (sy - b * sx) / n;
+
+		printf("%-6s fixed cost per call: %.1f us, cost per item: %.3f us\n", netid, a, b);
+		if (b > 0)
+			printf("%-6s fixed cost is below the cost of the items beyond %.0f items\n",
+					netid, a / b);
+	}
+	if (breakeven)
+		printf("%-6s batching pays off from %u items\n", netid, breakeven);
+	else
+		printf("%-6s batching did not pay off for any size\n", netid);
+	printf("\n");
+
+	return n? 0 : -1;
+}
+
+int
+do_batch(const char *hostname, const char *netid, int argc, char **argv)
+{
+	struct batch_opts opt;
+	unsigned int i;
+	int exitval = 0;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.runtime = 2;
+	if (batch_opts_set(&opt, argc, argv) < 0)
+		return 1;
+
+	if (opt.num_sizes == 0) {
+		unsigned int size;
+
+		for (size = 1; size <= 1024; size *= 2)
+			opt.sizes[opt.num_sizes++] = size;
+	}
+
+	/* -T or -U on the command line restrict us to one transport */
+	if (netid) {
+		opt.netids[0] = netid;
+		opt.num_netids = 1;
+	}
+	if (opt.num_netids == 0) {
+		opt.netids[opt.num_netids++] = "tcp";
+		opt.netids[opt.num_netids++] = "udp";
+		opt.netids[opt.num_netids++] = "local";
+	}
+
+	printf("%-6s %8s %12s %12s %10s %8s\n",
+			"netid", "items", "single(us)", "batch(us)", "us/item", "speedup");
+	for (i = 0; i < opt.num_netids; ++i) {
+		if (batch_run_netid(hostname, opt.netids[i], &opt) < 0)
+			exitval = 1;
+	}
+
+	return exitval;
+}
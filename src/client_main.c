@@ -24,6 +24,14 @@
 #include "square.h"
 
 extern int	do_stress(const char *hostname, const char *netid, int argc, char **argv);
+extern int	do_sweep(const char *hostname, const char *netid, int argc, char **argv);
+extern int	do_bulk(const char *hostname, const char *netid, int argc, char **argv);
+extern int	do_batch(const char *hostname, const char *netid, int argc, char **argv);
+extern int	do_contend(const char *hostname, const char *netid, int argc, char **argv);
+extern int	do_storm(const char *hostname, const char *netid, int argc, char **argv);
+extern int	do_startup(const char *hostname, const char *netid, int argc, char **argv);
+extern int	do_idle(const char *hostname, const char *netid, int argc, char **argv);
+extern int	do_stats(const char *hostname, const char *netid, int argc, char **argv);
 
 int
 main(int argc, char **argv)
@@ -58,7 +66,16 @@ main(int argc, char **argv)
 		usage:
 			fprintf(stderr,
 				"Usage:\n"
-				"square [-h hostname] num ...\n");
+				"square [-h hostname] num ...\n"
+				"square [-h hostname] [-T|-U] stress [name=value ...]\n"
+				"square [-h hostname] sweep [name=value ...]\n"
+				"square [-h hostname] bulk [name=value ...]\n"
+				"square [-h hostname] [-T|-U] contend [name=value ...]\n"
+				"square [-h hostname] [-T|-U] batch [name=value ...]\n"
+				"square [-h hostname] idle [name=value ...]\n"
+				"square [-h hostname] storm [name=value ...]\n"
+				"square [-h hostname] [-T|-U] startup [name=value ...]\n"
+				"square [-h hostname] [-T|-U] stats [reset]\n");
 			return 1;
 		}
 	}
@@ -72,6 +89,33 @@ main(int argc, char **argv)
 		return do_stress(opt_hostname, opt_ipproto, argc - optind, argv + optind);
 	}
 
+	if (!strcmp(argv[optind], "sweep"))
+		return do_sweep(opt_hostname, opt_ipproto, argc - optind, argv + optind);
+
+	if (!strcmp(argv[optind], "bulk"))
+		return do_bulk(opt_hostname, opt_ipproto, argc - optind, argv + optind);
+
+	if (!strcmp(argv[optind], "contend")) {
+		if (opt_callit)
+			fprintf(stderr, "Ignoring -i (indirect) option\n");
+		return do_contend(opt_hostname, opt_ipproto, argc - optind, argv + optind);
+	}
+
+	if (!strcmp(argv[optind], "batch"))
+		return do_batch(opt_hostname, opt_ipproto, argc - optind, argv + optind);
+
+	if (!strcmp(argv[optind], "stats"))
+		return do_stats(opt_hostname, opt_ipproto, argc - optind, argv + optind);
+
+	if (!strcmp(argv[optind], "idle"))
+		return do_idle(opt_hostname, opt_ipproto, argc - optind, argv + optind);
+
+	if (!strcmp(argv[optind], "storm"))
+		return do_storm(opt_hostname, opt_ipproto, argc - optind, argv + optind);
+
+	if (!strcmp(argv[optind], "startup"))
+		return do_startup(opt_hostname, opt_ipproto, argc - optind, argv + optind);
+
 	if (opt_callit == 0) {
 		/* Default case: direct calls.
 		 * Create a client handle for the square server. */
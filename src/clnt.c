@@ -71,6 +71,8 @@ rpctest_verify_clnt_funcs(void)
 
 	log_test_group("client", "Verify client functions");
 
+	rpctest_rpcb_fixup(all_regs);
+
 	unsetenv("NETPATH");
 
 	log_test("Create service and register all transports");
@@ -83,15 +85,15 @@ rpctest_verify_clnt_funcs(void)
 	if (proc == NULL)
 		log_fatal("%s: unable to fork server process", __FUNCTION__);
 
-	rpctest_verify_clnt_create_vers(SQUARE_PROG, SQUARE_VERS, SQUARE_VERS);
+	rpctest_verify_clnt_create_vers(rpctest_prog, SQUARE_VERS, SQUARE_VERS);
 
 	srv_addr = loopback_address(AF_INET);
-	rpctest_verify_clnttcp_create(srv_addr, SQUARE_PROG, SQUARE_VERS);
-	rpctest_verify_clntudp_create(srv_addr, SQUARE_PROG, SQUARE_VERS);
-	rpctest_verify_clntunix_create(SQUARE_PROG, SQUARE_VERS);
+	rpctest_verify_clnttcp_create(srv_addr, rpctest_prog, SQUARE_VERS);
+	rpctest_verify_clntudp_create(srv_addr, rpctest_prog, SQUARE_VERS);
+	rpctest_verify_clntunix_create(rpctest_prog, SQUARE_VERS);
 
-	rpctest_verify_callrpc("localhost", SQUARE_PROG, SQUARE_VERS);
-	rpctest_verify_call_errors(srv_addr, SQUARE_PROG, SQUARE_VERS);
+	rpctest_verify_callrpc("localhost", rpctest_prog, SQUARE_VERS);
+	rpctest_verify_call_errors(srv_addr, rpctest_prog, SQUARE_VERS);
 
 	log_test("Verifying get_myaddress");
 	get_myaddress(&my_addr);
@@ -101,21 +103,21 @@ rpctest_verify_clnt_funcs(void)
 
 	my_addr.sin_port = 0;
 	if (memcmp(srv_addr, &my_addr, sizeof(my_addr))) {
-		rpctest_verify_clnttcp_create((struct sockaddr *) &my_addr, SQUARE_PROG, SQUARE_VERS);
-		rpctest_verify_clntudp_create((struct sockaddr *) &my_addr, SQUARE_PROG, SQUARE_VERS);
+		rpctest_verify_clnttcp_create((struct sockaddr *) &my_addr, rpctest_prog, SQUARE_VERS);
+		rpctest_verify_clntudp_create((struct sockaddr *) &my_addr, rpctest_prog, SQUARE_VERS);
 	}
 
 	log_test("Verify getrpcport()");
-	rpctest_verify_getrpcport(SQUARE_PROG, SQUARE_VERS, IPPROTO_UDP);
-	rpctest_verify_getrpcport(SQUARE_PROG, SQUARE_VERS, IPPROTO_TCP);
+	rpctest_verify_getrpcport(rpctest_prog, SQUARE_VERS, IPPROTO_UDP);
+	rpctest_verify_getrpcport(rpctest_prog, SQUARE_VERS, IPPROTO_TCP);
 
-	rpctest_verify_tcp_sendsz(srv_addr, SQUARE_PROG, SQUARE_VERS);
+	rpctest_verify_tcp_sendsz(srv_addr, rpctest_prog, SQUARE_VERS);
 
-	rpctest_verify_clnt_create_fail("localhost", SQUARE_PROG, SQUARE_VERS, "bad nettype", __BAD_NETTYPE, RPC_UNKNOWNPROTO);
-	rpctest_verify_clnt_create_fail("localhost", SQUARE_PROG, SQUARE_VERS, "huge nettype", __HUGE_NETTYPE, RPC_UNKNOWNPROTO);
+	rpctest_verify_clnt_create_fail("localhost", rpctest_prog, SQUARE_VERS, "bad nettype", __BAD_NETTYPE, RPC_UNKNOWNPROTO);
+	rpctest_verify_clnt_create_fail("localhost", rpctest_prog, SQUARE_VERS, "huge nettype", __HUGE_NETTYPE, RPC_UNKNOWNPROTO);
 
 #if 0
-	if (!rpctest_verify_clnt_create_fail("localhost", SQUARE_PROG, 5, "bad version", "tcp", RPC_UNKNOWNPROTO))
+	if (!rpctest_verify_clnt_create_fail("localhost", rpctest_prog, 5, "bad version", "tcp", RPC_UNKNOWNPROTO))
 		fprintf(stderr,
 			"    Editor's comment on the above failure:\n"
 			"      This is due to a design problem in libtirpc/rpcbind. If there is no registration \n"
@@ -125,19 +127,19 @@ rpctest_verify_clnt_funcs(void)
 #endif
 
 	setenv("NETPATH", "udp6", 1);
-	rpctest_verify_clnt_create_fail("127.0.0.1", SQUARE_PROG, SQUARE_VERS, "IPv4 address and IPv6 netid", "netpath", RPC_UNKNOWNHOST);
+	rpctest_verify_clnt_create_fail("127.0.0.1", rpctest_prog, SQUARE_VERS, "IPv4 address and IPv6 netid", "netpath", RPC_UNKNOWNHOST);
 	setenv("NETPATH", "udp", 1);
-	rpctest_verify_clnt_create_fail("::1", SQUARE_PROG, SQUARE_VERS, "IPv6 address and IPv4 netid", "netpath", RPC_UNKNOWNHOST);
+	rpctest_verify_clnt_create_fail("::1", rpctest_prog, SQUARE_VERS, "IPv6 address and IPv4 netid", "netpath", RPC_UNKNOWNHOST);
 	unsetenv("NETPATH");
-	rpctest_verify_clnt_create_fail(__HUGE_HOSTNAME, SQUARE_PROG, SQUARE_VERS, "huge hostname", "netpath", RPC_UNKNOWNHOST);
+	rpctest_verify_clnt_create_fail(__HUGE_HOSTNAME, rpctest_prog, SQUARE_VERS, "huge hostname", "netpath", RPC_UNKNOWNHOST);
 
 done:
 	if (proc)
 		rpctest_kill_process(proc);
 	rpctest_svc_cleanup(all_regs);
-	rpctest_rpcb_unset_wildcard(SQUARE_PROG);
+	rpctest_rpcb_unset_wildcard(rpctest_prog);
 
-	unlink(SQUARE_LOCAL_ADDR);
+	unlink(rpctest_local_addr);
 }
 
 /*
@@ -284,7 +286,7 @@ rpctest_verify_clntunix_create(rpcprog_t prog, rpcvers_t vers)
 		return 0;
 
 	case 0:
-		clnt = clntunix_create((struct sockaddr_un *) build_local_address(SQUARE_LOCAL_ADDR),
+		clnt = clntunix_create((struct sockaddr_un *) build_local_address(rpctest_local_addr),
 			prog, vers, &sockfd, 0, 0);
 		exit(0);
 
@@ -293,15 +295,15 @@ rpctest_verify_clntunix_create(rpcprog_t prog, rpcvers_t vers)
 
 	case 2:
 		log_fail("clntunix_create(%s, %lu, %lu) CRASHED with signal %u",
-				SQUARE_LOCAL_ADDR, prog, vers,
+				rpctest_local_addr, prog, vers,
 				termsig);
 		return 0;
 	}
 
-	clnt = clntunix_create((struct sockaddr_un *) build_local_address(SQUARE_LOCAL_ADDR),
+	clnt = clntunix_create((struct sockaddr_un *) build_local_address(rpctest_local_addr),
 			prog, vers, &sockfd, 0, 0);
 	if (clnt == NULL) {
-		log_fail("clntunix_create(%s, %lu, %lu) failed", SQUARE_LOCAL_ADDR, prog, vers);
+		log_fail("clntunix_create(%s, %lu, %lu) failed", rpctest_local_addr, prog, vers);
 		return 0;
 	}
 
@@ -0,0 +1,493 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * CLIENT handle contention benchmark.
+ *
+ * Runs SQUAREPROC calls from 1..N threads, either all sharing one
+ * CLIENT handle, or each thread using a handle of its own, and reports
+ * how throughput scales with the number of threads.
+ *
+ * libtirpc serializes calls on a CLIENT handle through a per-fd lock.
+ * By default, we wrap the shared handle in a mutex of our own so that
+ * the time spent waiting for the handle can be measured directly (the
+ * library lock is then never contended). With lock=tirpc, we leave the
+ * serialization to libtirpc, and estimate the wait time as the increase
+ * in call latency over the single threaded case.
+ *
+ * Try this:
+ *  ./rpc.squared -T udp -T tcp -T local
+ *  ./square contend threads=16 runtime=5
+ *
+ * With cpus=<cpulist>, thread N is pinned to the N-th CPU of the list.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include "rpctest.h"
+
+#define CONTEND_MAX_NETIDS	8
+
+enum {
+	CONTEND_SHARED,
+	CONTEND_PRIVATE,
+};
+
+struct contend_opts {
+	unsigned int		max_threads;
+	double			runtime;
+	int			explicit_lock;
+
+	unsigned int		num_netids;
+	const char *		netids[CONTEND_MAX_NETIDS];
+
+	int			modes[2];
+	unsigned int		num_modes;
+
+	int			pinned;
+	cpu_set_t		cpus;
+};
+
+struct contend_run {
+	const char *		hostname;
+	struct netconfig *	nconf;
+	int			mode;
+	int			explicit_lock;
+	unsigned int		nthreads;
+	const cpu_set_t *	cpus;
+
+	CLIENT *		shared_clnt;
+	pthread_mutex_t		clnt_lock;
+
+	pthread_barrier_t	start;
+	volatile int		stop;
+};
+
+struct contend_thread {
+	pthread_t		thread;
+	unsigned int		index;
+	struct contend_run *	run;
+
+	CLIENT *		clnt;
+
+	unsigned long		ncalls;
+	unsigned long		nerrors;
+	struct latency		latency;
+	struct latency		lockwait;
+};
+
+struct contend_result {
+	unsigned int		nthreads;
+	double			elapsed;
+	unsigned long		ncalls;
+	unsigned long		nerrors;
+	struct latency		latency;
+	struct latency		lockwait;
+};
+
+static const char *	contend_mode_name[] = {
+	[CONTEND_SHARED]	= "shared",
+	[CONTEND_PRIVATE]	= "private",
+};
+
+static struct timeval	contend_call_timeout = { 25, 0 };
+
+static int		contend_run_netid(const char *hostname, const char *netid, const struct contend_opts *opt);
+static int		contend_run_one(struct contend_run *run, double runtime, struct contend_result *res);
+static void *		contend_thread_main(void *);
+static void		contend_print_result(const char *netid, int mode, const struct contend_result *res,
+				const struct contend_result *base, int explicit_lock);
+
+static void
+contend_opts_init_defaults(struct contend_opts *opt)
+{
+	memset(opt, 0, sizeof(*opt));
+	opt->max_threads = 8;
+	opt->runtime = 5;
+	opt->explicit_lock = 1;
+}
+
+static int
+contend_split_list(char *value, const char **array, unsigned int max)
+{
+	unsigned int count = 0;
+	char *s;
+
+	for (s = strtok(value, ","); s; s = strtok(NULL, ",")) {
+		if (count >= max) {
+			log_error("too many list elements");
+			return -1;
+		}
+		array[count++] = s;
+	}
+	return count;
+}
+
+static int
+contend_opts_set(struct contend_opts *opt, int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		char *name = argv[i];
+		char *value;
+
+		if ((value = strchr(name, '=')) != NULL)
+			*value++ = '\0';
+
+		if (value == NULL) {
+			log_error("missing value to %s argument", name);
+			return -1;
+		}
+
+		if (!strcmp(name, "threads") || !strcmp(name, "runtime")) {
+			unsigned long number;
+			char *s;
+
+			number = strtoul(value, &s, 0);
+			if (*s || number == 0) {
+				log_error("cannot parse numeric value to %s=%s", name, value);
+				return -1;
+			}
+			if (!strcmp(name, "threads"))
+				opt->max_threads = number;
+			else
+				opt->runtime = number;
+		} else
+		if (!strcmp(name, "netid")) {
+			int n;
+
+			if ((n = contend_split_list(value, opt->netids, CONTEND_MAX_NETIDS)) < 0)
+				return -1;
+			opt->num_netids = n;
+		} else
+		if (!strcmp(name, "mode")) {
+			const char *modes[2];
+			int j, n;
+
+			if ((n = contend_split_list(value, modes, 2)) < 0)
+				return -1;
+			for (j = 0; j < n; ++j) {
+				if (!strcmp(modes[j], "shared"))
+					opt->modes[j] = CONTEND_SHARED;
+				else if (!strcmp(modes[j], "private"))
+					opt->modes[j] = CONTEND_PRIVATE;
+				else {
+					log_error("unknown mode \"%s\"", modes[j]);
+					return -1;
+				}
+			}
+			opt->num_modes = n;
+		} else
+		if (!strcmp(name, "cpus")) {
+			if (rpctest_cpuset_parse(value, &opt->cpus) < 0)
+				return -1;
+			opt->pinned = 1;
+		} else
+		if (!strcmp(name, "lock")) {
+			if (!strcmp(value, "explicit"))
+				opt->explicit_lock = 1;
+			else if (!strcmp(value, "tirpc"))
+				opt->explicit_lock = 0;
+			else {
+				log_error("lock must be either \"explicit\" or \"tirpc\"");
+				return -1;
+			}
+		} else {
+			log_error("unknown argument \"%s\"", name);
+			return -1;
+		}
+	}
+
+	if (opt->num_netids == 0) {
+		opt->netids[opt->num_netids++] = "tcp";
+		opt->netids[opt->num_netids++] = "udp";
+		opt->netids[opt->num_netids++] = "local";
+	}
+	if (opt->num_modes == 0) {
+		opt->modes[opt->num_modes++] = CONTEND_SHARED;
+		opt->modes[opt->num_modes++] = CONTEND_PRIVATE;
+	}
+
+	return 0;
+}
+
+int
+do_contend(const char *hostname, const char *netid, int argc, char **argv)
+{
+	struct contend_opts opt;
+	unsigned int i;
+	int exitval = 0;
+
+	contend_opts_init_defaults(&opt);
+	if (contend_opts_set(&opt, argc, argv) < 0)
+		return 1;
+
+	/* -T or -U on the command line restrict us to one transport */
+	if (netid) {
+		opt.netids[0] = netid;
+		opt.num_netids = 1;
+	}
+
+	if (opt.pinned) {
+		struct rpctest_placement pl;
+
+		rpctest_cpuset_topology(&opt.cpus, &pl);
+		printf("Client placement: %s\n", rpctest_placement_print(&pl));
+	}
+
+	printf("%-6s %-8s %7s %10s %8s %10s %10s %10s\n",
+			"netid", "mode", "threads", "calls/s", "scaling",
+			"mean(us)", "p99(us)", "wait(us)");
+
+	for (i = 0; i < opt.num_netids; ++i) {
+		if (contend_run_netid(hostname, opt.netids[i], &opt) < 0)
+			exitval = 1;
+	}
+
+	return exitval;
+}
+
+static int
+contend_run_netid(const char *hostname, const char *netid, const struct contend_opts *opt)
+{
+	struct netconfig *nconf;
+	unsigned int m;
+	int rv = 0;
+
+	if ((nconf = getnetconfigent(netid)) == NULL) {
+		log_error("unknown netid %s", netid);
+		return -1;
+	}
+
+	for (m = 0; m < opt->num_modes; ++m) {
+		struct contend_result base;
+		unsigned int nthreads;
+
+		memset(&base, 0, sizeof(base));
+		for (nthreads = 1; ; nthreads *= 2) {
+			struct contend_run run;
+			struct contend_result res;
+
+			if (nthreads > opt->max_threads)
+				nthreads = opt->max_threads;
+
+			memset(&run, 0, sizeof(run));
+			run.hostname = hostname;
+			run.nconf = nconf;
+			run.mode = opt->modes[m];
+			run.explicit_lock = opt->explicit_lock;
+			run.nthreads = nthreads;
+			run.cpus = opt->pinned? &opt->cpus : NULL;
+
+			if (contend_run_one(&run, opt->runtime, &res) < 0) {
+				rv = -1;
+				break;
+			}
+
+			if (nthreads == 1)
+				base = res;
+			contend_print_result(netid, run.mode, &res, &base, opt->explicit_lock);
+
+			if (nthreads >= opt->max_threads)
+				break;
+		}
+	}
+
+	freenetconfigent(nconf);
+	return rv;
+}
+
+static CLIENT *
+contend_create_client(struct contend_run *run)
+{
+	CLIENT *clnt;
+
+	clnt = clnt_tp_create(run->hostname, SQUARE_PROG, SQUARE_VERS, run->nconf);
+	if (clnt == NULL)
+		log_error("%s: %s", run->nconf->nc_netid, clnt_spcreateerror("unable to create client"));
+	return clnt;
+}
+
+static int
+contend_run_one(struct contend_run *run, double runtime, struct contend_result *res)
+{
+	struct contend_thread *threads;
+	struct timespec ts;
+	double t0;
+	unsigned int i;
+	int rv = -1;
+
+	memset(res, 0, sizeof(*res));
+	res->nthreads = run->nthreads;
+	latency_init(&res->latency);
+	latency_init(&res->lockwait);
+
+	threads = calloc(run->nthreads, sizeof(threads[0]));
+
+	if (run->mode == CONTEND_SHARED) {
+		if (!(run->shared_clnt = contend_create_client(run)))
+			goto out;
+		pthread_mutex_init(&run->clnt_lock, NULL);
+	}
+
+	for (i = 0; i < run->nthreads; ++i) {
+		struct contend_thread *t = &threads[i];
+
+		t->index = i;
+		t->run = run;
+		if (run->mode == CONTEND_SHARED) {
+			t->clnt = run->shared_clnt;
+		} else
+		if (!(t->clnt = contend_create_client(run))) {
+			goto out;
+		}
+		latency_init(&t->latency);
+		latency_init(&t->lockwait);
+	}
+
+	/* All worker threads, plus ourselves */
+	pthread_barrier_init(&run->start, NULL, run->nthreads + 1);
+
+	for (i = 0; i < run->nthreads; ++i) {
+		if (pthread_create(&threads[i].thread, NULL, contend_thread_main, &threads[i]) != 0)
+			log_fatal("unable to create thread: %m");
+	}
+
+	pthread_barrier_wait(&run->start);
+	t0 = rpctest_time();
+
+	ts.tv_sec = runtime;
+	ts.tv_nsec = (runtime - ts.tv_sec) * 1e9;
+	while (nanosleep(&ts, &ts) < 0)
+		;
+	run->stop = 1;
+
+	for (i = 0; i < run->nthreads; ++i) {
+		struct contend_thread *t = &threads[i];
+
+		pthread_join(t->thread, NULL);
+		res->ncalls += t->ncalls;
+		res->nerrors += t->nerrors;
+		latency_merge(&res->latency, &t->latency);
+		latency_merge(&res->lockwait, &t->lockwait);
+	}
+	res->elapsed = rpctest_time() - t0;
+
+	pthread_barrier_destroy(&run->start);
+	rv = 0;
+
+out:
+	if (run->mode == CONTEND_SHARED) {
+		if (run->shared_clnt) {
+			clnt_destroy(run->shared_clnt);
+			pthread_mutex_destroy(&run->clnt_lock);
+		}
+	} else {
+		for (i = 0; i < run->nthreads; ++i) {
+			if (threads[i].clnt)
+				clnt_destroy(threads[i].clnt);
+		}
+	}
+	free(threads);
+	return rv;
+}
+
+static void *
+contend_thread_main(void *p)
+{
+	struct contend_thread *t = p;
+	struct contend_run *run = t->run;
+	int use_lock = run->mode == CONTEND_SHARED && run->explicit_lock;
+	square_in in;
+	square_out out;
+
+	if (run->cpus)
+		rpctest_cpuset_pin_thread(run->cpus, t->index);
+
+	pthread_barrier_wait(&run->start);
+
+	in.arg1 = t->index & 0xffff;
+	while (!run->stop) {
+		enum clnt_stat st;
+		double t0, t1;
+
+		t0 = rpctest_time();
+		if (use_lock) {
+			pthread_mutex_lock(&run->clnt_lock);
+			t1 = rpctest_time();
+			latency_add(&t->lockwait, 1e6 * (t1 - t0));
+		}
+
+		st = clnt_call(t->clnt, SQUAREPROC,
+				(xdrproc_t) xdr_square_in, (caddr_t) &in,
+				(xdrproc_t) xdr_square_out, (caddr_t) &out,
+				contend_call_timeout);
+
+		if (use_lock)
+			pthread_mutex_unlock(&run->clnt_lock);
+
+		latency_add_since(&t->latency, t0);
+
+		if (st != RPC_SUCCESS || out.res1 != in.arg1 * in.arg1)
+			t->nerrors++;
+		else
+			t->ncalls++;
+
+		/* Keep the square within the 32 bits of xdr_long */
+		in.arg1 = (in.arg1 + 1) & 0xffff;
+	}
+
+	return NULL;
+}
+
+static void
+contend_print_result(const char *netid, int mode, const struct contend_result *res,
+				const struct contend_result *base, int explicit_lock)
+{
+	double rate, base_rate, wait;
+
+	rate = res->ncalls / res->elapsed;
+	base_rate = base->ncalls / base->elapsed;
+
+	if (mode != CONTEND_SHARED) {
+		wait = 0;
+	} else
+	if (explicit_lock) {
+		wait = latency_mean(&res->lockwait);
+	} else {
+		/* Estimate: whatever the call takes longer than in the
+		 * uncontended single-threaded case */
+		wait = latency_mean(&res->latency) - latency_mean(&base->latency);
+		if (wait < 0)
+			wait = 0;
+	}
+
+	printf("%-6s %-8s %7u %10.0f %7.2fx %10.1f %10.1f %10.1f",
+			netid, contend_mode_name[mode], res->nthreads,
+			rate, base_rate? rate / base_rate : 0,
+			latency_mean(&res->latency),
+			latency_percentile(&res->latency, 99),
+			wait);
+	if (res->nerrors)
+		printf(" (%lu errors)", res->nerrors);
+	printf("\n");
+	fflush(stdout);
+}
@@ -0,0 +1,360 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * CPU placement of benchmark clients and servers.
+ *
+ * A CPU list is a comma separated list of items, each of which can be
+ *	N or N-M	CPU N, or CPUs N through M
+ *	socketN		all CPUs in physical package N
+ *	nodeN		all CPUs in NUMA node N
+ *	coreN		all SMT threads of the core CPU N belongs to
+ * Any item prefixed with ^ is removed from the set instead of added.
+ * Items are evaluated left to right, so "socket0,^core0" means all
+ * of socket 0 except the first core, and "core0,^0" is the SMT sibling
+ * of CPU 0.
+ */
+#include <sched.h>
+#include <pthread.h>
+#include <ctype.h>
+#include <stdio.h>
+#include "rpctest.h"
+
+#define SYSFS_CPU_DIR		"/sys/devices/system/cpu"
+#define SYSFS_NODE_DIR		"/sys/devices/system/node"
+
+static int
+__cpuset_read_int(const char *fmt, unsigned int cpu)
+{
+	char path[256];
+	FILE *fp;
+	int value = -1;
+
+	snprintf(path, sizeof(path), fmt, cpu);
+	if ((fp = fopen(path, "r")) == NULL)
+		return -1;
+	if (fscanf(fp, "%d", &value) != 1)
+		value = -1;
+	fclose(fp);
+	return value;
+}
+
+static int
+__cpuset_socket_of(unsigned int cpu)
+{
+	return __cpuset_read_int(SYSFS_CPU_DIR "/cpu%u/topology/physical_package_id", cpu);
+}
+
+static int
+__cpuset_core_of(unsigned int cpu)
+{
+	return __cpuset_read_int(SYSFS_CPU_DIR "/cpu%u/topology/core_id", cpu);
+}
+
+/*
+ * Parse a plain numeric CPU list such as "0-3,8,10-11", the way the
+ * kernel prints it in sysfs.
+ */
+static int
+__cpuset_parse_numeric(const char *s, cpu_set_t *set)
+{
+	while (*s) {
+		unsigned long first, last;
+		char *end;
+
+		first = last = strtoul(s, &end, 10);
+		if (end == s)
+			return -1;
+		if (*end == '-') {
+			s = end + 1;
+			last = strtoul(s, &end, 10);
+			if (end == s || last < first)
+				return -1;
+		}
+		for (; first <= last && first < CPU_SETSIZE; ++first)
+			CPU_SET(first, set);
+
+		s = end;
+		if (*s == ',')
+			++s;
+		else if (*s && *s != '\n')
+			return -1;
+		else
+			break;
+	}
+	return 0;
+}
+
+static int
+__cpuset_read_list(const char *fmt, unsigned int index, cpu_set_t *set)
+{
+	char path[256], line[4096];
+	FILE *fp;
+	int rv = -1;
+
+	snprintf(path, sizeof(path), fmt, index);
+	if ((fp = fopen(path, "r")) == NULL) {
+		log_error("%s: %m", path);
+		return -1;
+	}
+	if (fgets(line, sizeof(line), fp) != NULL)
+		rv = __cpuset_parse_numeric(line, set);
+	fclose(fp);
+	return rv;
+}
+
+static int
+__cpuset_parse_item(const char *item, cpu_set_t *set)
+{
+	unsigned int cpu, n;
+	char *end;
+
+	CPU_ZERO(set);
+
+	if (!strncmp(item, "socket", 6)) {
+		n = strtoul(item + 6, &end, 10);
+		if (end == item + 6 || *end)
+			return -1;
+		for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			int socket = __cpuset_socket_of(cpu);
+
+			if (socket < 0)
+				break;
+			if (socket == n)
+				CPU_SET(cpu, set);
+		}
+		if (CPU_COUNT(set) == 0) {
+			log_error("no CPUs on socket %u", n);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!strncmp(item, "node", 4)) {
+		n = strtoul(item + 4, &end, 10);
+		if (end == item + 4 || *end)
+			return -1;
+		return __cpuset_read_list(SYSFS_NODE_DIR "/node%u/cpulist", n, set);
+	}
+
+	if (!strncmp(item, "core", 4)) {
+		n = strtoul(item + 4, &end, 10);
+		if (end == item + 4 || *end)
+			return -1;
+		return __cpuset_read_list(SYSFS_CPU_DIR "/cpu%u/topology/thread_siblings_list", n, set);
+	}
+
+	if (isdigit(*item))
+		return __cpuset_parse_numeric(item, set);
+
+	return -1;
+}
+
+int
+rpctest_cpuset_parse(const char *string, cpu_set_t *result)
+{
+	char *copy, *item;
+	int rv = 0;
+
+	CPU_ZERO(result);
+
+	copy = strdup(string);
+	for (item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+		int exclude = 0;
+		cpu_set_t cpus;
+
+		if (*item == '^') {
+			exclude = 1;
+			item++;
+		}
+
+		if (__cpuset_parse_item(item, &cpus) < 0) {
+			log_error("cannot parse CPU list item \"%s\"", item);
+			rv = -1;
+			break;
+		}
+
+		if (exclude) {
+			unsigned int cpu;
+
+			for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+				if (CPU_ISSET(cpu, &cpus))
+					CPU_CLR(cpu, result);
+			}
+		} else {
+			CPU_OR(result, result, &cpus);
+		}
+	}
+	free(copy);
+
+	if (rv == 0 && CPU_COUNT(result) == 0) {
+		log_error("CPU list \"%s\" is empty", string);
+		rv = -1;
+	}
+	return rv;
+}
+
+/*
+ * Return the index'th CPU of the set, wrapping around.
+ */
+static int
+__cpuset_nth(const cpu_set_t *set, unsigned int index)
+{
+	unsigned int count = CPU_COUNT(set), cpu;
+
+	if (count == 0)
+		return -1;
+
+	index %= count;
+	for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (CPU_ISSET(cpu, set) && index-- == 0)
+			return cpu;
+	}
+	return -1;
+}
+
+/*
+ * Pin the calling thread. With index < 0, we allow the thread
+ * to run on any CPU of the set; otherwise we pin it to the
+ * index'th CPU of the set. This is what you want when distributing
+ * a number of worker threads across a CPU list.
+ */
+int
+rpctest_cpuset_pin_thread(const cpu_set_t *set, int index)
+{
+	cpu_set_t target;
+	int err;
+
+	if (index < 0) {
+		target = *set;
+	} else {
+		CPU_ZERO(&target);
+		CPU_SET(__cpuset_nth(set, index), &target);
+	}
+
+	err = pthread_setaffinity_np(pthread_self(), sizeof(target), &target);
+	if (err != 0) {
+		log_error("unable to set CPU affinity: %s", strerror(err));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Get the affinity of the calling thread
+ */
+int
+rpctest_cpuset_current(cpu_set_t *set)
+{
+	CPU_ZERO(set);
+	if (pthread_getaffinity_np(pthread_self(), sizeof(*set), set) != 0)
+		return -1;
+	return 0;
+}
+
+static void
+__cpuset_format_ids(char *buf, size_t size, const unsigned char *seen, unsigned int max)
+{
+	unsigned int i, len = 0;
+
+	buf[0] = '\0';
+	for (i = 0; i < max && len < size; ++i) {
+		unsigned int j;
+
+		if (!seen[i])
+			continue;
+		for (j = i; j + 1 < max && seen[j + 1]; ++j)
+			;
+		if (j == i)
+			len += snprintf(buf + len, size - len, "%s%u", len? "," : "", i);
+		else
+			len += snprintf(buf + len, size - len, "%s%u-%u", len? "," : "", i, j);
+		i = j;
+	}
+}
+
+const char *
+rpctest_cpuset_format(const cpu_set_t *set)
+{
+	static char buffer[1024];
+	unsigned char seen[CPU_SETSIZE];
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		seen[cpu] = CPU_ISSET(cpu, set);
+	__cpuset_format_ids(buffer, sizeof(buffer), seen, CPU_SETSIZE);
+	return buffer;
+}
+
+/*
+ * Describe where a CPU set lives, in terms of sockets and cores.
+ */
+void
+rpctest_cpuset_topology(const cpu_set_t *set, struct rpctest_placement *pl)
+{
+	unsigned char sockets[CPU_SETSIZE];
+	unsigned int cores[CPU_SETSIZE];
+	unsigned int cpu, i;
+
+	memset(pl, 0, sizeof(*pl));
+	memset(sockets, 0, sizeof(sockets));
+
+	snprintf(pl->cpus, sizeof(pl->cpus), "%s", rpctest_cpuset_format(set));
+
+	for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		int socket, core;
+
+		if (!CPU_ISSET(cpu, set))
+			continue;
+
+		socket = __cpuset_socket_of(cpu);
+		core = __cpuset_core_of(cpu);
+		if (socket < 0 || core < 0 || socket >= CPU_SETSIZE)
+			continue;
+
+		sockets[socket] = 1;
+
+		/* Count distinct (socket, core) pairs; several threads
+		 * on the same core means we're sharing SMT siblings */
+		for (i = 0; i < pl->ncores; ++i) {
+			if (cores[i] == (socket << 16 | core))
+				break;
+		}
+		if (i < pl->ncores)
+			pl->smt_shared = 1;
+		else
+			cores[pl->ncores++] = socket << 16 | core;
+	}
+	pl->ncpus = CPU_COUNT(set);
+
+	__cpuset_format_ids(pl->sockets, sizeof(pl->sockets), sockets, CPU_SETSIZE);
+}
+
+const char *
+rpctest_placement_print(const struct rpctest_placement *pl)
+{
+	static char buffer[1400];
+
+	snprintf(buffer, sizeof(buffer), "cpus %s (%u cpus, %u cores, socket %s%s)",
+			pl->cpus, pl->ncpus, pl->ncores,
+			pl->sockets[0]? pl->sockets : "unknown",
+			pl->smt_shared? ", shares SMT siblings" : "");
+	return buffer;
+}
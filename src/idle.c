@@ -0,0 +1,303 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Idle connection scaling benchmark.
+ *
+ * Opens a growing number of idle connections to the server, and
+ * measures the rate of SQUAREPROC calls a single active client gets
+ * at each step. A server that looks at every connection on each
+ * wakeup slows down as the number of idle connections grows.
+ *
+ * Try this, once with and once without -E:
+ *  ./rpc.squared -T tcp -E
+ *  ./square idle conns=0,1000,10000,50000 server-pid=$(pidof rpc.squared)
+ *
+ * With server-pid=, we also report how much CPU the server spent
+ * per call, by looking at /proc/<pid>/stat.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include "rpctest.h"
+
+#define IDLE_MAX_STEPS		16
+
+/* Beyond this many connections, we run out of ephemeral ports on
+ * a single loopback address */
+#define IDLE_CONNS_PER_ADDR	25000
+
+struct idle_opts {
+	unsigned int		num_steps;
+	unsigned int		conns[IDLE_MAX_STEPS];
+	double			runtime;
+	pid_t			server_pid;
+};
+
+static struct timeval	idle_call_timeout = { 25, 0 };
+
+static int
+idle_opts_set(struct idle_opts *opt, int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		char *name = argv[i];
+		char *value, *s;
+
+		if ((value = strchr(name, '=')) != NULL)
+			*value++ = '\0';
+
+		if (value == NULL) {
+			log_error("missing value to %s argument", name);
+			return -1;
+		}
+
+		if (!strcmp(name, "conns")) {
+			opt->num_steps = 0;
+			for (s = strtok(value, ","); s; s = strtok(NULL, ",")) {
+				char *end;
+
+				if (opt->num_steps >= IDLE_MAX_STEPS) {
+					log_error("too many steps in conns=");
+					return -1;
+				}
+				opt->conns[opt->num_steps] = strtoul(s, &end, 0);
+				if (*end) {
+					log_error("cannot parse conns=%s", s);
+					return -1;
+				}
+				if (opt->num_steps && opt->conns[opt->num_steps] < opt->conns[opt->num_steps - 1]) {
+					log_error("conns= must be increasing");
+					return -1;
+				}
+				opt->num_steps++;
+			}
+			if (opt->num_steps == 0) {
+				log_error("conns= needs at least one value");
+				return -1;
+			}
+		} else
+		if (!strcmp(name, "runtime") || !strcmp(name, "server-pid")) {
+			unsigned long number;
+
+			number = strtoul(value, &s, 0);
+			if (*s || number == 0) {
+				log_error("cannot parse numeric value to %s=%s", name, value);
+				return -1;
+			}
+			if (!strcmp(name, "runtime"))
+				opt->runtime = number;
+			else
+				opt->server_pid = number;
+		} else {
+			log_error("unknown argument \"%s\"", name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * CPU time used by a process, in seconds
+ */
+static double
+idle_process_cputime(pid_t pid)
+{
+	unsigned long utime, stime;
+	char path[64], buffer[1024], *s;
+	FILE *fp;
+	int n;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+	if ((fp = fopen(path, "r")) == NULL)
+		return -1;
+	n = fread(buffer, 1, sizeof(buffer) - 1, fp);
+	fclose(fp);
+	buffer[n > 0? n : 0] = '\0';
+
+	/* The command name may contain blanks; skip past it */
+	if ((s = strrchr(buffer, ')')) == NULL)
+		return -1;
+	if (sscanf(s + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+		return -1;
+	return (double) (utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static int
+idle_connect(const struct netbuf *addr, unsigned int index)
+{
+	const struct sockaddr *sa = (const struct sockaddr *) addr->buf;
+	int fd;
+
+	if ((fd = socket(sa->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return -1;
+
+	/* On loopback, spread connections across 127.0.0.0/8 so that we
+	 * don't run out of ephemeral ports */
+	if (sa->sa_family == AF_INET
+	 && (ntohl(((const struct sockaddr_in *) sa)->sin_addr.s_addr) >> 24) == 127) {
+		struct sockaddr_in src;
+		int one = 1;
+
+		memset(&src, 0, sizeof(src));
+		src.sin_family = AF_INET;
+		src.sin_addr.s_addr = htonl(INADDR_LOOPBACK + index / IDLE_CONNS_PER_ADDR);
+		setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+		if (bind(fd, (struct sockaddr *) &src, sizeof(src)) < 0) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	if (connect(fd, sa, addr->len) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int
+idle_measure(CLIENT *clnt, double runtime, const struct idle_opts *opt, unsigned int nconns, int report)
+{
+	unsigned long ncalls = 0, nerrors = 0;
+	struct latency latency;
+	double t0, elapsed, cpu0 = 0, cpu1 = 0;
+	square_in in;
+	square_out out;
+
+	latency_init(&latency);
+
+	if (opt->server_pid)
+		cpu0 = idle_process_cputime(opt->server_pid);
+
+	t0 = rpctest_time();
+	do {
+		double begin = rpctest_time();
+
+		in.arg1 = ncalls;
+		if (clnt_call(clnt, SQUAREPROC,
+				(xdrproc_t) xdr_square_in, (caddr_t) &in,
+				(xdrproc_t) xdr_square_out, (caddr_t) &out,
+				idle_call_timeout) != RPC_SUCCESS) {
+			clnt_perror(clnt, "SQUAREPROC");
+			nerrors++;
+			if (nerrors > 10)
+				return -1;
+			continue;
+		}
+		latency_add_since(&latency, begin);
+		ncalls++;
+	} while ((elapsed = rpctest_time() - t0) < runtime);
+
+	if (opt->server_pid)
+		cpu1 = idle_process_cputime(opt->server_pid);
+
+	if (!report)
+		return 0;
+
+	printf("%8u %10.0f %10.1f %10.1f",
+			nconns, ncalls / elapsed,
+			latency_mean(&latency),
+			latency_percentile(&latency, 99));
+	if (opt->server_pid && cpu0 >= 0 && cpu1 >= 0 && ncalls)
+		printf(" %12.2f", 1e6 * (cpu1 - cpu0) / ncalls);
+	printf("\n");
+	return 0;
+}
+
+int
+do_idle(const char *hostname, const char *netid, int argc, char **argv)
+{
+	struct idle_opts opt;
+	struct netconfig *nconf;
+	struct netbuf addr;
+	char addrbuf[128];
+	CLIENT *clnt;
+	unsigned int step, nconns = 0, limit;
+	int *fds, rv = 1;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.runtime = 5;
+	opt.conns[0] = 0;
+	opt.conns[1] = 1000;
+	opt.conns[2] = 10000;
+	opt.num_steps = 3;
+	if (idle_opts_set(&opt, argc, argv) < 0)
+		return 1;
+
+	limit = rpctest_raise_fd_limit();
+	if (opt.conns[opt.num_steps - 1] + 16 > limit) {
+		log_error("file limit of %u is too low for %u connections", limit, opt.conns[opt.num_steps - 1]);
+		return 1;
+	}
+
+	if ((nconf = getnetconfigent(netid? : "tcp")) == NULL) {
+		log_error("unknown netid %s", netid? : "tcp");
+		return 1;
+	}
+	if (nconf->nc_semantics == NC_TPI_CLTS) {
+		log_error("idle connections need a connection oriented transport");
+		return 1;
+	}
+
+	addr.buf = addrbuf;
+	addr.maxlen = sizeof(addrbuf);
+	if (!rpcb_getaddr(SQUARE_PROG, SQUARE_VERS, nconf, &addr, hostname)) {
+		log_error("%s", clnt_spcreateerror("unable to get server address"));
+		return 1;
+	}
+
+	clnt = clnt_tp_create(hostname, SQUARE_PROG, SQUARE_VERS, nconf);
+	if (clnt == NULL) {
+		log_error("%s", clnt_spcreateerror("unable to create client"));
+		return 1;
+	}
+
+	fds = calloc(opt.conns[opt.num_steps - 1] + 1, sizeof(int));
+
+	printf("%8s %10s %10s %10s%s\n", "idle", "calls/s", "mean(us)", "p99(us)",
+			opt.server_pid? "  srv-us/call" : "");
+	for (step = 0; step < opt.num_steps; ++step) {
+		while (nconns < opt.conns[step]) {
+			if ((fds[nconns] = idle_connect(&addr, nconns)) < 0) {
+				log_error("connection %u failed: %m", nconns);
+				goto out;
+			}
+			nconns++;
+		}
+
+		/* Let the server accept everything before we start measuring */
+		if (idle_measure(clnt, 1, &opt, nconns, 0) < 0
+		 || idle_measure(clnt, opt.runtime, &opt, nconns, 1) < 0)
+			goto out;
+	}
+	rv = 0;
+
+out:
+	while (nconns)
+		close(fds[--nconns]);
+	clnt_destroy(clnt);
+	freenetconfigent(nconf);
+	return rv;
+}
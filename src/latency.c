@@ -0,0 +1,183 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Latency recording for the benchmark tools.
+ *
+ * Values are recorded in nanoseconds into log-linear buckets: every
+ * power of two is split into 2^LATENCY_SUBBITS linear sub-buckets,
+ * which gives us a relative error of about 12% across the whole range
+ * from nanoseconds to minutes, at a fixed cost of a few KB per histogram.
+ */
+#include <time.h>
+#include "rpctest.h"
+
+#define LATENCY_SUBCOUNT	(1 << LATENCY_SUBBITS)
+#define LATENCY_SUBMASK		(LATENCY_SUBCOUNT - 1)
+
+/*
+ * Monotonic time stamp in seconds
+ */
+double
+rpctest_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static unsigned int
+__latency_index(unsigned long nsec)
+{
+	unsigned int msb, idx;
+
+	if (nsec < LATENCY_SUBCOUNT)
+		return nsec;
+
+	msb = 63 - __builtin_clzl(nsec);
+	idx = ((msb - LATENCY_SUBBITS + 1) << LATENCY_SUBBITS)
+	    + ((nsec >> (msb - LATENCY_SUBBITS)) & LATENCY_SUBMASK);
+	if (idx >= LATENCY_NBUCKETS)
+		idx = LATENCY_NBUCKETS - 1;
+	return idx;
+}
+
+/*
+ * Upper bound of a bucket, in nanoseconds
+ */
+static double
+__latency_bucket_limit(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < LATENCY_SUBCOUNT)
+		return idx + 1;
+
+	shift = (idx >> LATENCY_SUBBITS) - 1;
+	return (double) (LATENCY_SUBCOUNT + (idx & LATENCY_SUBMASK) + 1) * (1UL << shift);
+}
+
+/*
+ * Index of the bucket a value in usec goes into. This is for callers
+ * that keep their own bucket arrays, eg in shared memory.
+ */
+unsigned int
+latency_bucket(double usec)
+{
+	if (usec < 0)
+		usec = 0;
+	return __latency_index(usec * 1000);
+}
+
+void
+latency_init(struct latency *lat)
+{
+	memset(lat, 0, sizeof(*lat));
+}
+
+void
+latency_add(struct latency *lat, double usec)
+{
+	unsigned long nsec;
+
+	if (usec < 0)
+		usec = 0;
+	nsec = usec * 1000;
+
+	if (lat->count == 0 || usec < lat->min)
+		lat->min = usec;
+	if (usec > lat->max)
+		lat->max = usec;
+	lat->sum += usec;
+	lat->count++;
+
+	lat->buckets[__latency_index(nsec)]++;
+}
+
+/*
+ * Record the time elapsed since t0 (as returned by rpctest_time)
+ */
+void
+latency_add_since(struct latency *lat, double t0)
+{
+	latency_add(lat, 1e6 * (rpctest_time() - t0));
+}
+
+void
+latency_merge(struct latency *dst, const struct latency *src)
+{
+	unsigned int i;
+
+	if (src->count == 0)
+		return;
+
+	if (dst->count == 0 || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->sum += src->sum;
+	dst->count += src->count;
+
+	for (i = 0; i < LATENCY_NBUCKETS; ++i)
+		dst->buckets[i] += src->buckets[i];
+}
+
+double
+latency_mean(const struct latency *lat)
+{
+	if (lat->count == 0)
+		return 0;
+	return lat->sum / lat->count;
+}
+
+/*
+ * Return the given percentile (0..100) in usec.
+ * We report the upper limit of the bucket the percentile falls into,
+ * so this errs on the pessimistic side.
+ */
+double
+latency_percentile(const struct latency *lat, double pct)
+{
+	unsigned long rank, seen = 0;
+	unsigned int i;
+
+	if (lat->count == 0)
+		return 0;
+
+	rank = (pct / 100) * lat->count;
+	if (rank >= lat->count)
+		rank = lat->count - 1;
+
+	for (i = 0; i < LATENCY_NBUCKETS; ++i) {
+		seen += lat->buckets[i];
+		if (seen > rank) {
+			double value = __latency_bucket_limit(i) / 1000;
+
+			if (value > lat->max)
+				value = lat->max;
+			if (value < lat->min)
+				value = lat->min;
+			return value;
+		}
+	}
+
+	return lat->max;
+}
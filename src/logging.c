@@ -33,6 +33,7 @@
 #include "rpctest.h"
 
 static int		opt_log_quiet;
+static int		log_capturing;
 static char		test_group_msg[1024];
 static char		test_msg[1024];
 static suselog_journal_t *test_journal = NULL;
@@ -42,6 +43,39 @@ static const char *	test_root_name;
 static const char *	test_group_name;
 static const char *	test_case_name;
 
+/*
+ * Test selection (rpctest --only and --skip). A test that is not
+ * selected still runs, because the tests after it may depend on what
+ * it did, but it is neither reported nor counted.
+ */
+static int		(*test_filter)(const char *group, const char *test);
+static char		test_group_tag[64];
+static int		test_case_skipped;
+
+/*
+ * Timing of tests and groups. test_elapsed is the duration of the
+ * test or group that just ended, for the backends to report. For
+ * the summary, a test is timed until the next one begins, because
+ * a test may keep going for a while after it has failed.
+ */
+static struct timespec	test_group_begin;
+static struct timespec	test_case_begin;
+static char *		test_timed_name;
+static char		test_group_desc[256];
+static char		test_case_desc[256];
+static double		test_elapsed;
+
+#define LOG_NUM_SLOWEST	10
+
+struct log_timing {
+	char *		name;
+	char *		desc;
+	double		elapsed;
+};
+
+static struct log_timing slowest_tests[LOG_NUM_SLOWEST];
+static struct log_timing slowest_groups[LOG_NUM_SLOWEST];
+
 unsigned int		num_tests;
 unsigned int		num_warns;
 unsigned int		num_fails;
@@ -52,6 +86,7 @@ enum {
 	TEST_SUCCESS, TEST_FAILURE, TEST_WARNING, TEST_ERROR,
 	TEST_INFO,
 	TEST_FATAL,
+	TEST_COUNTS, TEST_TIMING,
 };
 
 
@@ -90,6 +125,12 @@ log_init_junit(const char *filename)
 	test_root_name = NULL;
 }
 
+void
+log_set_filter(int (*filter)(const char *group, const char *test))
+{
+	test_filter = filter;
+}
+
 void
 log_init(const char *format, const char *prefix, const char *filename)
 {
@@ -119,7 +160,8 @@ __log_print_plain(int type, const char *name, const char *extra_fmt, va_list ext
 		break;
 
 	case TEST_END_GROUP:
-		/* Nothing */
+		if (!opt_log_quiet)
+			fprintf(stderr, "=== %.3fs ===\n", test_elapsed);
 		return;
 
 	case TEST_BEGIN:
@@ -130,14 +172,15 @@ __log_print_plain(int type, const char *name, const char *extra_fmt, va_list ext
 		break;
 
 	case TEST_SUCCESS:
-		/* Nothing */
+		if (!opt_log_quiet)
+			fprintf(stderr, "PASS: %.3fs\n", test_elapsed);
 		return;
 
 	case TEST_FAILURE:
 		fprintf(stderr, "FAIL: ");
 		if (extra_fmt)
 			vfprintf(stderr, extra_fmt, extra_ap);
-		fprintf(stderr, "\n");
+		fprintf(stderr, " (%.3fs)\n", test_elapsed);
 		break;
 
 	case TEST_WARNING:
@@ -189,7 +232,7 @@ __log_print_jlogger(int type, const char *name, const char *extra_fmt, va_list e
 		break;
 
 	case TEST_END_GROUP:
-		fprintf(stderr, "###junit endsuite time=\"%s\" id=\"%s\"", timestamp, name);	// id="..." unneeded by JUnit XML
+		fprintf(stderr, "###junit endsuite time=\"%s\" id=\"%s\" duration=\"%.3f\"", timestamp, name, test_elapsed);	// id="..." unneeded by JUnit XML
 		break;
 
 	case TEST_BEGIN:
@@ -197,10 +240,13 @@ __log_print_jlogger(int type, const char *name, const char *extra_fmt, va_list e
 		break;
 
 	case TEST_SUCCESS:
-		fprintf(stderr, "###junit success time=\"%s\" id=\"%s\"", timestamp, name);	// id="..." unneeded by JUnit XML
+		fprintf(stderr, "###junit success time=\"%s\" id=\"%s\" duration=\"%.3f\"", timestamp, name, test_elapsed);	// id="..." unneeded by JUnit XML
 		break;
 
 	case TEST_FAILURE:
+		fprintf(stderr, "###junit failure time=\"%s\" id=\"%s\" duration=\"%.3f\"", timestamp, name, test_elapsed);	// id="..." unneeded by JUnit XML
+		break;
+
 	case TEST_WARNING:									// no real support for warnings in JUnit XML
 		fprintf(stderr, "###junit failure time=\"%s\" id=\"%s\"", timestamp, name);	// id="..." unneeded by JUnit XML
 		break;
@@ -252,6 +298,7 @@ __log_print_junit(int type, const char *name, const char *extra_fmt, va_list ext
 	case TEST_END_GROUP:
 		if (extra_msg)
 			suselog_info(j, "%s", extra_msg);
+		suselog_info(j, "duration %.3fs", test_elapsed);
 		suselog_group_finish(j);
 		break;
 
@@ -260,6 +307,7 @@ __log_print_junit(int type, const char *name, const char *extra_fmt, va_list ext
 		break;
 
 	case TEST_SUCCESS:
+		suselog_info(j, "duration %.3fs", test_elapsed);
 		if (extra_msg)
 			suselog_success_msg(j, "%s", extra_msg);
 		else
@@ -267,6 +315,7 @@ __log_print_junit(int type, const char *name, const char *extra_fmt, va_list ext
 		break;
 
 	case TEST_FAILURE:
+		suselog_info(j, "duration %.3fs", test_elapsed);
 		if (extra_msg)
 			suselog_failure(j, "%s", extra_msg);
 		else
@@ -300,10 +349,92 @@ __log_print_junit(int type, const char *name, const char *extra_fmt, va_list ext
 	}
 }
 
+static double
+__log_elapsed(const struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) + 1e-9 * (now.tv_nsec - since->tv_nsec);
+}
+
+/*
+ * Keep the LOG_NUM_SLOWEST slowest tests (or groups), slowest first
+ */
+static void
+__log_timing_record(struct log_timing *table, const char *name, const char *desc, double elapsed)
+{
+	unsigned int i = LOG_NUM_SLOWEST - 1;
+
+	if (name == NULL)
+		return;
+	if (table[i].name) {
+		if (table[i].elapsed >= elapsed)
+			return;
+		free(table[i].name);
+		free(table[i].desc);
+	}
+
+	for (; i > 0 && (table[i - 1].name == NULL || table[i - 1].elapsed < elapsed); --i)
+		table[i] = table[i - 1];
+
+	table[i].name = strdup(name);
+	table[i].desc = strdup(desc);
+	table[i].elapsed = elapsed;
+}
+
+static void
+__log_print_slowest(const char *what, const struct log_timing *table)
+{
+	unsigned int i;
+
+	if (table[0].name == NULL)
+		return;
+
+	printf("Slowest %s:\n", what);
+	for (i = 0; i < LOG_NUM_SLOWEST && table[i].name; ++i)
+		printf("%8.3fs  %-32s %s\n", table[i].elapsed, table[i].name, table[i].desc);
+}
+
+static void
+__log_event(int type, const char *name, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	__log_test_begin_or_end(type, name, fmt, ap);
+	va_end(ap);
+}
+
+static void
+__log_timing_begin(const char *name)
+{
+	free(test_timed_name);
+	test_timed_name = strdup(name);
+	clock_gettime(CLOCK_MONOTONIC, &test_case_begin);
+}
+
+static void
+__log_timing_end(void)
+{
+	if (test_timed_name == NULL)
+		return;
+
+	test_elapsed = __log_elapsed(&test_case_begin);
+	if (log_capturing)
+		__log_event(TEST_TIMING, test_timed_name, "%s", test_case_desc);
+	else
+		__log_timing_record(slowest_tests, test_timed_name, test_case_desc, test_elapsed);
+
+	free(test_timed_name);
+	test_timed_name = NULL;
+}
+
 static void
 __log_test_finish(const char **namep)
 {
 	if (*namep != NULL) {
+		test_elapsed = __log_elapsed(&test_case_begin);
 		__log_test_begin_or_end(TEST_SUCCESS, *namep, NULL, NULL);
 		*namep = NULL;
 	}
@@ -312,7 +443,11 @@ __log_test_finish(const char **namep)
 static void
 __log_group_finish(const char **namep)
 {
+	__log_timing_end();
+
 	if (*namep != NULL) {
+		test_elapsed = __log_elapsed(&test_group_begin);
+		__log_timing_record(slowest_groups, *namep, test_group_desc, test_elapsed);
 		__log_test_begin_or_end(TEST_END_GROUP, *namep, NULL, NULL);
 		*namep = NULL;
 	}
@@ -344,6 +479,13 @@ log_test_group(const char *groupname, const char *fmt, ...)
 
 	test_group_name = log_name_combine(test_root_name, groupname, &group_name_save);
 	test_group_index = 0;
+	snprintf(test_group_tag, sizeof(test_group_tag), "%s", groupname);
+	test_case_skipped = 0;
+
+	va_start(ap, fmt);
+	vsnprintf(test_group_desc, sizeof(test_group_desc), fmt, ap);
+	va_end(ap);
+	clock_gettime(CLOCK_MONOTONIC, &test_group_begin);
 
 	va_start(ap, fmt);
 	if (!opt_log_quiet) {
@@ -358,11 +500,25 @@ static void
 __log_test_tagged(const char *tag, const char *fmt, va_list ap)
 {
 	static char *test_name_save = NULL;
+	va_list aq;
 
 	__log_test_finish(&test_case_name);
+	__log_timing_end();
+
+	test_case_skipped = test_filter && !test_filter(test_group_tag, tag);
+	if (test_case_skipped) {
+		test_msg[0] = '\0';
+		test_group_index++;
+		return;
+	}
 
 	test_case_name = log_name_combine(test_group_name? test_group_name : test_root_name, tag, &test_name_save);
 
+	va_copy(aq, ap);
+	vsnprintf(test_case_desc, sizeof(test_case_desc), fmt, aq);
+	va_end(aq);
+	__log_timing_begin(test_case_name);
+
 	if (!opt_log_quiet) {
 		__log_test_begin_or_end(TEST_BEGIN, test_case_name, fmt, ap);
 	} else {
@@ -407,6 +563,9 @@ log_finish(void)
 		"%4u warnings\n",
 		num_tests, num_fails, num_warns);
 
+	__log_print_slowest("tests", slowest_tests);
+	__log_print_slowest("groups", slowest_groups);
+
 	if (test_journal) {
 		suselog_journal_write(test_journal);
 		test_journal = NULL;
@@ -431,6 +590,8 @@ log_warn(const char *fmt, ...)
 {
 	va_list ap;
 
+	if (test_case_skipped)
+		return;
 	__log_msg_flush();
 
 	va_start(ap, fmt);
@@ -445,9 +606,13 @@ log_fail(const char *fmt, ...)
 {
 	va_list ap;
 
+	if (test_case_skipped)
+		return;
 	__log_msg_flush();
 
 	if (test_case_name) {
+		test_elapsed = __log_elapsed(&test_case_begin);
+
 		va_start(ap, fmt);
 		__log_test_begin_or_end(TEST_FAILURE, test_case_name, fmt, ap);
 		va_end(ap);
@@ -483,6 +648,9 @@ log_trace(const char *fmt, ...)
 {
 	va_list ap;
 
+	if (test_case_skipped)
+		return;
+
 	va_start(ap, fmt);
 	__log_test_begin_or_end(TEST_INFO, test_case_name, fmt, ap);
 	va_end(ap);
@@ -501,3 +669,168 @@ log_fatal(const char *fmt, ...)
 
 	exit(1);
 }
+
+/*
+ * Support for running test groups in parallel (rpctest -j).
+ *
+ * Each worker process captures its log into a file of its own; the
+ * parent replays the file through the configured backend once the
+ * worker is done, so the journal sees one group after the other.
+ * Log events are written as marker lines, anything else the worker
+ * prints is copied as is.
+ */
+#define LOG_CAPTURE_MARKER	"\001rpctest "
+
+static void
+__log_print_capture(int type, const char *name, const char *extra_fmt, va_list extra_ap)
+{
+	char buffer[1024], *s;
+
+	fprintf(stderr, LOG_CAPTURE_MARKER "%d %s %.6f ", type, name? name : "-", test_elapsed);
+	if (extra_fmt == NULL) {
+		fprintf(stderr, "-\n");
+		return;
+	}
+
+	vsnprintf(buffer, sizeof(buffer), extra_fmt, extra_ap);
+	fputc('+', stderr);
+	for (s = buffer; *s; ++s) {
+		if (*s == '\n')
+			fputs("\\n", stderr);
+		else if (*s == '\\')
+			fputs("\\\\", stderr);
+		else
+			fputc(*s, stderr);
+	}
+	fputc('\n', stderr);
+}
+
+void
+log_capture(void)
+{
+	/* Quiet mode is applied by the parent when replaying, and
+	 * whatever the parent has replayed so far is none of our
+	 * business. */
+	opt_log_quiet = 0;
+	test_group_msg[0] = '\0';
+	test_msg[0] = '\0';
+	num_tests = num_fails = num_warns = 0;
+
+	log_capturing = 1;
+	__log_test_begin_or_end = __log_print_capture;
+	setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+void
+log_capture_finish(void)
+{
+	__log_test_finish(&test_case_name);
+	__log_group_finish(&test_group_name);
+
+	fprintf(stderr, LOG_CAPTURE_MARKER "%d - 0 +%u %u %u\n",
+			TEST_COUNTS, num_tests, num_fails, num_warns);
+	fflush(stdout);
+	fflush(stderr);
+}
+
+static void
+__log_replay_line(char *line)
+{
+	char *name, *msg, *s, *t;
+	unsigned int tests, fails, warns;
+	int type;
+
+	type = strtol(line, &name, 10);
+	if (*name++ != ' ' || (s = strchr(name, ' ')) == NULL)
+		return;
+	*s++ = '\0';
+	if (!strcmp(name, "-"))
+		name = NULL;
+
+	test_elapsed = strtod(s, &msg);
+	if (*msg++ != ' ')
+		return;
+
+	if (*msg == '+') {
+		/* Undo the escaping of __log_print_capture */
+		for (s = t = ++msg; *s; ++s) {
+			if (*s == '\\' && s[1] == 'n') {
+				*t++ = '\n';
+				++s;
+			} else if (*s == '\\' && s[1] == '\\') {
+				*t++ = '\\';
+				++s;
+			} else {
+				*t++ = *s;
+			}
+		}
+		*t = '\0';
+	} else {
+		msg = NULL;
+	}
+
+	switch (type) {
+	case TEST_COUNTS:
+		if (msg && sscanf(msg, "%u %u %u", &tests, &fails, &warns) == 3) {
+			num_tests += tests;
+			num_fails += fails;
+			num_warns += warns;
+		}
+		return;
+
+	case TEST_BEGIN_GROUP:
+		snprintf(test_group_desc, sizeof(test_group_desc), "%s", msg? msg : "");
+		if (opt_log_quiet) {
+			snprintf(test_group_msg, sizeof(test_group_msg), "%s", msg? msg : "");
+			return;
+		}
+		break;
+
+	case TEST_BEGIN:
+		snprintf(test_case_desc, sizeof(test_case_desc), "%s", msg? msg : "");
+		if (opt_log_quiet) {
+			snprintf(test_msg, sizeof(test_msg), "%s", msg? msg : "");
+			return;
+		}
+		break;
+
+	case TEST_TIMING:
+		__log_timing_record(slowest_tests, name, msg? msg : "", test_elapsed);
+		return;
+
+	case TEST_END_GROUP:
+		__log_timing_record(slowest_groups, name, test_group_desc, test_elapsed);
+		break;
+
+	case TEST_FAILURE:
+	case TEST_WARNING:
+	case TEST_ERROR:
+	case TEST_FATAL:
+		__log_msg_flush();
+		break;
+	}
+
+	if (msg)
+		__log_event(type, name, "%s", msg);
+	else
+		__log_event(type, name, NULL);
+}
+
+void
+log_replay(FILE *fp)
+{
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	while ((len = getline(&line, &size, fp)) > 0) {
+		if (!strncmp(line, LOG_CAPTURE_MARKER, sizeof(LOG_CAPTURE_MARKER) - 1)) {
+			if (line[len - 1] == '\n')
+				line[len - 1] = '\0';
+			__log_replay_line(line + sizeof(LOG_CAPTURE_MARKER) - 1);
+		} else {
+			fputs(line, stderr);
+		}
+	}
+	free(line);
+}
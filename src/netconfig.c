@@ -62,7 +62,7 @@ static struct addr_info	__uaddr_data[] = {
 
 static void		rpctest_verify_netconfig(const struct netconfig *);
 static const char *	__netconfig_semantics_name(int);
-static void		rpctest_verify_sockinfo_all(void);
+static void		rpctest_verify_sockinfo(void);
 static void		rpctest_verify_taddr2uaddr(void);
 
 void
@@ -101,10 +101,18 @@ rpctest_verify_netconfig_all(void)
 		log_warn("found unknown netid %s", nconf->nc_netid);
 	}
 	endnetconfig(handle);
+}
 
+void
+rpctest_verify_sockinfo_all(void)
+{
 	log_test_group("sockinfo", "Verify sockinfo functions");
-	rpctest_verify_sockinfo_all();
+	rpctest_verify_sockinfo();
+}
 
+void
+rpctest_verify_addrconv_all(void)
+{
 	log_test_group("addrconv", "Verify uaddr2taddr/taddr2uaddr functions");
 	rpctest_verify_taddr2uaddr();
 }
@@ -218,7 +226,7 @@ rpctest_make_socket(const char *netid)
 
 #ifdef __TEST_RPC_SOCKINFO
 static void
-rpctest_verify_sockinfo_all(void)
+rpctest_verify_sockinfo(void)
 {
 	struct __sockinfo_test *st;
 
@@ -256,7 +264,7 @@ rpctest_verify_sockinfo_all(void)
 }
 #else
 static void
-rpctest_verify_sockinfo_all(void)
+rpctest_verify_sockinfo(void)
 {
 }
 #endif
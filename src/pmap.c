@@ -71,6 +71,19 @@ static struct pmap	__square_binding_root[] = {
 	BI(SQUARE_PROG,	4,		IPPROTO_UDP,	151),
 };
 
+/*
+ * Use our program number in a table of registrations (see rpctest_prog)
+ */
+static void
+__rpctest_pmap_fixup(struct pmap *pm, unsigned int count)
+{
+	while (count--) {
+		if (pm->pm_prog == SQUARE_PROG)
+			pm->pm_prog = rpctest_prog;
+		pm++;
+	}
+}
+
 void
 rpctest_verify_pmap_all(unsigned int flags)
 {
@@ -78,24 +91,27 @@ rpctest_verify_pmap_all(unsigned int flags)
 
 	log_test_group("portmap", "Verify portmap client functions");
 
+	__rpctest_pmap_fixup(__square_binding, 4);
+	__rpctest_pmap_fixup(__square_binding_root, 4);
+
 	memset(&sin, 0, sizeof(sin));
 	sin.sin_family = AF_INET;
 	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 	rpctest_verify_pmap_registration(&sin, "portmapper", __portmap_binding, 6);
 
-	rpctest_pmap_unset_wildcard(&sin, SQUARE_PROG);
+	rpctest_pmap_unset_wildcard(&sin, rpctest_prog);
 
 	rpctest_verify_pmap_set(&sin, "square program", __square_binding, 4, 0);
 	rpctest_verify_pmap_unset(&sin, "square program", __square_binding, 4, 0);
 
-	rpctest_pmap_unset_wildcard(&sin, SQUARE_PROG);
+	rpctest_pmap_unset_wildcard(&sin, rpctest_prog);
 
 	if (flags & RPF_DISPUTED) {
 		if (geteuid() == 0) {
 			rpctest_verify_pmap_set(&sin, "square program (with privports)", __square_binding_root, 4, 0);
 			rpctest_verify_pmap_unset(&sin, "square program (with privports)", __square_binding_root, 4, 0);
 
-			rpctest_pmap_unset_wildcard(&sin, SQUARE_PROG);
+			rpctest_pmap_unset_wildcard(&sin, rpctest_prog);
 
 			rpctest_drop_privileges();
 			rpctest_verify_pmap_set(&sin, "square program (with privports, unpriv user)", __square_binding_root, 4, 1);
@@ -105,7 +121,7 @@ rpctest_verify_pmap_all(unsigned int flags)
 		}
 	}
 
-	rpctest_pmap_unset_wildcard(&sin, SQUARE_PROG);
+	rpctest_pmap_unset_wildcard(&sin, rpctest_prog);
 }
 
 void
@@ -0,0 +1,797 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * rpc.rawsquared - the square service without libtirpc's svc layer.
+ *
+ * This is a baseline for measuring what libtirpc costs us. It speaks
+ * the same wire protocol as rpc.squared, and calls the same procedures
+ * from square_impl.c, with the same XDR routines for the arguments and
+ * results. Everything in between is done here, with as little work as
+ * possible: sockets are polled with epoll, TCP records are parsed
+ * straight from the receive buffer, call headers are decoded by hand
+ * (the reverse of what sumjob_check_reply does on the client side),
+ * and replies to pipelined calls are sent with a single write.
+ * Credentials are skipped without looking at them.
+ *
+ * The difference in throughput between this and rpc.squared is the
+ * overhead of libtirpc's transports and dispatch.
+ *
+ * -p <port>
+ *	Serve TCP and UDP on this port. By default, the kernel picks one.
+ *
+ * -j <nthreads>
+ *	Serve from this many threads, each with an epoll set of its own.
+ *	All threads accept connections and receive datagrams; a
+ *	connection stays with the thread that accepted it. Default is 1.
+ *
+ * -C <cpulist>
+ *	Pin the threads round-robin to the CPUs of the list.
+ *
+ * -R
+ *	Do not register with rpcbind. Use "square stress port=N" then.
+ *
+ * -n <maxrec>
+ *	Drop TCP connections that send records larger than maxrec bytes
+ *	(k and m suffixes are allowed). Unlike rpc.squared, we hold every
+ *	record in memory until it is complete. The default leaves room for
+ *	the largest ECHOPROC call, and SINKPROC or SUMPROC calls of the same
+ *	size; their array has no bound, so raise this for larger calls.
+ *
+ * Only the procedures used for benchmarking are supported; the others,
+ * and STATSPROC in particular, do nothing useful.
+ */
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include "rpctest.h"
+
+#define RAW_EPOLL_BATCH		64
+#define RAW_BUFSZ		(64 * 1024)
+/* Call header with the largest credentials and verifier we accept,
+ * plus the length word of a square_bulk or foodata argument */
+#define RAW_MAX_CALL_HEADER	(24 + 2 * (8 + MAX_AUTH_BYTES) + 4)
+#define RAW_MAX_RECORD		(RAW_MAX_CALL_HEADER + SQUARE_BULK_MAX)
+#define RAW_UDP_BUFSZ		65536
+
+typedef char *		raw_proc_fn_t(char *, struct svc_req *);
+
+struct raw_proc {
+	xdrproc_t		xdr_arg;
+	xdrproc_t		xdr_res;
+	raw_proc_fn_t *		func;
+};
+
+union raw_args {
+	square_in		square_in;
+	foodata_sum		foodata_sum;
+	square_bulk		square_bulk;
+	square_vec		square_vec;
+	square_work		square_work;
+	u_int			count;
+};
+
+struct raw_buf {
+	char *			data;
+	size_t			len;
+	size_t			size;
+};
+
+enum {
+	RAW_LISTENER,
+	RAW_UDP,
+	RAW_CONN,
+};
+
+struct raw_conn {
+	int			type;
+	int			fd;
+
+	/* Received data that has not been processed yet */
+	struct raw_buf		in;
+
+	/* A record that spans several fragments */
+	struct raw_buf		record;
+
+	/* Replies that have not been sent yet */
+	struct raw_buf		out;
+	size_t			out_sent;
+	int			want_write;
+};
+
+/*
+ * The call being processed. The procedures in square_impl.c report
+ * errors through svcerr_*, which replies through the transport they
+ * find in rq_xprt; ours appends the reply to out.
+ */
+struct raw_call {
+	struct raw_buf *	out;
+	int			tcp;
+	uint32_t		xid;
+	int			replied;
+};
+
+struct raw_thread {
+	unsigned int		index;
+	int			epfd;
+	struct raw_buf		reply;
+};
+
+static char *		raw_nullproc(void *, struct svc_req *);
+static bool_t		raw_xprt_reply(SVCXPRT *, struct rpc_msg *);
+
+#define RAW_PROC(nr, arg, res, fn) \
+	[nr] = { \
+		.xdr_arg = (xdrproc_t) xdr_##arg, \
+		.xdr_res = (xdrproc_t) xdr_##res, \
+		.func = (raw_proc_fn_t *) fn, \
+	}
+
+static const struct raw_proc raw_procs[] = {
+	RAW_PROC(NULLPROC,	void,		void,		raw_nullproc),
+	RAW_PROC(SQUAREPROC,	square_in,	square_out,	squareproc_1_svc),
+	RAW_PROC(SINKPROC,	foodata_skip,	void,		sinkproc_fast_1_svc),
+	RAW_PROC(SUMPROC,	foodata_sum,	u_int,		sumproc_fast_1_svc),
+	RAW_PROC(STATSPROC,	u_int,		square_stats,	statsproc_1_svc),
+	RAW_PROC(ECHOPROC,	square_bulk_arena, square_bulk,	echoproc_1_svc),
+	RAW_PROC(GENPROC,	u_int,		square_bulk,	genproc_1_svc),
+	RAW_PROC(SQUAREVPROC,	square_vec_arena, square_vec,	squarevproc_1_svc),
+	RAW_PROC(WORKPROC,	square_work,	void,		workproc_1_svc),
+	RAW_PROC(DRCSTATSPROC,	void,		square_drcstats, drcstatsproc_1_svc),
+};
+
+static struct raw_conn	raw_listener = { .type = RAW_LISTENER, .fd = -1 };
+static struct raw_conn	raw_udp = { .type = RAW_UDP, .fd = -1 };
+
+static const struct xp_ops raw_xprt_ops = {
+	.xp_reply	= raw_xprt_reply,
+};
+
+static int		opt_pinned = 0;
+static cpu_set_t	opt_cpus;
+static unsigned int	opt_maxrec = RAW_MAX_RECORD;
+
+static char *
+raw_nullproc(void *argp, struct svc_req *rqstp)
+{
+	static char dummy;
+
+	return &dummy;
+}
+
+static int
+raw_buf_reserve(struct raw_buf *buf, size_t count)
+{
+	size_t size;
+	char *p;
+
+	if (buf->len + count <= buf->size)
+		return 0;
+
+	for (size = buf->size? : RAW_BUFSZ; size < buf->len + count; size *= 2)
+		;
+	if ((p = realloc(buf->data, size)) == NULL)
+		return -1;
+	buf->data = p;
+	buf->size = size;
+	return 0;
+}
+
+static void
+raw_buf_free(struct raw_buf *buf)
+{
+	free(buf->data);
+	memset(buf, 0, sizeof(*buf));
+}
+
+static inline uint32_t
+raw_get32(const char *p)
+{
+	uint32_t value;
+
+	memcpy(&value, p, 4);
+	return ntohl(value);
+}
+
+static inline void
+raw_put32(char *p, uint32_t value)
+{
+	value = htonl(value);
+	memcpy(p, &value, 4);
+}
+
+/*
+ * Append a reply to out. On TCP, it gets a record mark.
+ */
+static void
+raw_reply(struct raw_buf *out, int tcp, uint32_t xid, enum accept_stat stat,
+		xdrproc_t xdr_res, void *result)
+{
+	unsigned int hdrlen = 24, reslen = 0;
+	char *p;
+
+	if (stat == SUCCESS && xdr_res != (xdrproc_t) xdr_void)
+		reslen = xdr_sizeof(xdr_res, result);
+	if (stat == PROG_MISMATCH)
+		reslen = 8;
+
+	if (raw_buf_reserve(out, 4 + hdrlen + reslen) < 0)
+		return;
+
+	p = out->data + out->len;
+	if (tcp) {
+		raw_put32(p, 0x80000000 | (hdrlen + reslen));
+		p += 4;
+	}
+
+	raw_put32(p, xid);
+	raw_put32(p + 4, REPLY);
+	raw_put32(p + 8, MSG_ACCEPTED);
+	raw_put32(p + 12, AUTH_NONE);
+	raw_put32(p + 16, 0);
+	raw_put32(p + 20, stat);
+	p += hdrlen;
+
+	if (stat == PROG_MISMATCH) {
+		raw_put32(p, SQUARE_VERS);
+		raw_put32(p + 4, SQUARE_VERS);
+	} else
+	if (reslen) {
+		XDR xdrs;
+
+		xdrmem_create(&xdrs, p, reslen, XDR_ENCODE);
+		if (!xdr_res(&xdrs, result)) {
+			xdr_destroy(&xdrs);
+			raw_reply(out, tcp, xid, SYSTEM_ERR, NULL, NULL);
+			return;
+		}
+		xdr_destroy(&xdrs);
+	}
+
+	out->len += (tcp? 4 : 0) + hdrlen + reslen;
+}
+
+/*
+ * Replies sent through svcerr_* by the procedures
+ */
+static bool_t
+raw_xprt_reply(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+	struct raw_call *call = xprt->xp_p2;
+
+	if (msg->rm_reply.rp_stat != MSG_ACCEPTED)
+		return FALSE;
+
+	raw_reply(call->out, call->tcp, call->xid, msg->acpted_rply.ar_stat,
+			msg->acpted_rply.ar_results.proc, msg->acpted_rply.ar_results.where);
+	call->replied = 1;
+	return TRUE;
+}
+
+static void
+raw_reply_rpc_mismatch(struct raw_buf *out, int tcp, uint32_t xid)
+{
+	char *p;
+
+	if (raw_buf_reserve(out, 4 + 20) < 0)
+		return;
+
+	p = out->data + out->len;
+	if (tcp) {
+		raw_put32(p, 0x80000000 | 20);
+		p += 4;
+	}
+	raw_put32(p, xid);
+	raw_put32(p + 4, REPLY);
+	raw_put32(p + 8, MSG_DENIED);
+	raw_put32(p + 12, RPC_MISMATCH);
+	raw_put32(p + 16, RPC_MSG_VERSION);
+	raw_put32(p + 20, RPC_MSG_VERSION);
+	out->len += (tcp? 4 : 0) + 24;
+}
+
+/*
+ * Skip over an opaque_auth. Returns the new offset, or 0 if the
+ * message is too short.
+ */
+static size_t
+raw_skip_auth(const char *msg, size_t len, size_t pos)
+{
+	uint32_t authlen;
+
+	if (pos + 8 > len)
+		return 0;
+	authlen = raw_get32(msg + pos + 4);
+	if (authlen > MAX_AUTH_BYTES)
+		return 0;
+	pos += 8 + RNDUP(authlen);
+	return pos <= len? pos : 0;
+}
+
+/*
+ * Decode and execute one call, and append the reply to out
+ */
+static void
+raw_process_call(struct raw_buf *out, int tcp, const char *msg, size_t len)
+{
+	const struct raw_proc *proc;
+	union raw_args argument;
+	struct raw_call call;
+	struct svc_req req;
+	SVCXPRT xprt;
+	uint32_t xid;
+	size_t pos;
+	char *result;
+	XDR xdrs;
+
+	/* xid, direction, rpcvers, prog, vers, proc */
+	if (len < 24 || raw_get32(msg + 4) != CALL)
+		return;
+	xid = raw_get32(msg);
+
+	if (raw_get32(msg + 8) != RPC_MSG_VERSION) {
+		raw_reply_rpc_mismatch(out, tcp, xid);
+		return;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.rq_prog = raw_get32(msg + 12);
+	req.rq_vers = raw_get32(msg + 16);
+	req.rq_proc = raw_get32(msg + 20);
+
+	/* Credentials and verifier */
+	if ((pos = raw_skip_auth(msg, len, 24)) == 0
+	 || (pos = raw_skip_auth(msg, len, pos)) == 0)
+		return;
+
+	if (req.rq_prog != SQUARE_PROG) {
+		raw_reply(out, tcp, xid, PROG_UNAVAIL, NULL, NULL);
+		return;
+	}
+	if (req.rq_vers != SQUARE_VERS) {
+		raw_reply(out, tcp, xid, PROG_MISMATCH, NULL, NULL);
+		return;
+	}
+
+	if (req.rq_proc >= ARRAY_COUNT(raw_procs) || raw_procs[req.rq_proc].func == NULL) {
+		raw_reply(out, tcp, xid, PROC_UNAVAIL, NULL, NULL);
+		return;
+	}
+	proc = &raw_procs[req.rq_proc];
+
+	rpctest_arena_begin();
+
+	memset(&argument, 0, sizeof(argument));
+	xdrmem_create(&xdrs, (char *) msg + pos, len - pos, XDR_DECODE);
+	if (!proc->xdr_arg(&xdrs, &argument)) {
+		raw_reply(out, tcp, xid, GARBAGE_ARGS, NULL, NULL);
+		goto out;
+	}
+
+	memset(&call, 0, sizeof(call));
+	call.out = out;
+	call.tcp = tcp;
+	call.xid = xid;
+
+	memset(&xprt, 0, sizeof(xprt));
+	xprt.xp_ops = &raw_xprt_ops;
+	xprt.xp_verf = _null_auth;
+	xprt.xp_p2 = &call;
+	req.rq_xprt = &xprt;
+
+	result = proc->func((char *) &argument, &req);
+	if (result != NULL)
+		raw_reply(out, tcp, xid, SUCCESS, proc->xdr_res, result);
+	else if (!call.replied)
+		raw_reply(out, tcp, xid, SYSTEM_ERR, NULL, NULL);
+
+out:
+	xdr_free(proc->xdr_arg, (char *) &argument);
+	xdr_destroy(&xdrs);
+	rpctest_arena_end();
+}
+
+static void
+raw_conn_close(struct raw_thread *thr, struct raw_conn *conn)
+{
+	close(conn->fd);
+	raw_buf_free(&conn->in);
+	raw_buf_free(&conn->record);
+	raw_buf_free(&conn->out);
+	free(conn);
+}
+
+/*
+ * Process all complete records in the receive buffer. Single fragment
+ * records, which is what everybody sends, are processed in place.
+ */
+static int
+raw_conn_process(struct raw_conn *conn)
+{
+	struct raw_buf *in = &conn->in;
+	size_t pos = 0;
+
+	while (in->len - pos >= 4) {
+		uint32_t mark = raw_get32(in->data + pos);
+		uint32_t fraglen = mark & 0x7fffffff;
+		const char *frag = in->data + pos + 4;
+
+		if (conn->record.len + fraglen > opt_maxrec)
+			return -1;
+
+		if (in->len - pos - 4 < fraglen) {
+			/* Make room for the rest of the fragment */
+			if (pos == 0 && raw_buf_reserve(in, 4 + fraglen - in->len) < 0)
+				return -1;
+			break;
+		}
+
+		if ((mark & 0x80000000) && conn->record.len == 0) {
+			raw_process_call(&conn->out, 1, frag, fraglen);
+		} else {
+			if (raw_buf_reserve(&conn->record, fraglen) < 0)
+				return -1;
+			memcpy(conn->record.data + conn->record.len, frag, fraglen);
+			conn->record.len += fraglen;
+
+			if (mark & 0x80000000) {
+				raw_process_call(&conn->out, 1, conn->record.data, conn->record.len);
+				conn->record.len = 0;
+			}
+		}
+
+		pos += 4 + fraglen;
+	}
+
+	if (pos) {
+		memmove(in->data, in->data + pos, in->len - pos);
+		in->len -= pos;
+	}
+	return 0;
+}
+
+static int
+raw_conn_flush(struct raw_thread *thr, struct raw_conn *conn)
+{
+	struct raw_buf *out = &conn->out;
+	int want_write;
+
+	while (conn->out_sent < out->len) {
+		ssize_t n;
+
+		n = write(conn->fd, out->data + conn->out_sent, out->len - conn->out_sent);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+			return -1;
+		}
+		conn->out_sent += n;
+	}
+
+	if (conn->out_sent == out->len)
+		out->len = conn->out_sent = 0;
+
+	/* Stop reading while the client doesn't take its replies */
+	want_write = out->len != 0;
+	if (want_write != conn->want_write) {
+		struct epoll_event ev;
+
+		ev.events = want_write? EPOLLOUT : EPOLLIN;
+		ev.data.ptr = conn;
+		if (epoll_ctl(thr->epfd, EPOLL_CTL_MOD, conn->fd, &ev) < 0)
+			return -1;
+		conn->want_write = want_write;
+	}
+	return 0;
+}
+
+static void
+raw_conn_event(struct raw_thread *thr, struct raw_conn *conn, unsigned int events)
+{
+	if (events & EPOLLIN) {
+		struct raw_buf *in = &conn->in;
+		ssize_t n;
+
+		if (raw_buf_reserve(in, 4096) < 0)
+			goto close;
+
+		n = read(conn->fd, in->data + in->len, in->size - in->len);
+		if (n == 0)
+			goto close;
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				return;
+			goto close;
+		}
+		in->len += n;
+
+		if (raw_conn_process(conn) < 0)
+			goto close;
+	} else
+	if (!(events & EPOLLOUT)) {
+		goto close;
+	}
+
+	if (raw_conn_flush(thr, conn) < 0)
+		goto close;
+	return;
+
+close:
+	raw_conn_close(thr, conn);
+}
+
+static void
+raw_accept(struct raw_thread *thr)
+{
+	while (1) {
+		struct raw_conn *conn;
+		struct epoll_event ev;
+		int fd, one = 1;
+
+		fd = accept4(raw_listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				log_error("accept: %m");
+			return;
+		}
+
+		/* libtirpc does this, too */
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		conn = calloc(1, sizeof(*conn));
+		conn->type = RAW_CONN;
+		conn->fd = fd;
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = conn;
+		if (epoll_ctl(thr->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			log_error("epoll_ctl: %m");
+			raw_conn_close(thr, conn);
+		}
+	}
+}
+
+static void
+raw_udp_recv(struct raw_thread *thr)
+{
+	static __thread char buf[RAW_UDP_BUFSZ];
+	unsigned int count;
+
+	for (count = 0; count < RAW_EPOLL_BATCH; ++count) {
+		struct sockaddr_storage addr;
+		socklen_t alen = sizeof(addr);
+		ssize_t n;
+
+		n = recvfrom(raw_udp.fd, buf, sizeof(buf), 0, (struct sockaddr *) &addr, &alen);
+		if (n < 0)
+			return;
+
+		thr->reply.len = 0;
+		raw_process_call(&thr->reply, 0, buf, n);
+		if (thr->reply.len)
+			sendto(raw_udp.fd, thr->reply.data, thr->reply.len, 0,
+					(struct sockaddr *) &addr, alen);
+	}
+}
+
+static void *
+raw_thread_main(void *arg)
+{
+	struct raw_thread *thr = arg;
+	struct epoll_event events[RAW_EPOLL_BATCH], ev;
+
+	if (opt_pinned && rpctest_cpuset_pin_thread(&opt_cpus, thr->index) < 0)
+		exit(1);
+
+	if ((thr->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		log_fatal("epoll_create: %m");
+
+	/* With several threads, wake up only one of them */
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	ev.data.ptr = &raw_listener;
+	if (epoll_ctl(thr->epfd, EPOLL_CTL_ADD, raw_listener.fd, &ev) < 0)
+		log_fatal("epoll_ctl: %m");
+	ev.data.ptr = &raw_udp;
+	if (epoll_ctl(thr->epfd, EPOLL_CTL_ADD, raw_udp.fd, &ev) < 0)
+		log_fatal("epoll_ctl: %m");
+
+	while (1) {
+		int i, n;
+
+		n = epoll_wait(thr->epfd, events, RAW_EPOLL_BATCH, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_fatal("epoll_wait: %m");
+		}
+
+		for (i = 0; i < n; ++i) {
+			struct raw_conn *conn = events[i].data.ptr;
+
+			switch (conn->type) {
+			case RAW_LISTENER:
+				raw_accept(thr);
+				break;
+			case RAW_UDP:
+				raw_udp_recv(thr);
+				break;
+			default:
+				raw_conn_event(thr, conn, events[i].events);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Bind a TCP and a UDP socket to the given port, or to one the
+ * kernel picks for TCP
+ */
+static int
+raw_bind_sockets(unsigned int port)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int one = 1;
+
+	raw_listener.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	raw_udp.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (raw_listener.fd < 0 || raw_udp.fd < 0) {
+		log_error("unable to create socket: %m");
+		return -1;
+	}
+	setsockopt(raw_listener.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	if (bind(raw_listener.fd, (struct sockaddr *) &sin, sizeof(sin)) < 0
+	 || getsockname(raw_listener.fd, (struct sockaddr *) &sin, &len) < 0) {
+		log_error("unable to bind TCP socket: %m");
+		return -1;
+	}
+	if (bind(raw_udp.fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+		log_error("unable to bind UDP socket to port %u: %m", ntohs(sin.sin_port));
+		return -1;
+	}
+	if (listen(raw_listener.fd, SOMAXCONN) < 0) {
+		log_error("unable to listen: %m");
+		return -1;
+	}
+
+	return ntohs(sin.sin_port);
+}
+
+static int
+raw_register(unsigned int port)
+{
+	static const char *netids[] = { "tcp", "udp", NULL };
+	struct sockaddr_in sin;
+	unsigned int i;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+
+	(void) rpcb_unset(SQUARE_PROG, SQUARE_VERS, NULL);
+	for (i = 0; netids[i]; ++i) {
+		struct netconfig *nconf;
+		struct netbuf nb;
+		bool_t ok;
+
+		if ((nconf = getnetconfigent(netids[i])) == NULL)
+			log_fatal("Bad netid %s", netids[i]);
+
+		nb.buf = &sin;
+		nb.len = nb.maxlen = sizeof(sin);
+		ok = rpcb_set(SQUARE_PROG, SQUARE_VERS, nconf, &nb);
+		freenetconfigent(nconf);
+
+		if (!ok) {
+			log_error("unable to register %s port %u with rpcbind", netids[i], port);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int opt_port = 0, opt_threads = 1, i;
+	int opt_register = 1;
+	pthread_t *threads;
+	int c, port;
+
+	while ((c = getopt(argc, argv, "C:j:n:p:R")) != EOF) {
+		switch (c) {
+		case 'C':
+			if (rpctest_cpuset_parse(optarg, &opt_cpus) < 0)
+				return 1;
+			opt_pinned = 1;
+			break;
+
+		case 'j':
+			opt_threads = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'n':
+			if (rpctest_parse_size(optarg, &opt_maxrec) < 0 || opt_maxrec == 0) {
+				log_error("bad record size \"%s\"", optarg);
+				return 1;
+			}
+			break;
+
+		case 'p':
+			opt_port = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'R':
+			opt_register = 0;
+			break;
+
+		default:
+		usage:
+			fprintf(stderr,
+				"Usage:\n"
+				"rpc.rawsquared [-p port] [-j nthreads] [-C cpulist] [-n maxrec] [-R]\n");
+			return 1;
+		}
+	}
+
+	if (optind != argc || opt_threads == 0 || opt_port > 65535)
+		goto usage;
+
+	rpctest_raise_fd_limit();
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((port = raw_bind_sockets(opt_port)) < 0)
+		return 1;
+	if (opt_register && raw_register(port) < 0)
+		return 1;
+	fprintf(stderr, "rpc.rawsquared: %u threads serving port %u\n", opt_threads, port);
+
+	threads = calloc(opt_threads, sizeof(threads[0]));
+	for (i = 0; i < opt_threads; ++i) {
+		struct raw_thread *thr;
+		int err;
+
+		thr = calloc(1, sizeof(*thr));
+		thr->index = i;
+		err = pthread_create(&threads[i], NULL, raw_thread_main, thr);
+		if (err != 0) {
+			log_error("cannot create thread: %s", strerror(err));
+			return 1;
+		}
+	}
+
+	for (i = 0; i < opt_threads; ++i)
+		pthread_join(threads[i], NULL);
+	return 0;
+}
@@ -155,25 +155,30 @@ rpctest_expand_nettype(const char *nettype, const char **array, unsigned int max
 int
 rpctest_run_oldstyle(unsigned long prog, unsigned long vers, rpc_program_fn_t *progfn)
 {
+	struct rpctest_svc_bufsizes bufsizes;
 	SVCXPRT *transp;
 
+	rpctest_svc_get_bufsizes(&bufsizes);
+
 	pmap_unset(prog, vers);
 
-	transp = svcudp_create(RPC_ANYSOCK);
+	transp = svcudp_bufcreate(RPC_ANYSOCK, bufsizes.sendsz, bufsizes.recvsz);
 	if (transp == NULL) {
 		fprintf (stderr, "cannot create udp service.\n");
 		return 0;
 	}
+	rpctest_svc_set_sockbufs(transp->xp_fd);
 	if (!svc_register(transp, prog, vers, progfn, IPPROTO_UDP)) {
 		fprintf (stderr, "unable to register (%lu, %lu, udp).\n", prog, vers);
 		return 0;
 	}
 
-	transp = svctcp_create(RPC_ANYSOCK, 0, 0);
+	transp = svctcp_create(RPC_ANYSOCK, bufsizes.sendsz, bufsizes.recvsz);
 	if (transp == NULL) {
 		fprintf (stderr, "cannot create tcp service.\n");
 		return 0;
 	}
+	rpctest_svc_set_sockbufs(transp->xp_fd);
 	if (!svc_register(transp, prog, vers, progfn, IPPROTO_TCP)) {
 		fprintf (stderr, "unable to register (%lu, %lu, tcp).\n", prog, vers);
 		return 0;
@@ -187,10 +192,41 @@ rpctest_run_newstyle(unsigned long prog, unsigned long vers, rpc_program_fn_t *p
 {
 	svc_unreg(prog, vers);
 
-	if (svc_create(progfn, prog, vers, NULL) == 0) {
+	if (rpctest_svc_create(progfn, prog, vers, NULL) == 0) {
 		fprintf (stderr, "cannot create services.\n");
 		return 0;
 	}
 
 	return 1;
 }
+
+/*
+ * Same as svc_create, but with the buffer sizes set through
+ * rpctest_svc_set_bufsizes
+ */
+int
+rpctest_svc_create(rpc_program_fn_t *progfn, unsigned long prog, unsigned long vers, const char *nettype)
+{
+	struct netconfig *nconf;
+	unsigned int count = 0;
+	void *handle;
+
+	if (!rpctest_svc_get_bufsizes(NULL))
+		return svc_create(progfn, prog, vers, nettype);
+
+	if ((handle = __rpc_setconf(nettype)) == NULL) {
+		fprintf(stderr, "Cannot look up nettype <%s>\n", nettype);
+		return 0;
+	}
+
+	while ((nconf = __rpc_getconf(handle)) != NULL) {
+		if (rpctest_svc_tp_create(progfn, prog, vers, nconf) == NULL) {
+			fprintf(stderr, "unable to create %s transport\n", nconf->nc_netid);
+			continue;
+		}
+		count++;
+	}
+
+	__rpc_endconf(handle);
+	return count;
+}
@@ -0,0 +1,491 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Benchmark result files.
+ *
+ * These are plain text files containing one name=value pair per
+ * line, in the same syntax the benchmark tools accept on their
+ * command line. Lines starting with # are comments.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include "rpctest.h"
+
+#define RESULTS_MAX		256
+
+struct rpctest_result {
+	char *			name;
+	char *			value;
+};
+
+struct rpctest_results {
+	unsigned int		count;
+	struct rpctest_result	entry[RESULTS_MAX];
+};
+
+rpctest_results_t *
+rpctest_results_new(void)
+{
+	return calloc(1, sizeof(rpctest_results_t));
+}
+
+void
+rpctest_results_free(rpctest_results_t *res)
+{
+	unsigned int i;
+
+	for (i = 0; i < res->count; ++i) {
+		free(res->entry[i].name);
+		free(res->entry[i].value);
+	}
+	free(res);
+}
+
+static struct rpctest_result *
+__rpctest_results_find(const rpctest_results_t *res, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < res->count; ++i) {
+		if (!strcmp(res->entry[i].name, name))
+			return (struct rpctest_result *) &res->entry[i];
+	}
+	return NULL;
+}
+
+void
+rpctest_results_set(rpctest_results_t *res, const char *name, const char *fmt, ...)
+{
+	struct rpctest_result *r;
+	char buffer[1024];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buffer, sizeof(buffer), fmt, ap);
+	va_end(ap);
+
+	if ((r = __rpctest_results_find(res, name)) == NULL) {
+		if (res->count >= RESULTS_MAX)
+			log_fatal("%s: too many result values", __FUNCTION__);
+		r = &res->entry[res->count++];
+		r->name = strdup(name);
+	} else {
+		free(r->value);
+	}
+	r->value = strdup(buffer);
+}
+
+const char *
+rpctest_results_get(const rpctest_results_t *res, const char *name)
+{
+	struct rpctest_result *r;
+
+	if ((r = __rpctest_results_find(res, name)) == NULL)
+		return NULL;
+	return r->value;
+}
+
+/*
+ * Look up a numeric result. Returns 0 if not found or not a number.
+ */
+int
+rpctest_results_get_double(const rpctest_results_t *res, const char *name, double *value)
+{
+	const char *s;
+	char *end;
+
+	if ((s = rpctest_results_get(res, name)) == NULL)
+		return 0;
+
+	*value = strtod(s, &end);
+	return end != s && *end == '\0';
+}
+
+/*
+ * Write results to the given file, or to stdout if filename is "-"
+ */
+int
+rpctest_results_write(const rpctest_results_t *res, const char *filename)
+{
+	FILE *fp;
+	unsigned int i;
+
+	if (!strcmp(filename, "-")) {
+		fp = stdout;
+	} else
+	if ((fp = fopen(filename, "w")) == NULL) {
+		log_error("unable to open %s: %m", filename);
+		return -1;
+	}
+
+	for (i = 0; i < res->count; ++i)
+		fprintf(fp, "%s=%s\n", res->entry[i].name, res->entry[i].value);
+
+	if (fp == stdout) {
+		fflush(fp);
+	} else
+	if (fclose(fp) != 0) {
+		log_error("error writing %s: %m", filename);
+		return -1;
+	}
+	return 0;
+}
+
+rpctest_results_t *
+rpctest_results_read(const char *filename)
+{
+	rpctest_results_t *res;
+	char line[1024];
+	FILE *fp;
+
+	if ((fp = fopen(filename, "r")) == NULL) {
+		log_error("unable to open %s: %m", filename);
+		return NULL;
+	}
+
+	res = rpctest_results_new();
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *value;
+
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '#' || line[0] == '\0')
+			continue;
+
+		if ((value = strchr(line, '=')) == NULL) {
+			log_error("%s: ignoring bad line \"%s\"", filename, line);
+			continue;
+		}
+		*value++ = '\0';
+		rpctest_results_set(res, line, "%s", value);
+	}
+
+	fclose(fp);
+	return res;
+}
+
+/*
+ * Helper function to record where we ran
+ */
+void
+rpctest_results_set_placement(rpctest_results_t *res, const char *prefix, const cpu_set_t *set)
+{
+	struct rpctest_placement pl;
+	char name[128];
+
+	rpctest_cpuset_topology(set, &pl);
+
+	snprintf(name, sizeof(name), "%s.cpus", prefix);
+	rpctest_results_set(res, name, "%s", pl.cpus);
+	snprintf(name, sizeof(name), "%s.ncpus", prefix);
+	rpctest_results_set(res, name, "%u", pl.ncpus);
+	snprintf(name, sizeof(name), "%s.ncores", prefix);
+	rpctest_results_set(res, name, "%u", pl.ncores);
+	snprintf(name, sizeof(name), "%s.sockets", prefix);
+	rpctest_results_set(res, name, "%s", pl.sockets);
+	snprintf(name, sizeof(name), "%s.smt-shared", prefix);
+	rpctest_results_set(res, name, "%d", pl.smt_shared);
+}
+
+/*
+ * Metrics we know how to compare. Only those marked as compare are
+ * checked against a baseline by default; any metric can be used in
+ * an SLO expression.
+ */
+static struct rpctest_metric {
+	const char *	name;
+	const char *	alias;
+	int		higher_is_better;
+	int		is_time;
+	int		compare;
+} rpctest_metrics[] = {
+	{ "calls-per-sec",		"calls/s",	1, 0, 1 },
+	{ "latency-mean-usec",		"mean",		0, 1, 1 },
+	{ "latency-p50-usec",		"p50",		0, 1, 1 },
+	{ "latency-p99-usec",		"p99",		0, 1, 1 },
+	{ "knee.calls-per-sec",		"knee",		1, 0, 1 },
+	{ "slo.calls-per-sec",		NULL,		1, 0, 1 },
+	{ "errors",			NULL,		0, 0, 0 },
+
+	{ NULL }
+};
+
+static const struct rpctest_metric *
+rpctest_metric_find(const char *name)
+{
+	const struct rpctest_metric *m;
+
+	for (m = rpctest_metrics; m->name; ++m) {
+		if (!strcmp(m->name, name) || (m->alias && !strcmp(m->alias, name)))
+			return m;
+	}
+	return NULL;
+}
+
+/*
+ * Parse a value such as 2ms, 500us, 1.5s or 1000. Without a unit,
+ * times are taken to be in usec.
+ */
+static int
+rpctest_metric_parse_value(const struct rpctest_metric *m, const char *value, double *result)
+{
+	char *end;
+	double v;
+
+	v = strtod(value, &end);
+	if (end == value)
+		return -1;
+
+	if (*end == '\0') {
+		*result = v;
+		return 0;
+	}
+
+	if (m && !m->is_time)
+		return -1;
+
+	if (!strcmp(end, "us"))
+		*result = v;
+	else if (!strcmp(end, "ms"))
+		*result = v * 1e3;
+	else if (!strcmp(end, "s"))
+		*result = v * 1e6;
+	else
+		return -1;
+	return 0;
+}
+
+int
+rpctest_parse_usec(const char *value, double *usec)
+{
+	return rpctest_metric_parse_value(NULL, value, usec);
+}
+
+/*
+ * Parse an SLO specification like "p99<2ms,calls/s>5000" into a list
+ * of conditions. A plain time value such as "2ms" is short for p99<2ms.
+ * The bounds are inclusive: < means at most, > at least, and <= and
+ * >= are accepted as well. Free the list with rpctest_slo_free.
+ */
+int
+rpctest_slo_parse(const char *spec, struct rpctest_slo *slo, unsigned int max)
+{
+	char *copy, *item, *op;
+	unsigned int count = 0;
+	int rv = -1;
+
+	if ((copy = strdup(spec)) == NULL) {
+		log_error("out of memory");
+		return -1;
+	}
+	for (item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+		const struct rpctest_metric *m;
+		struct rpctest_slo *cond;
+
+		if (count >= max) {
+			log_error("too many SLO conditions");
+			goto out;
+		}
+		cond = &slo[count];
+
+		if ((op = strpbrk(item, "<>")) == NULL) {
+			m = rpctest_metric_find("p99");
+			cond->op = '<';
+			op = item;
+		} else {
+			cond->op = *op;
+			*op++ = '\0';
+			if (*op == '=')
+				op++;
+			m = rpctest_metric_find(item);
+		}
+
+		if ((cond->metric = strdup(m? m->name : item)) == NULL) {
+			log_error("out of memory");
+			goto out;
+		}
+		count++;
+
+		if (rpctest_metric_parse_value(m, op, &cond->value) < 0)
+			goto bad_item;
+	}
+
+	rv = count;
+
+out:
+	if (rv < 0)
+		rpctest_slo_free(slo, count);
+	free(copy);
+	return rv;
+
+bad_item:
+	log_error("cannot parse SLO value \"%s\" for %s", op, slo[count - 1].metric);
+	goto out;
+}
+
+void
+rpctest_slo_free(struct rpctest_slo *slo, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; ++i) {
+		free(slo[i].metric);
+		slo[i].metric = NULL;
+	}
+}
+
+/*
+ * Check the results against a list of SLO conditions.
+ * Returns the number of violations.
+ */
+int
+rpctest_results_check_slo(const rpctest_results_t *res, const struct rpctest_slo *slo, unsigned int count)
+{
+	unsigned int i, violations = 0;
+
+	for (i = 0; i < count; ++i) {
+		const struct rpctest_slo *cond = &slo[i];
+		const char *verdict;
+		double value;
+
+		if (!rpctest_results_get_double(res, cond->metric, &value)) {
+			printf("SLO %s %c %g: no such result\n", cond->metric, cond->op, cond->value);
+			violations++;
+			continue;
+		}
+
+		if ((cond->op == '<' && value <= cond->value)
+		 || (cond->op == '>' && value >= cond->value)) {
+			verdict = "ok";
+		} else {
+			verdict = "VIOLATED";
+			violations++;
+		}
+
+		printf("SLO %-20s %c %12.1f: %12.1f  %s\n",
+				cond->metric, cond->op, cond->value, value, verdict);
+	}
+
+	return violations;
+}
+
+/*
+ * Parse tolerances like "10%" (applies to all metrics) or
+ * "calls/s:5%,p99:20%", and return the tolerance for the given metric
+ * as a fraction.
+ */
+static int
+rpctest_tolerance_get(const char *spec, const struct rpctest_metric *m, double *result)
+{
+	char *copy, *item;
+	int specific = 0, rv = 0;
+
+	copy = strdup(spec);
+	for (item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+		const struct rpctest_metric *tm = NULL;
+		char *value, *end;
+		double v;
+
+		if ((value = strchr(item, ':')) != NULL) {
+			*value++ = '\0';
+			if ((tm = rpctest_metric_find(item)) == NULL) {
+				log_error("unknown metric \"%s\" in tolerance", item);
+				rv = -1;
+				break;
+			}
+		} else {
+			value = item;
+		}
+
+		v = strtod(value, &end);
+		if (end == value || (*end && strcmp(end, "%")) || v < 0) {
+			log_error("cannot parse tolerance \"%s\"", value);
+			rv = -1;
+			break;
+		}
+
+		/* A tolerance for a specific metric overrides a global one */
+		if (tm == m) {
+			*result = v / 100;
+			specific = 1;
+		} else
+		if (tm == NULL && !specific) {
+			*result = v / 100;
+		}
+	}
+	free(copy);
+
+	return rv;
+}
+
+/*
+ * Check the syntax of a tolerance specification
+ */
+int
+rpctest_tolerance_check(const char *spec)
+{
+	double tolerance;
+
+	return rpctest_tolerance_get(spec, NULL, &tolerance);
+}
+
+/*
+ * Compare results against a baseline. Regressions are changes in the
+ * wrong direction by more than the tolerance for that metric.
+ * Returns the number of regressions, or -1 on error.
+ */
+int
+rpctest_results_compare(const rpctest_results_t *res, const rpctest_results_t *base,
+				const char *tolerances)
+{
+	const struct rpctest_metric *m;
+	unsigned int regressions = 0;
+
+	for (m = rpctest_metrics; m->name; ++m) {
+		double cur_value, base_value, change, tolerance = 0.10;
+		const char *verdict = "ok";
+
+		if (!m->compare)
+			continue;
+		if (!rpctest_results_get_double(res, m->name, &cur_value)
+		 || !rpctest_results_get_double(base, m->name, &base_value))
+			continue;
+
+		if (tolerances && rpctest_tolerance_get(tolerances, m, &tolerance) < 0)
+			return -1;
+
+		if (base_value == 0) {
+			change = 0;
+		} else {
+			change = (cur_value - base_value) / base_value;
+		}
+
+		if (m->higher_is_better? (change < -tolerance) : (change > tolerance)) {
+			verdict = "REGRESSION";
+			regressions++;
+		}
+
+		printf("%-24s %12.1f -> %12.1f  %+6.1f%% (tolerance %.0f%%)  %s\n",
+				m->name, base_value, cur_value, 100 * change,
+				100 * tolerance, verdict);
+	}
+
+	return regressions;
+}
@@ -139,6 +139,9 @@ rpctest_verify_rpcb_all(unsigned int flags)
 
 	log_test_group("rpcbind", "Verify rpcbind client functions");
 
+	rpctest_rpcb_fixup(__square_binding);
+	rpctest_rpcb_fixup(__square_binding_root);
+
 	ci = &conn_info[0];
 
 	rpctest_verify_rpcb_crashme();
@@ -148,20 +151,20 @@ rpctest_verify_rpcb_all(unsigned int flags)
 	 */
 	rpctest_verify_rpcb_registration("rpcbind", __rpcbind_binding);
 
-	rpctest_rpcb_unset_wildcard(SQUARE_PROG);
+	rpctest_rpcb_unset_wildcard(rpctest_prog);
 
 	rpctest_verify_rpcb_set(ci, "square program", __square_binding, 0, 0);
 	rpctest_verify_rpcb_registration_pmap(ci, "square program", __square_binding);
 	rpctest_verify_rpcb_unset(ci, "square program", __square_binding, 0, 0);
 
-	rpctest_rpcb_unset_wildcard(SQUARE_PROG);
+	rpctest_rpcb_unset_wildcard(rpctest_prog);
 
 	if (flags & RPF_DISPUTED) {
 		if (geteuid() == 0) {
 			rpctest_verify_rpcb_set(ci, "square program (with privports)", __square_binding_root, 0, 0);
 			rpctest_verify_rpcb_unset(ci, "square program (with privports)", __square_binding_root, 0, 0);
 
-			__rpctest_rpcb_unset_wildcard(ci, SQUARE_PROG);
+			__rpctest_rpcb_unset_wildcard(ci, rpctest_prog);
 
 			rpctest_drop_privileges();
 			rpctest_verify_rpcb_set(ci, "square program (with privports, unpriv user)", __square_binding_root, 1, 0);
@@ -171,7 +174,7 @@ rpctest_verify_rpcb_all(unsigned int flags)
 		}
 	}
 
-	__rpctest_rpcb_unset_wildcard(ci, SQUARE_PROG);
+	__rpctest_rpcb_unset_wildcard(ci, rpctest_prog);
  
 	for (ci = conn_info; ci->netid; ++ci) {
 		char message[128];
@@ -418,7 +421,7 @@ rpctest_verify_rpcb_getaddr(struct rpcb_conninfo *conn_info, const char *program
 		clnt_destroy(clnt);
 	}
 
-	__rpctest_rpcb_unset_wildcard(&conn_info[0], SQUARE_PROG);
+	__rpctest_rpcb_unset_wildcard(&conn_info[0], rpctest_prog);
 }
 
 int
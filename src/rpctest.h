@@ -21,6 +21,7 @@
 #ifndef RPCTEST_H
 #define RPCTEST_H
 
+#include <sched.h>
 #include "square.h"
 
 #define __TEST_RPC_SOCKINFO
@@ -32,7 +33,50 @@
 #define RPF_DISPUTED	0x0001
 #define RPF_QUIET	0x0002
 
+#define SVF_REUSEPORT	0x0001
+#define SVF_NOREG	0x0002
+
+/* SUMPROC argument, summed up while decoding */
+typedef struct foodata_sum {
+	u_int		count;
+	u_int		sum;
+} foodata_sum;
+
 typedef struct rpctest_process rpctest_process_t;
+typedef struct rpctest_results rpctest_results_t;
+
+#define LATENCY_SUBBITS		3
+#define LATENCY_NBUCKETS	(40 << LATENCY_SUBBITS)
+
+struct rpctest_placement {
+	char			cpus[1024];
+	char			sockets[256];
+	unsigned int		ncpus;
+	unsigned int		ncores;
+	int			smt_shared;
+};
+
+/* Buffer sizes for the server transports we create; 0 means default */
+struct rpctest_svc_bufsizes {
+	unsigned int		sendsz;		/* XDR buffers */
+	unsigned int		recvsz;
+	unsigned int		sndbuf;		/* SO_SNDBUF, SO_RCVBUF */
+	unsigned int		rcvbuf;
+};
+
+struct rpctest_slo {
+	char *			metric;
+	char			op;		/* '<' or '>' */
+	double			value;
+};
+
+struct latency {
+	unsigned long		count;
+	double			sum;		/* all values in usec */
+	double			min;
+	double			max;
+	unsigned int		buckets[LATENCY_NBUCKETS];
+};
 
 extern unsigned int	num_tests;
 extern unsigned int	num_fails;
@@ -42,6 +86,7 @@ typedef void	rpc_program_fn_t(struct svc_req *, register SVCXPRT *);
 
 extern void	log_quiet(void);
 extern void	log_init(const char *format, const char *prefix, const char *filename);
+extern void	log_set_filter(int (*)(const char *group, const char *test));
 extern void	log_test_group(const char *, const char *, ...);
 extern void	log_test(const char *, ...);
 extern void	log_test_tagged(const char *, const char *, ...);
@@ -51,6 +96,9 @@ extern void	log_warn(const char *, ...);
 extern void	log_trace(const char *, ...);
 extern void	log_error(const char *, ...);
 extern void	log_fatal(const char *, ...) __attribute((noreturn));
+extern void	log_capture(void);
+extern void	log_capture_finish(void);
+extern void	log_replay(FILE *);
 
 extern void	square_prog_1(struct svc_req *, register SVCXPRT *);
 
@@ -61,24 +109,43 @@ extern int	rpctest_make_socket(const char *);
 
 extern void	rpctest_verify_netpath_all(void);
 extern void	rpctest_verify_netconfig_all(void);
+extern void	rpctest_verify_sockinfo_all(void);
+extern void	rpctest_verify_addrconv_all(void);
 extern void	rpctest_verify_sockets_all(void);
 extern void	rpctest_verify_pmap_all(unsigned int);
 extern void	rpctest_verify_rpcb_all(unsigned int);
 extern void	rpctest_verify_svc_register(void);
 extern void	rpctest_verify_clnt_funcs(void);
+extern void	rpctest_verify_xdr_all(void);
 
 extern int	rpctest_run_oldstyle(unsigned long, unsigned long, rpc_program_fn_t *);
 extern int	rpctest_run_newstyle(unsigned long, unsigned long, rpc_program_fn_t *);
 extern int	rpctest_register_service_nettype(unsigned long, unsigned long, rpc_program_fn_t *, const char *);
+extern int	rpctest_svc_create(rpc_program_fn_t *, unsigned long, unsigned long, const char *);
 extern CLIENT *	rpctest_rpcb_client(const char *, const char *, unsigned int, char **);
 extern RPCB *	rpctest_rpcb_get_registrations(rpcprog_t);
 extern int	rpctest_verify_rpcb_registration(const char *, const struct rpcb *);
 extern int	rpctest_rpcb_unset_wildcard(rpcprog_t);
 extern int	rpctest_svc_register_rpcb(const RPCB *, rpc_program_fn_t *);
+extern int	rpctest_svc_register_rpcb_flags(const RPCB *, rpc_program_fn_t *, int);
 extern void	rpctest_svc_cleanup(RPCB *);
+extern void	rpctest_svc_set_bufsizes(const struct rpctest_svc_bufsizes *);
+extern int	rpctest_svc_get_bufsizes(struct rpctest_svc_bufsizes *);
+extern void	rpctest_svc_set_sockbufs(int);
+extern SVCXPRT *rpctest_svc_tli_create(int, const struct netconfig *);
+extern SVCXPRT *rpctest_svc_tp_create(rpc_program_fn_t *, rpcprog_t, rpcvers_t, const struct netconfig *);
+extern int	rpctest_svc_register_fds(const int *, unsigned int, rpcprog_t, rpcvers_t,
+				rpc_program_fn_t *, int);
+
+extern rpcprog_t	rpctest_prog;
+extern const char *	rpctest_local_addr;
+extern void	rpctest_set_program(rpcprog_t, const char *);
+extern void	rpctest_rpcb_fixup(RPCB *);
 
 extern void	rpctest_drop_privileges(void);
 extern void	rpctest_resume_privileges(void);
+extern unsigned int rpctest_raise_fd_limit(void);
+extern int	rpctest_parse_size(const char *, unsigned int *);
 extern rpctest_process_t *rpctest_fork_server(void);
 extern int	rpctest_kill_process(rpctest_process_t *);
 extern int	rpctest_try_catch_crash(int *termsig, int *exit_code);
@@ -94,4 +161,107 @@ extern const char *sockaddr_ntoa(const struct sockaddr *, const struct ifaddrs *
 
 extern const char *printable(const char *);
 
+extern int	rpctest_cpuset_parse(const char *, cpu_set_t *);
+extern int	rpctest_cpuset_pin_thread(const cpu_set_t *, int index);
+extern int	rpctest_cpuset_current(cpu_set_t *);
+extern const char *rpctest_cpuset_format(const cpu_set_t *);
+extern void	rpctest_cpuset_topology(const cpu_set_t *, struct rpctest_placement *);
+extern const char *rpctest_placement_print(const struct rpctest_placement *);
+
+extern rpctest_results_t *rpctest_results_new(void);
+extern void	rpctest_results_free(rpctest_results_t *);
+extern void	rpctest_results_set(rpctest_results_t *, const char *, const char *, ...)
+			__attribute__((format(printf, 3, 4)));
+extern const char *rpctest_results_get(const rpctest_results_t *, const char *);
+extern int	rpctest_results_get_double(const rpctest_results_t *, const char *, double *);
+extern int	rpctest_results_write(const rpctest_results_t *, const char *);
+extern rpctest_results_t *rpctest_results_read(const char *);
+extern void	rpctest_results_set_placement(rpctest_results_t *, const char *, const cpu_set_t *);
+extern int	rpctest_results_compare(const rpctest_results_t *, const rpctest_results_t *, const char *);
+extern int	rpctest_slo_parse(const char *, struct rpctest_slo *, unsigned int);
+extern void	rpctest_slo_free(struct rpctest_slo *, unsigned int);
+extern int	rpctest_tolerance_check(const char *);
+extern int	rpctest_parse_usec(const char *, double *);
+extern int	rpctest_results_check_slo(const rpctest_results_t *, const struct rpctest_slo *, unsigned int);
+
+#define SVC_STATS_MAXPROC	32
+
+extern unsigned int square_sum_host(const unsigned int *, unsigned int);
+extern unsigned int square_sum_net(const void *, unsigned int);
+extern bool_t	xdr_foodata_sum(XDR *, foodata_sum *);
+extern unsigned int *sumproc_fast_1_svc(foodata_sum *, struct svc_req *);
+extern bool_t	xdr_foodata_skip(XDR *, u_int *);
+extern bool_t	xdr_square_bulk_arena(XDR *, square_bulk *);
+extern bool_t	xdr_square_vec_arena(XDR *, square_vec *);
+extern void *	sinkproc_fast_1_svc(u_int *, struct svc_req *);
+
+extern int	square_get_server_stats(CLIENT *, unsigned int flags, square_stats *);
+extern const square_procstats *square_find_server_stats(const square_stats *, const char *proc);
+extern int	square_get_drc_stats(CLIENT *, square_drcstats *);
+
+extern int	svc_stats_init(unsigned int nslots);
+extern void	svc_stats_set_slot(unsigned int);
+extern void	svc_stats_record(unsigned int proc, const SVCXPRT *, int error,
+				unsigned long bytes_in, unsigned long bytes_out,
+				unsigned long allocs, double t0);
+extern unsigned long svc_malloc_count(void);
+extern void	svc_stats_reset(void);
+extern void	svc_stats_collect(square_stats *, const char **procnames);
+
+enum {
+	SVC_DRC_HIT,
+	SVC_DRC_MISS,
+	SVC_DRC_EVICT,
+
+	__SVC_DRC_MAX
+};
+/*
+ * SVC_CONTROL request to send an encoded reply, given as a struct netbuf,
+ * to the caller of the current request. Only our batched UDP transport
+ * supports it; others return FALSE.
+ */
+#define SVCSET_SENDREPLY_RAW	0x7201
+
+extern void	svc_stats_record_drc(unsigned int event);
+extern void	svc_stats_collect_drc(square_drcstats *);
+extern int	svc_drc_init(unsigned int size);
+extern unsigned int svc_drc_get_size(void);
+extern int	svc_drc_replay(struct svc_req *, SVCXPRT *);
+extern bool_t	svc_drc_sendreply(struct svc_req *, SVCXPRT *, xdrproc_t, void *);
+
+struct svc_deferred;
+extern int	svc_defer_init(void);
+extern struct svc_deferred *svc_defer(struct svc_req *, SVCXPRT *, double t0,
+				unsigned long allocs, unsigned long bytes_in);
+extern bool_t	svc_defer_sendreply(struct svc_deferred *, xdrproc_t, void *, double when);
+extern void	svc_defer_cancel(struct svc_deferred *);
+extern void	svc_defer_drop_fd(int fd);
+extern void	squared_dispatch_init(int fast_xdr, int async);
+extern void	squared_prog_1(struct svc_req *, SVCXPRT *);
+
+struct svc_pool;
+extern struct svc_pool *svc_pool_new(unsigned int nthreads, const cpu_set_t *);
+extern void	svc_pool_submit(struct svc_pool *, int fd);
+extern int	svc_pool_wakeup_fd(const struct svc_pool *);
+extern unsigned int svc_pool_reap(struct svc_pool *, int *fds, unsigned int max);
+extern int	svc_fd_is_listener(int fd);
+extern void	rpctest_svc_run_pool(unsigned int nthreads, const cpu_set_t *);
+extern void	rpctest_svc_run_epoll(void);
+extern int	svc_mmsg_start(unsigned int batch, rpcprog_t, rpcvers_t, rpc_program_fn_t *);
+extern int	rpctest_run_workers(unsigned int nworkers, void (*worker)(unsigned int, int),
+				void (*report)(void));
+
+extern void	rpctest_arena_begin(void);
+extern void	rpctest_arena_end(void);
+extern void *	rpctest_arena_alloc(size_t);
+
+extern double	rpctest_time(void);
+extern unsigned int latency_bucket(double usec);
+extern void	latency_init(struct latency *);
+extern void	latency_add(struct latency *, double usec);
+extern void	latency_add_since(struct latency *, double t0);
+extern void	latency_merge(struct latency *, const struct latency *);
+extern double	latency_mean(const struct latency *);
+extern double	latency_percentile(const struct latency *, double pct);
+
 #endif /* RPCTEST_H */
@@ -0,0 +1,483 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Deferred replies for rpc.squared.
+ *
+ * Normally, a procedure returns its result to the dispatcher, which
+ * replies right away. A call that has to wait for something would
+ * hold up the thread that serves it, and with svc_run(), every other
+ * client. Instead, the dispatcher can capture what it takes to reply
+ * later (svc_defer): the connection, the XID and the verifier, and for
+ * datagrams the caller's address. It returns without replying, and
+ * the transport goes on serving other calls.
+ *
+ * Once the result is there, svc_defer_sendreply encodes the reply and
+ * queues it with the time it is due; this may happen from any thread.
+ * The queue is a heap ordered by that time, and a timerfd fires when
+ * the first entry is due. The timerfd is registered with libtirpc like
+ * a transport, so svc_run() or our epoll loop polls it along with all
+ * the others, and the replies are sent from the thread that serves
+ * the connections. That way, they are never written to a connection
+ * at the same time as a reply from svc_vc.
+ *
+ * Like server_drc.c, we encode the reply ourselves. libtirpc does not
+ * tell us the XID of a call: svc_dg has the datagram in xp_p1, which
+ * starts with it, and svc_vc keeps it in struct cf_conn, which it
+ * keeps in xp_p1. On connections, we send from a dup of the socket,
+ * so that a client that goes away in the meantime does not leave us
+ * writing to an fd that has been reused.
+ *
+ * The dup keeps the socket open after libtirpc has destroyed the
+ * transport, and with it any epoll registration of the socket. The
+ * epoll loop therefore calls svc_defer_drop_fd when a transport goes
+ * away, which closes our dups, and we drop the replies to it.
+ *
+ * Deferred replies are not added to the duplicate request cache.
+ * Serving connections from a pool of threads (-j) is not supported.
+ */
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include "rpctest.h"
+
+struct svc_deferred {
+	int			fd;
+	int			xprt_fd;
+	int			stream;
+	uint32_t		xid;
+	struct opaque_auth	verf;
+	char			verf_body[MAX_AUTH_BYTES];
+	struct sockaddr_storage	addr;
+	socklen_t		addrlen;
+
+	/* For the statistics */
+	unsigned int		proc;
+	char			netid[16];
+	double			t0;
+	unsigned long		bytes_in;
+	unsigned long		bytes_out;
+	unsigned long		allocs;
+
+	double			when;
+	char *			reply;
+	unsigned int		reply_len;
+};
+
+/*
+ * The head of struct cf_conn in libtirpc's svc_vc.c
+ */
+struct svc_vc_conn_head {
+	enum xprt_stat		strm_stat;
+	uint32_t		x_id;
+};
+
+static pthread_mutex_t		svc_defer_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct svc_deferred **	svc_defer_heap;
+static unsigned int		svc_defer_count;
+static unsigned int		svc_defer_size;
+static int			svc_defer_timerfd = -1;
+static SVCXPRT			svc_defer_xprt;
+
+static void
+__svc_defer_swap(unsigned int i, unsigned int j)
+{
+	struct svc_deferred *tmp = svc_defer_heap[i];
+
+	svc_defer_heap[i] = svc_defer_heap[j];
+	svc_defer_heap[j] = tmp;
+}
+
+static int
+__svc_defer_push(struct svc_deferred *d)
+{
+	unsigned int i;
+
+	if (svc_defer_count >= svc_defer_size) {
+		unsigned int size = svc_defer_size? 2 * svc_defer_size : 1024;
+		struct svc_deferred **heap;
+
+		if ((heap = realloc(svc_defer_heap, size * sizeof(heap[0]))) == NULL)
+			return -1;
+		svc_defer_heap = heap;
+		svc_defer_size = size;
+	}
+
+	i = svc_defer_count++;
+	svc_defer_heap[i] = d;
+	while (i && svc_defer_heap[(i - 1) / 2]->when > d->when) {
+		__svc_defer_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	return 0;
+}
+
+static struct svc_deferred *
+__svc_defer_pop(void)
+{
+	struct svc_deferred *d = svc_defer_heap[0];
+	unsigned int i = 0;
+
+	svc_defer_heap[0] = svc_defer_heap[--svc_defer_count];
+	while (1) {
+		unsigned int l = 2 * i + 1, r = l + 1, min = i;
+
+		if (l < svc_defer_count && svc_defer_heap[l]->when < svc_defer_heap[min]->when)
+			min = l;
+		if (r < svc_defer_count && svc_defer_heap[r]->when < svc_defer_heap[min]->when)
+			min = r;
+		if (min == i)
+			break;
+		__svc_defer_swap(i, min);
+		i = min;
+	}
+	return d;
+}
+
+/*
+ * Arm the timer for the first entry of the queue. Call with the lock held.
+ */
+static void
+__svc_defer_arm(void)
+{
+	struct itimerspec its;
+	double when;
+
+	memset(&its, 0, sizeof(its));
+	if (svc_defer_count) {
+		/* A zero it_value would disarm the timer */
+		when = svc_defer_heap[0]->when;
+		its.it_value.tv_sec = when;
+		its.it_value.tv_nsec = (when - its.it_value.tv_sec) * 1e9;
+		if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+			its.it_value.tv_nsec = 1;
+	}
+
+	if (timerfd_settime(svc_defer_timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		log_error("svc defer: timerfd_settime: %m");
+}
+
+static void
+__svc_defer_free(struct svc_deferred *d)
+{
+	if (d->stream && d->fd >= 0)
+		close(d->fd);
+	free(d->reply);
+	free(d);
+}
+
+static int
+__svc_defer_send(struct svc_deferred *d)
+{
+	unsigned int sent = 0;
+
+	if (d->fd < 0)
+		return -1;
+	if (!d->stream)
+		return sendto(d->fd, d->reply, d->reply_len, 0, (struct sockaddr *) &d->addr, d->addrlen);
+
+	/* With rpc.squared -n, the socket is non-blocking */
+	while (sent < d->reply_len) {
+		ssize_t n;
+
+		n = write(d->fd, d->reply + sent, d->reply_len - sent);
+		if (n < 0) {
+			struct pollfd pfd = { .fd = d->fd, .events = POLLOUT };
+
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN || poll(&pfd, 1, 1000) <= 0)
+				return -1;
+			continue;
+		}
+		sent += n;
+	}
+	return 0;
+}
+
+static void
+__svc_defer_complete(struct svc_deferred *d)
+{
+	SVCXPRT xprt;
+	int error = 0;
+
+	/* The connection may be gone; that's not our problem */
+	if (__svc_defer_send(d) < 0)
+		error = 1;
+
+	/* svc_stats_record only looks at the netid */
+	memset(&xprt, 0, sizeof(xprt));
+	xprt.xp_netid = d->netid;
+	svc_stats_record(d->proc, &xprt, error, d->bytes_in, d->bytes_out, d->allocs, d->t0);
+
+	__svc_defer_free(d);
+}
+
+/*
+ * The timer fired. Send all replies that are due.
+ */
+static bool_t
+__svc_defer_recv(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+	uint64_t expirations;
+	double now;
+
+	if (read(svc_defer_timerfd, &expirations, sizeof(expirations)) < 0
+	 && errno != EAGAIN)
+		log_error("svc defer: read from timerfd: %m");
+
+	now = rpctest_time();
+	while (1) {
+		struct svc_deferred *d;
+
+		pthread_mutex_lock(&svc_defer_lock);
+		if (svc_defer_count == 0 || svc_defer_heap[0]->when > now) {
+			__svc_defer_arm();
+			pthread_mutex_unlock(&svc_defer_lock);
+			break;
+		}
+		d = __svc_defer_pop();
+		pthread_mutex_unlock(&svc_defer_lock);
+
+		__svc_defer_complete(d);
+	}
+
+	/* There is never a call to dispatch */
+	return FALSE;
+}
+
+static enum xprt_stat
+__svc_defer_stat(SVCXPRT *xprt)
+{
+	return XPRT_IDLE;
+}
+
+static bool_t
+__svc_defer_getargs(SVCXPRT *xprt, xdrproc_t xdr_args, void *args_ptr)
+{
+	return FALSE;
+}
+
+static bool_t
+__svc_defer_reply(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+	return FALSE;
+}
+
+static bool_t
+__svc_defer_freeargs(SVCXPRT *xprt, xdrproc_t xdr_args, void *args_ptr)
+{
+	return FALSE;
+}
+
+static void
+__svc_defer_destroy(SVCXPRT *xprt)
+{
+}
+
+static bool_t
+__svc_defer_control(SVCXPRT *xprt, const u_int rq, void *in)
+{
+	return FALSE;
+}
+
+static const struct xp_ops	svc_defer_ops = {
+	.xp_recv	= __svc_defer_recv,
+	.xp_stat	= __svc_defer_stat,
+	.xp_getargs	= __svc_defer_getargs,
+	.xp_reply	= __svc_defer_reply,
+	.xp_freeargs	= __svc_defer_freeargs,
+	.xp_destroy	= __svc_defer_destroy,
+};
+
+static const struct xp_ops2	svc_defer_ops2 = {
+	.xp_control	= __svc_defer_control,
+};
+
+/*
+ * Create the timer, and register it with libtirpc. Call this before
+ * entering the main loop.
+ */
+int
+svc_defer_init(void)
+{
+	svc_defer_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (svc_defer_timerfd < 0) {
+		log_error("svc defer: cannot create timerfd: %m");
+		return -1;
+	}
+
+	svc_defer_xprt.xp_fd = svc_defer_timerfd;
+	svc_defer_xprt.xp_ops = &svc_defer_ops;
+	svc_defer_xprt.xp_ops2 = &svc_defer_ops2;
+	xprt_register(&svc_defer_xprt);
+	return 0;
+}
+
+/*
+ * Capture what we need to reply to this call later. t0, allocs and
+ * bytes_in are for the statistics, as for svc_stats_record. The call
+ * is recorded when the reply has been sent.
+ */
+struct svc_deferred *
+svc_defer(struct svc_req *rqstp, SVCXPRT *xprt, double t0, unsigned long allocs, unsigned long bytes_in)
+{
+	struct svc_deferred *d;
+	socklen_t len = sizeof(int);
+	uint32_t value;
+	int type;
+
+	if (svc_defer_timerfd < 0 || xprt->xp_p1 == NULL
+	 || xprt->xp_verf.oa_length > MAX_AUTH_BYTES
+	 || getsockopt(xprt->xp_fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+		return NULL;
+
+	if ((d = calloc(1, sizeof(*d))) == NULL)
+		return NULL;
+
+	if (type == SOCK_STREAM) {
+		const struct svc_vc_conn_head *cd = xprt->xp_p1;
+
+		d->stream = 1;
+		d->xid = cd->x_id;
+		d->xprt_fd = xprt->xp_fd;
+		if ((d->fd = dup(xprt->xp_fd)) < 0) {
+			free(d);
+			return NULL;
+		}
+	} else {
+		const struct netbuf *addr = svc_getrpccaller(xprt);
+
+		if (addr->len > sizeof(d->addr)) {
+			free(d);
+			return NULL;
+		}
+		memcpy(&value, xprt->xp_p1, 4);
+		d->xid = ntohl(value);
+		d->fd = xprt->xp_fd;
+		memcpy(&d->addr, addr->buf, addr->len);
+		d->addrlen = addr->len;
+	}
+
+	d->verf = xprt->xp_verf;
+	d->verf.oa_base = d->verf_body;
+	memcpy(d->verf_body, xprt->xp_verf.oa_base, xprt->xp_verf.oa_length);
+
+	d->proc = rqstp->rq_proc;
+	if (xprt->xp_netid)
+		snprintf(d->netid, sizeof(d->netid), "%s", xprt->xp_netid);
+	d->t0 = t0;
+	d->allocs = allocs;
+	d->bytes_in = bytes_in;
+	return d;
+}
+
+/*
+ * Encode a successful reply, and have it sent at the given time (as
+ * returned by rpctest_time), or as soon as possible if that has passed.
+ * The result need not remain valid after this returns. d is freed in
+ * any case.
+ */
+bool_t
+svc_defer_sendreply(struct svc_deferred *d, xdrproc_t xdr_res, void *result, double when)
+{
+	unsigned int len, mark = d->stream? 4 : 0;
+	struct rpc_msg msg;
+	XDR xdrs;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.rm_xid = d->xid;
+	msg.rm_direction = REPLY;
+	msg.rm_reply.rp_stat = MSG_ACCEPTED;
+	msg.acpted_rply.ar_verf = d->verf;
+	msg.acpted_rply.ar_stat = SUCCESS;
+	msg.acpted_rply.ar_results.where = result;
+	msg.acpted_rply.ar_results.proc = xdr_res;
+
+	len = xdr_sizeof((xdrproc_t) xdr_replymsg, &msg);
+	if ((d->reply = malloc(mark + len)) == NULL)
+		goto failed;
+
+	xdrmem_create(&xdrs, d->reply + mark, len, XDR_ENCODE);
+	if (!xdr_replymsg(&xdrs, &msg)) {
+		xdr_destroy(&xdrs);
+		goto failed;
+	}
+	xdr_destroy(&xdrs);
+
+	/* A record of a single fragment */
+	if (mark) {
+		uint32_t value = htonl(0x80000000 | len);
+
+		memcpy(d->reply, &value, 4);
+	}
+	d->reply_len = mark + len;
+	d->bytes_out = xdr_sizeof(xdr_res, result);
+	d->allocs = svc_malloc_count() - d->allocs;
+	d->when = when;
+
+	pthread_mutex_lock(&svc_defer_lock);
+	if (__svc_defer_push(d) < 0) {
+		pthread_mutex_unlock(&svc_defer_lock);
+		goto failed;
+	}
+	if (svc_defer_heap[0] == d)
+		__svc_defer_arm();
+	pthread_mutex_unlock(&svc_defer_lock);
+	return TRUE;
+
+failed:
+	__svc_defer_free(d);
+	return FALSE;
+}
+
+/*
+ * Give up on replying
+ */
+void
+svc_defer_cancel(struct svc_deferred *d)
+{
+	__svc_defer_free(d);
+}
+
+/*
+ * The transport on fd has been destroyed. Close our dups of it, so
+ * that the socket is really gone, and drop the replies that are
+ * queued for it.
+ */
+void
+svc_defer_drop_fd(int fd)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&svc_defer_lock);
+	for (i = 0; i < svc_defer_count; ++i) {
+		struct svc_deferred *d = svc_defer_heap[i];
+
+		if (d->stream && d->xprt_fd == fd && d->fd >= 0) {
+			close(d->fd);
+			d->fd = -1;
+		}
+	}
+	pthread_mutex_unlock(&svc_defer_lock);
+}
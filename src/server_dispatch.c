@@ -0,0 +1,314 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Dispatcher for rpc.squared.
+ *
+ * This does the same as the rpcgen generated square_prog_1, but is
+ * table driven, and records statistics for every call (see
+ * server_stats.c). rpctest still uses the generated dispatcher.
+ *
+ * Some procedures have a fast path that decodes their arguments with
+ * custom XDR routines. Others decode variable length arguments into
+ * the request arena (see arena.c) instead of memory from malloc, which
+ * is released in one go after the reply has been sent; their results
+ * may come from the arena as well. squared_dispatch_init(0, ...) disables
+ * both, so that we can compare against the rpcgen generated code.
+ *
+ * With async replies, calls that would wait reply later instead (see
+ * server_defer.c). For WORKPROC, this is the sleep: the procedure does
+ * the rest of its work, and the reply is sent when the sleep is over.
+ */
+#include "rpctest.h"
+
+typedef char *		squared_proc_fn_t(char *, struct svc_req *);
+
+struct squared_proc {
+	const char *		name;
+	xdrproc_t		xdr_arg;
+	xdrproc_t		xdr_res;
+	squared_proc_fn_t *	func;
+
+	/* Encoded size of the arguments, if cheaper than xdr_sizeof */
+	unsigned long		(*arg_size)(const void *);
+
+	/* For async replies: how long the call would wait, in usec.
+	 * The wait is removed from the arguments. */
+	unsigned long		(*defer_usec)(void *);
+};
+
+union squared_args {
+	square_in		square_in;
+	foodata			foodata;
+	foodata_sum		foodata_sum;
+	square_bulk		square_bulk;
+	square_vec		square_vec;
+	square_work		square_work;
+	u_int			flags;
+};
+
+static char *		squared_nullproc(void *, struct svc_req *);
+static square_stats *	squared_statsproc(u_int *, struct svc_req *);
+static square_drcstats *squared_drcstatsproc(void *, struct svc_req *);
+static unsigned long	squared_foodata_size(const void *);
+static unsigned long	squared_foodata_sum_size(const void *);
+static unsigned long	squared_foodata_skip_size(const void *);
+static unsigned long	squared_bulk_size(const void *);
+static unsigned long	squared_vec_size(const void *);
+static unsigned long	squared_work_defer(void *);
+
+#define SQUARED_PROC(nr, arg, res, fn, size) \
+	[nr] = { \
+		.name = #nr, \
+		.xdr_arg = (xdrproc_t) xdr_##arg, \
+		.xdr_res = (xdrproc_t) xdr_##res, \
+		.func = (squared_proc_fn_t *) fn, \
+		.arg_size = size, \
+	}
+
+static struct squared_proc squared_procs[SVC_STATS_MAXPROC] = {
+	SQUARED_PROC(NULLPROC,		void,		void,		squared_nullproc, NULL),
+	SQUARED_PROC(SQUAREPROC,	square_in,	square_out,	squareproc_1_svc, NULL),
+	SQUARED_PROC(ERRNOPROG,		void,		void,		errnoprog_1_svc, NULL),
+	SQUARED_PROC(ERRPROGVERS,	void,		void,		errprogvers_1_svc, NULL),
+	SQUARED_PROC(ERRNOPROC,		void,		void,		errnoproc_1_svc, NULL),
+	SQUARED_PROC(ERRDECODE,		void,		void,		errdecode_1_svc, NULL),
+	SQUARED_PROC(ERRSYSTEMERR,	void,		void,		errsystemerr_1_svc, NULL),
+	SQUARED_PROC(ERRWEAKAUTH,	void,		void,		errweakauth_1_svc, NULL),
+	SQUARED_PROC(SINKPROC,		foodata,	void,		sinkproc_1_svc, squared_foodata_size),
+	SQUARED_PROC(SUMPROC,		foodata,	u_int,		sumproc_1_svc, squared_foodata_size),
+	SQUARED_PROC(STATSPROC,		u_int,		square_stats,	squared_statsproc, NULL),
+	SQUARED_PROC(ECHOPROC,		square_bulk,	square_bulk,	echoproc_1_svc, squared_bulk_size),
+	SQUARED_PROC(GENPROC,		u_int,		square_bulk,	genproc_1_svc, NULL),
+	SQUARED_PROC(SQUAREVPROC,	square_vec,	square_vec,	squarevproc_1_svc, squared_vec_size),
+	SQUARED_PROC(WORKPROC,		square_work,	void,		workproc_1_svc, NULL),
+	SQUARED_PROC(DRCSTATSPROC,	void,		square_drcstats, squared_drcstatsproc, NULL),
+};
+
+static const struct squared_proc squared_fast_procs[] = {
+	SQUARED_PROC(SINKPROC,		foodata_skip,	void,		sinkproc_fast_1_svc, squared_foodata_skip_size),
+	SQUARED_PROC(SUMPROC,		foodata_sum,	u_int,		sumproc_fast_1_svc, squared_foodata_sum_size),
+};
+
+static const struct squared_proc squared_arena_procs[] = {
+	SQUARED_PROC(ECHOPROC,		square_bulk_arena, square_bulk,	echoproc_1_svc, squared_bulk_size),
+	SQUARED_PROC(SQUAREVPROC,	square_vec_arena, square_vec,	squarevproc_1_svc, squared_vec_size),
+};
+
+static int		squared_use_arena;
+static int		squared_async;
+
+/* Calls to unknown procedures are accounted here */
+#define SQUARED_UNKNOWN		(SVC_STATS_MAXPROC - 1)
+
+static char *
+squared_nullproc(void *argp, struct svc_req *rqstp)
+{
+	static char dummy;
+
+	return &dummy;
+}
+
+static unsigned long
+squared_foodata_size(const void *argp)
+{
+	const foodata *fd = argp;
+
+	return 4 + 4 * fd->buffer.buffer_len;
+}
+
+static unsigned long
+squared_foodata_sum_size(const void *argp)
+{
+	const foodata_sum *fs = argp;
+
+	return 4 + 4 * fs->count;
+}
+
+static unsigned long
+squared_foodata_skip_size(const void *argp)
+{
+	const u_int *count = argp;
+
+	return 4 + 4 * *count;
+}
+
+static unsigned long
+squared_bulk_size(const void *argp)
+{
+	const square_bulk *bulk = argp;
+
+	return 4 + RNDUP(bulk->square_bulk_len);
+}
+
+static unsigned long
+squared_vec_size(const void *argp)
+{
+	const square_vec *vec = argp;
+
+	return 4 + 4 * vec->square_vec_len;
+}
+
+static unsigned long
+squared_work_defer(void *argp)
+{
+	square_work *work = argp;
+	unsigned long usec = work->sleep_usec;
+
+	work->sleep_usec = 0;
+	return usec;
+}
+
+void
+squared_dispatch_init(int fast_xdr, int async)
+{
+	unsigned int i;
+
+	if (async) {
+		squared_procs[WORKPROC].defer_usec = squared_work_defer;
+		squared_async = 1;
+	}
+
+	if (!fast_xdr)
+		return;
+
+	/* These tables are indexed by procedure number, too */
+	for (i = 0; i < ARRAY_COUNT(squared_arena_procs); ++i) {
+		if (squared_arena_procs[i].func)
+			squared_procs[i] = squared_arena_procs[i];
+	}
+	for (i = 0; i < ARRAY_COUNT(squared_fast_procs); ++i) {
+		if (squared_fast_procs[i].func)
+			squared_procs[i] = squared_fast_procs[i];
+	}
+	squared_use_arena = 1;
+}
+
+static square_stats *
+squared_statsproc(u_int *flags, struct svc_req *rqstp)
+{
+	static __thread square_stats result;
+	const char *procnames[SVC_STATS_MAXPROC];
+	unsigned int i;
+
+	for (i = 0; i < SVC_STATS_MAXPROC; ++i)
+		procnames[i] = squared_procs[i].name;
+	procnames[SQUARED_UNKNOWN] = "unknown";
+
+	svc_stats_collect(&result, procnames);
+	if (*flags & SQUARE_STATS_RESET)
+		svc_stats_reset();
+	return &result;
+}
+
+static square_drcstats *
+squared_drcstatsproc(void *argp, struct svc_req *rqstp)
+{
+	static __thread square_drcstats result;
+
+	svc_stats_collect_drc(&result);
+	result.size = svc_drc_get_size();
+	return &result;
+}
+
+void
+squared_prog_1(struct svc_req *rqstp, SVCXPRT *transp)
+{
+	const struct squared_proc *proc = NULL;
+	struct svc_deferred *deferred = NULL;
+	unsigned long delay = 0;
+	union squared_args argument;
+	unsigned long bytes_in = 0, bytes_out = 0;
+	unsigned long allocs = svc_malloc_count();
+	double t0 = rpctest_time();
+	char *result;
+	int error = 0;
+
+	/* A retransmission that we answered from the cache is
+	 * not counted as a call */
+	if (svc_drc_replay(rqstp, transp))
+		return;
+
+	if (rqstp->rq_proc < SVC_STATS_MAXPROC)
+		proc = &squared_procs[rqstp->rq_proc];
+	if (proc == NULL || proc->func == NULL) {
+		svcerr_noproc(transp);
+		svc_stats_record(SQUARED_UNKNOWN, transp, 1, 0, 0, 0, t0);
+		return;
+	}
+
+	if (squared_use_arena)
+		rpctest_arena_begin();
+
+	memset(&argument, 0, sizeof(argument));
+	if (!svc_getargs(transp, proc->xdr_arg, (caddr_t) &argument)) {
+		svcerr_decode(transp);
+		error = 1;
+		goto out;
+	}
+
+	if (proc->arg_size)
+		bytes_in = proc->arg_size(&argument);
+	else
+		bytes_in = xdr_sizeof(proc->xdr_arg, &argument);
+
+	if (squared_async && proc->defer_usec && (delay = proc->defer_usec(&argument)) != 0) {
+		deferred = svc_defer(rqstp, transp, t0, allocs, bytes_in);
+		if (deferred == NULL) {
+			svcerr_systemerr(transp);
+			error = 1;
+			goto free;
+		}
+	}
+
+	result = proc->func((char *) &argument, rqstp);
+	if (result == NULL) {
+		/* The procedure sent an error reply itself */
+		if (deferred)
+			svc_defer_cancel(deferred);
+		error = 1;
+	} else
+	if (deferred) {
+		/* The call is recorded when the reply has been sent */
+		if (svc_defer_sendreply(deferred, proc->xdr_res, result, rpctest_time() + 1e-6 * delay))
+			goto free;
+		svcerr_systemerr(transp);
+		error = 1;
+	} else
+	if (!svc_drc_sendreply(rqstp, transp, proc->xdr_res, result)) {
+		svcerr_systemerr(transp);
+		error = 1;
+	} else {
+		bytes_out = xdr_sizeof(proc->xdr_res, result);
+	}
+
+free:
+	if (!svc_freeargs(transp, proc->xdr_arg, (caddr_t) &argument))
+		log_fatal("unable to free arguments");
+
+out:
+	if (squared_use_arena)
+		rpctest_arena_end();
+
+	if (deferred && !error)
+		return;
+	svc_stats_record(rqstp->rq_proc, transp, error, bytes_in, bytes_out,
+			svc_malloc_count() - allocs, t0);
+}
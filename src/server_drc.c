@@ -0,0 +1,354 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Duplicate request cache for rpc.squared.
+ *
+ * UDP clients retransmit calls whose reply is late, and without a cache
+ * we execute every retransmission again - which adds load exactly when
+ * the server is already behind. With rpc.squared -D, we keep the replies
+ * sent over datagram transports, keyed on client address, XID, program,
+ * version and procedure, and answer retransmissions from the cache.
+ * Entries are found through a hash table, and the least recently used
+ * one is recycled when the cache is full.
+ *
+ * libtirpc's svc_dg_enablecache does much the same, but keeps no
+ * statistics. Like it, we need the encoded reply, so we encode replies
+ * on datagram transports ourselves rather than through svc_sendreply.
+ * This skips SVCAUTH_WRAP, which is fine for AUTH_NONE and AUTH_SYS.
+ *
+ * Only successful replies are cached; calls that failed are executed
+ * again when they are retransmitted.
+ */
+#include <sys/socket.h>
+#include <pthread.h>
+#include "rpctest.h"
+
+struct svc_drc_entry {
+	/* Hash chain */
+	struct svc_drc_entry *	hash_next;
+	struct svc_drc_entry **	hash_pprev;
+
+	/* LRU list, most recently used first */
+	struct svc_drc_entry *	lru_next;
+	struct svc_drc_entry *	lru_prev;
+
+	unsigned int		hash;
+	uint32_t		xid;
+	uint32_t		prog, vers, proc;
+	socklen_t		addrlen;
+	struct sockaddr_storage	addr;
+
+	char *			reply;
+	unsigned int		reply_len;
+};
+
+static pthread_mutex_t		svc_drc_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int		svc_drc_size;
+static struct svc_drc_entry *	svc_drc_entries;
+static struct svc_drc_entry **	svc_drc_hash;
+static unsigned int		svc_drc_hash_mask;
+static struct svc_drc_entry	svc_drc_lru;
+
+static void
+__svc_drc_lru_unlink(struct svc_drc_entry *e)
+{
+	e->lru_prev->lru_next = e->lru_next;
+	e->lru_next->lru_prev = e->lru_prev;
+}
+
+static void
+__svc_drc_lru_push(struct svc_drc_entry *e)
+{
+	e->lru_next = svc_drc_lru.lru_next;
+	e->lru_prev = &svc_drc_lru;
+	e->lru_next->lru_prev = e;
+	svc_drc_lru.lru_next = e;
+}
+
+static void
+__svc_drc_unhash(struct svc_drc_entry *e)
+{
+	if (e->hash_pprev == NULL)
+		return;
+	if (e->hash_next)
+		e->hash_next->hash_pprev = e->hash_pprev;
+	*e->hash_pprev = e->hash_next;
+	e->hash_next = NULL;
+	e->hash_pprev = NULL;
+}
+
+static void
+__svc_drc_hash_insert(struct svc_drc_entry *e)
+{
+	struct svc_drc_entry **head = &svc_drc_hash[e->hash & svc_drc_hash_mask];
+
+	e->hash_next = *head;
+	e->hash_pprev = head;
+	if (*head)
+		(*head)->hash_pprev = &e->hash_next;
+	*head = e;
+}
+
+/*
+ * Allocate a cache of the given number of entries. Call this
+ * before serving any calls.
+ */
+int
+svc_drc_init(unsigned int size)
+{
+	unsigned int i, nbuckets;
+
+	if (size == 0)
+		return 0;
+
+	for (nbuckets = 1; nbuckets < size; nbuckets <<= 1)
+		;
+
+	svc_drc_entries = calloc(size, sizeof(svc_drc_entries[0]));
+	svc_drc_hash = calloc(nbuckets, sizeof(svc_drc_hash[0]));
+	if (svc_drc_entries == NULL || svc_drc_hash == NULL) {
+		log_error("unable to allocate duplicate request cache");
+		free(svc_drc_entries);
+		free(svc_drc_hash);
+		return -1;
+	}
+	svc_drc_hash_mask = nbuckets - 1;
+
+	/* All entries start out unused at the end of the LRU list */
+	svc_drc_lru.lru_next = svc_drc_lru.lru_prev = &svc_drc_lru;
+	for (i = 0; i < size; ++i)
+		__svc_drc_lru_push(&svc_drc_entries[i]);
+
+	svc_drc_size = size;
+	return 0;
+}
+
+unsigned int
+svc_drc_get_size(void)
+{
+	return svc_drc_size;
+}
+
+static int
+__svc_drc_is_dgram(const SVCXPRT *xprt)
+{
+	socklen_t len = sizeof(int);
+	int type;
+
+	/* Transports created with svcudp_create have no netid */
+	if (xprt->xp_netid)
+		return !strncmp(xprt->xp_netid, "udp", 3);
+
+	if (getsockopt(xprt->xp_fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+		return 0;
+	return type == SOCK_DGRAM;
+}
+
+/*
+ * svc_req does not tell us the XID. However, svc_dg keeps the datagram
+ * it received in xp_p1 (rpc_buffer() in libtirpc's svc_dg.c) until the
+ * reply is sent, and a call starts with the XID.
+ */
+static int
+__svc_drc_get_xid(const SVCXPRT *xprt, uint32_t *xid)
+{
+	uint32_t value;
+
+	if (xprt->xp_p1 == NULL)
+		return -1;
+	memcpy(&value, xprt->xp_p1, 4);
+	*xid = ntohl(value);
+	return 0;
+}
+
+static unsigned int
+__svc_drc_hashfn(uint32_t xid, const struct netbuf *addr)
+{
+	const unsigned char *p = addr->buf;
+	unsigned int i, h = 2166136261U;
+
+	/* FNV-1a over the client address, mixed with the XID */
+	for (i = 0; i < addr->len; ++i)
+		h = (h ^ p[i]) * 16777619U;
+	return h ^ (xid * 2654435761U);
+}
+
+static struct svc_drc_entry *
+__svc_drc_find(unsigned int hash, uint32_t xid, const struct svc_req *rqstp, const struct netbuf *addr)
+{
+	struct svc_drc_entry *e;
+
+	for (e = svc_drc_hash[hash & svc_drc_hash_mask]; e; e = e->hash_next) {
+		if (e->hash == hash
+		 && e->xid == xid
+		 && e->proc == rqstp->rq_proc
+		 && e->vers == rqstp->rq_vers
+		 && e->prog == rqstp->rq_prog
+		 && e->addrlen == addr->len
+		 && !memcmp(&e->addr, addr->buf, addr->len))
+			return e;
+	}
+	return NULL;
+}
+
+/*
+ * Send an encoded reply. The batched UDP transport (-M) queues it with
+ * the other replies of its batch; on svc_dg, we send it ourselves.
+ */
+static int
+__svc_drc_send(SVCXPRT *xprt, char *buf, unsigned int len, const struct netbuf *addr)
+{
+	struct netbuf reply = { .maxlen = len, .len = len, .buf = buf };
+
+	if (SVC_CONTROL(xprt, SVCSET_SENDREPLY_RAW, &reply))
+		return 0;
+	if (sendto(xprt->xp_fd, buf, len, 0, addr->buf, addr->len) < 0)
+		return -1;
+	return 0;
+}
+
+/*
+ * Check whether this call is a retransmission of one we have already
+ * replied to. If so, send the cached reply, and return 1.
+ */
+int
+svc_drc_replay(struct svc_req *rqstp, SVCXPRT *xprt)
+{
+	const struct netbuf *addr = svc_getrpccaller(xprt);
+	struct svc_drc_entry *e;
+	unsigned int hash;
+	uint32_t xid;
+
+	if (svc_drc_size == 0 || !__svc_drc_is_dgram(xprt))
+		return 0;
+	if (__svc_drc_get_xid(xprt, &xid) < 0 || addr->len > sizeof(e->addr))
+		return 0;
+
+	hash = __svc_drc_hashfn(xid, addr);
+
+	pthread_mutex_lock(&svc_drc_lock);
+	if ((e = __svc_drc_find(hash, xid, rqstp, addr)) == NULL) {
+		pthread_mutex_unlock(&svc_drc_lock);
+		svc_stats_record_drc(SVC_DRC_MISS);
+		return 0;
+	}
+
+	__svc_drc_lru_unlink(e);
+	__svc_drc_lru_push(e);
+
+	if (__svc_drc_send(xprt, e->reply, e->reply_len, addr) < 0)
+		log_error("unable to resend cached reply: %m");
+	pthread_mutex_unlock(&svc_drc_lock);
+
+	svc_stats_record_drc(SVC_DRC_HIT);
+	return 1;
+}
+
+static void
+__svc_drc_insert(unsigned int hash, uint32_t xid, const struct svc_req *rqstp, const struct netbuf *addr,
+			char *reply, unsigned int reply_len)
+{
+	struct svc_drc_entry *e;
+	int evicted = 0;
+
+	pthread_mutex_lock(&svc_drc_lock);
+
+	/* If a retransmission got here before we replied to the
+	 * original call, we executed it twice. Keep the newer reply. */
+	e = __svc_drc_find(hash, xid, rqstp, addr);
+	if (e == NULL) {
+		e = svc_drc_lru.lru_prev;
+		if (e->hash_pprev) {
+			__svc_drc_unhash(e);
+			evicted = 1;
+		}
+
+		e->hash = hash;
+		e->xid = xid;
+		e->prog = rqstp->rq_prog;
+		e->vers = rqstp->rq_vers;
+		e->proc = rqstp->rq_proc;
+		e->addrlen = addr->len;
+		memcpy(&e->addr, addr->buf, addr->len);
+		__svc_drc_hash_insert(e);
+	}
+
+	free(e->reply);
+	e->reply = reply;
+	e->reply_len = reply_len;
+
+	__svc_drc_lru_unlink(e);
+	__svc_drc_lru_push(e);
+
+	pthread_mutex_unlock(&svc_drc_lock);
+
+	if (evicted)
+		svc_stats_record_drc(SVC_DRC_EVICT);
+}
+
+/*
+ * Send a successful reply, like svc_sendreply. On datagram transports,
+ * the reply is added to the cache if there is one.
+ */
+bool_t
+svc_drc_sendreply(struct svc_req *rqstp, SVCXPRT *xprt, xdrproc_t xdr_res, void *result)
+{
+	const struct netbuf *addr = svc_getrpccaller(xprt);
+	struct rpc_msg msg;
+	unsigned int len;
+	uint32_t xid;
+	char *buf;
+	XDR xdrs;
+
+	if (svc_drc_size == 0 || !__svc_drc_is_dgram(xprt)
+	 || __svc_drc_get_xid(xprt, &xid) < 0
+	 || addr->len > sizeof(struct sockaddr_storage))
+		return svc_sendreply(xprt, xdr_res, result);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.rm_xid = xid;
+	msg.rm_direction = REPLY;
+	msg.rm_reply.rp_stat = MSG_ACCEPTED;
+	msg.acpted_rply.ar_verf = xprt->xp_verf;
+	msg.acpted_rply.ar_stat = SUCCESS;
+	msg.acpted_rply.ar_results.where = result;
+	msg.acpted_rply.ar_results.proc = xdr_res;
+
+	len = xdr_sizeof((xdrproc_t) xdr_replymsg, &msg);
+	if ((buf = malloc(len)) == NULL)
+		return FALSE;
+
+	xdrmem_create(&xdrs, buf, len, XDR_ENCODE);
+	if (!xdr_replymsg(&xdrs, &msg)) {
+		xdr_destroy(&xdrs);
+		free(buf);
+		return FALSE;
+	}
+	xdr_destroy(&xdrs);
+
+	if (__svc_drc_send(xprt, buf, len, addr) < 0) {
+		free(buf);
+		return FALSE;
+	}
+
+	__svc_drc_insert(__svc_drc_hashfn(xid, addr), xid, rqstp, addr, buf, len);
+	return TRUE;
+}
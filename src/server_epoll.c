@@ -0,0 +1,181 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * epoll based replacement for svc_run().
+ *
+ * svc_run() hands all of svc_pollfd to poll() on every iteration, which
+ * costs O(connections) per wakeup even if all but one are idle. Here,
+ * we keep the transport fds in an epoll set instead, and only look at
+ * the ones that are ready.
+ *
+ * libtirpc does not tell us when transports come and go, so we mirror
+ * svc_pollfd: for every fd we track, we remember the slot it occupies.
+ *
+ *  -	A transport is destroyed only from within svc_getreq_common() on
+ *	its own fd. xprt_unregister() clears its slot, so after each call
+ *	we check whether the slot still holds our fd. Closing the fd
+ *	removes it from the epoll set, unless the socket is still open
+ *	through a dup - which is what server_defer.c does to reply to
+ *	deferred calls. So we have it close those as well, or epoll
+ *	would keep reporting an fd we no longer serve.
+ *  -	New transports are created when svc_getreq_common() accepts on a
+ *	listening socket. xprt_register() puts them into the first unused
+ *	slot of svc_pollfd, or appends them. We remember the lowest slot
+ *	that may be unused, and scan forward from there.
+ */
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include "rpctest.h"
+
+#define EPOLL_BATCH	256
+
+struct svc_epoll {
+	int		epfd;
+	unsigned int	max_fds;
+
+	/* slot + 1 for every fd we track, 0 if we don't */
+	unsigned int *	slot;
+	unsigned char *	listener;
+
+	/* All slots below this one are in use */
+	int		first_free;
+};
+
+static void
+__svc_epoll_add(struct svc_epoll *ep, int fd, int slot)
+{
+	struct epoll_event ev;
+
+	if (fd >= ep->max_fds) {
+		log_error("svc epoll: fd %d exceeds file limit", fd);
+		return;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(ep->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		log_error("svc epoll: cannot add fd %d: %m", fd);
+		return;
+	}
+	ep->slot[fd] = slot + 1;
+}
+
+/*
+ * Pick up transports registered since the last scan.
+ */
+static void
+__svc_epoll_scan(struct svc_epoll *ep)
+{
+	int i;
+
+	for (i = ep->first_free; i < svc_max_pollfd; ++i) {
+		int fd = svc_pollfd[i].fd;
+
+		if (fd < 0)
+			break;
+		if (fd < ep->max_fds && ep->slot[fd] == i + 1)
+			continue;
+		__svc_epoll_add(ep, fd, i);
+	}
+	ep->first_free = i;
+}
+
+/*
+ * Check whether the transport on fd is still around after a call to
+ * svc_getreq_common.
+ */
+static void
+__svc_epoll_check(struct svc_epoll *ep, int fd)
+{
+	int slot = ep->slot[fd] - 1;
+
+	if (slot < svc_max_pollfd && svc_pollfd[slot].fd == fd)
+		return;
+
+	ep->slot[fd] = 0;
+	svc_defer_drop_fd(fd);
+	if (slot < ep->first_free)
+		ep->first_free = slot;
+}
+
+void
+rpctest_svc_run_epoll(void)
+{
+	struct epoll_event events[EPOLL_BATCH];
+	struct svc_epoll ep;
+	struct rlimit rlim;
+	int i;
+
+	memset(&ep, 0, sizeof(ep));
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0 || rlim.rlim_cur == RLIM_INFINITY)
+		ep.max_fds = 65536;
+	else
+		ep.max_fds = rlim.rlim_cur;
+
+	ep.slot = calloc(ep.max_fds, sizeof(ep.slot[0]));
+	ep.listener = calloc(ep.max_fds, 1);
+
+	if ((ep.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		log_fatal("svc epoll: cannot create epoll fd: %m");
+
+	/* Listening sockets all exist at this point, and are never closed */
+	ep.first_free = -1;
+	for (i = 0; i < svc_max_pollfd; ++i) {
+		int fd = svc_pollfd[i].fd;
+
+		if (fd < 0) {
+			if (ep.first_free < 0)
+				ep.first_free = i;
+			continue;
+		}
+		__svc_epoll_add(&ep, fd, i);
+		if (fd < ep.max_fds)
+			ep.listener[fd] = svc_fd_is_listener(fd);
+	}
+	if (ep.first_free < 0)
+		ep.first_free = svc_max_pollfd;
+
+	while (1) {
+		int n;
+
+		n = epoll_wait(ep.epfd, events, EPOLL_BATCH, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_fatal("svc epoll: epoll_wait: %m");
+		}
+
+		for (i = 0; i < n; ++i) {
+			int fd = events[i].data.fd;
+
+			svc_getreq_common(fd);
+
+			if (ep.listener[fd])
+				__svc_epoll_scan(&ep);
+			else
+				__svc_epoll_check(&ep, fd);
+		}
+	}
+}
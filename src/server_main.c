@@ -23,36 +23,454 @@
  *	Can be one of the common nettypes (like netpath, visible, circuit_n, circuit_v,
  *	datagram_n, datagram_v, tcp, and udp).
  *	Specifying -T with an empty string causes it to call svc_reg with a NULL nettype.
+ *	Specifying -T local creates a transport bound to SQUARE_LOCAL_ADDR.
+ *
+ * -C <cpulist>
+ *	Pin the server to the given CPUs (see cpuset.c for the syntax).
+ *	The resulting placement is printed on startup.
+ *	With -j, worker threads are pinned round-robin to the CPUs of the list.
+ *
+ * -j <nthreads>
+ *	Dispatch requests from a pool of worker threads instead of svc_run().
+ *	See server_pool.c for how transports are handed out.
+ *
+ * -E
+ *	Use an epoll based main loop instead of svc_run(). This scales to
+ *	large numbers of idle connections; see server_epoll.c.
+ *
+ * -P <nworkers>
+ *	Fork the given number of worker processes, each of which serves
+ *	the same TCP and UDP port through SO_REUSEPORT sockets, and let
+ *	the kernel balance the load between them. The port is registered
+ *	with rpcbind once, and unregistered when the supervisor terminates.
+ *	With -C, worker N is pinned to the N-th CPU of the list.
+ *	Send SIGUSR1 to the supervisor to have it print per-worker stats.
+ *	Cannot be combined with -T or -o.
+ *
+ * -G
+ *	Decode all arguments with the rpcgen generated XDR routines. By
+ *	default, some procedures use faster custom decoders, and others
+ *	decode into a per-request arena rather than memory from malloc
+ *	(see arena.c); this option is for comparing the two.
+ *
+ * -b sendsz=N,recvsz=N,sndbuf=N,rcvbuf=N
+ *	Set the size of the XDR send and receive buffers of the transports
+ *	(the sendsz and recvsz arguments of svc_tli_create), and the socket
+ *	buffer sizes (SO_SNDBUF, SO_RCVBUF). Sizes may have a k or m suffix.
+ *	Anything not given keeps its default. For UDP, sendsz and recvsz
+ *	also limit the size of datagrams.
+ *
+ * -n <maxrec>
+ *	Put connection oriented transports into non-blocking mode, and
+ *	limit the size of a record to maxrec bytes (k and m suffixes are
+ *	allowed). By default, svc_vc reads a record until it is complete,
+ *	so a client that sends a call slowly stalls everyone else served by
+ *	the same thread. In non-blocking mode, libtirpc only reads what is
+ *	there, and assembles the record over several wakeups. Clients that
+ *	send larger records are disconnected.
+ *
+ * -D <nentries>
+ *	Keep a duplicate request cache of the given number of entries for
+ *	UDP, and answer retransmitted calls from it instead of executing
+ *	them again (see server_drc.c). Hits, misses and evictions are
+ *	reported by "square stats".
+ *
+ * -M <batch>
+ *	Serve UDP sockets with recvmmsg and sendmmsg, up to batch datagrams
+ *	per system call, rather than through libtirpc's svc_dg, which does
+ *	one recvmsg and one sendmsg per call. Every UDP socket gets a thread
+ *	of its own (see server_mmsg.c); the other transports are served as
+ *	usual.
+ *
+ * -A
+ *	Reply to calls that wait asynchronously, so that the thread serving
+ *	them can go on serving other calls in the meantime. The dispatcher
+ *	returns without replying, and the reply is sent from a completion
+ *	queue when it is due (see server_defer.c). For now, the only wait
+ *	is the sleep of WORKPROC. Cannot be combined with -j.
+ *
+ * -F <fd>
+ *	Serve the program on an inherited socket, which must be bound
+ *	already. May be given several times. Likewise, when started through
+ *	systemd socket activation, we serve the sockets passed in LISTEN_FDS.
+ *	This skips creating and binding a socket for every netconfig entry,
+ *	and all transports are registered with rpcbind over a single
+ *	connection (see rpctest_svc_register_fds), which makes for a much
+ *	faster startup. "square startup" measures the difference.
+ *	Unless -T is given as well, only the inherited sockets are served.
  *
  */
 #include "rpctest.h"
+#include <rpc/rpc_com.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
 #include <getopt.h>
+#include <limits.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+
+struct squared_worker_stats {
+	pid_t		pid;
+	unsigned int	restarts;
+	unsigned long	calls;
+};
+
+static RPCB		local_reg[] = {
+	{
+		.r_prog = SQUARE_PROG,
+		.r_vers = SQUARE_VERS,
+		.r_netid = "local",
+		.r_addr = SQUARE_LOCAL_ADDR,
+	},
+	{ 0 }
+};
+
+static char		reuseport_addr[32];
+static RPCB		reuseport_reg[] = {
+	{
+		.r_prog = SQUARE_PROG,
+		.r_vers = SQUARE_VERS,
+		.r_netid = "tcp",
+		.r_addr = reuseport_addr,
+	},
+	{
+		.r_prog = SQUARE_PROG,
+		.r_vers = SQUARE_VERS,
+		.r_netid = "udp",
+		.r_addr = reuseport_addr,
+	},
+	{ 0 }
+};
+
+static int		opt_pinned = 0;
+static cpu_set_t	opt_cpus;
+static unsigned int	opt_threads = 0;
+static int		opt_epoll = 0;
+static unsigned int	opt_workers = 0;
+static int		opt_generic_xdr = 0;
+static unsigned int	opt_maxrec = 0;
+static unsigned int	opt_drc_size = 0;
+static unsigned int	opt_mmsg_batch = 0;
+static int		opt_async = 0;
+static int		opt_fds[64];
+static unsigned int	num_fds = 0;
+
+/* Shared between the supervisor and all workers with -P */
+static struct squared_worker_stats *worker_stats;
+static struct squared_worker_stats *my_stats;
+
+/*
+ * Parse the argument to -b
+ */
+static int
+squared_parse_bufsizes(char *value, struct rpctest_svc_bufsizes *bs)
+{
+	char *item;
+
+	for (item = strtok(value, ","); item; item = strtok(NULL, ",")) {
+		unsigned int size;
+		char *s;
+
+		if ((s = strchr(item, '=')) == NULL)
+			goto bad;
+		*s++ = '\0';
+
+		if (rpctest_parse_size(s, &size) < 0)
+			goto bad;
+
+		if (!strcmp(item, "sendsz"))
+			bs->sendsz = size;
+		else if (!strcmp(item, "recvsz"))
+			bs->recvsz = size;
+		else if (!strcmp(item, "sndbuf"))
+			bs->sndbuf = size;
+		else if (!strcmp(item, "rcvbuf"))
+			bs->rcvbuf = size;
+		else
+			goto bad;
+	}
+	return 0;
+
+bad:
+	log_error("bad buffer size \"%s\"; expected sendsz=, recvsz=, sndbuf= or rcvbuf=", item);
+	return -1;
+}
+
+/*
+ * Add a socket we inherited to the list of those we serve
+ */
+static int
+squared_add_fd(int fd)
+{
+	if (fd < 0 || fcntl(fd, F_GETFD) < 0) {
+		log_error("fd %d is not open", fd);
+		return -1;
+	}
+	if (num_fds >= 64) {
+		log_error("too many sockets");
+		return -1;
+	}
+
+	opt_fds[num_fds++] = fd;
+	return 0;
+}
+
+/*
+ * Pick up the sockets passed to us through systemd's socket activation
+ * protocol. They start at fd 3, and are only meant for us if LISTEN_PID
+ * is our pid.
+ */
+static int
+squared_listen_fds(void)
+{
+	const char *value;
+	unsigned int i, count;
+	char *s;
+
+	if ((value = getenv("LISTEN_FDS")) == NULL)
+		return 0;
+
+	count = strtoul(value, &s, 10);
+	if (*s || s == value) {
+		log_error("bad LISTEN_FDS value \"%s\"", value);
+		return -1;
+	}
+
+	if ((value = getenv("LISTEN_PID")) != NULL && strtoul(value, NULL, 10) != (unsigned long) getpid())
+		return 0;
+
+	/* Don't pass these on to anything we might start */
+	unsetenv("LISTEN_FDS");
+	unsetenv("LISTEN_PID");
+	unsetenv("LISTEN_FDNAMES");
+
+	for (i = 0; i < count; ++i) {
+		int fd = 3 + i;
+
+		if (squared_add_fd(fd) < 0)
+			return -1;
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+
+	return 0;
+}
+
+static void
+squared_dispatch(struct svc_req *req, SVCXPRT *xprt)
+{
+	if (my_stats)
+		__atomic_fetch_add(&my_stats->calls, 1, __ATOMIC_RELAXED);
+	squared_prog_1(req, xprt);
+}
+
+static void
+squared_run(void)
+{
+	/* With -P, every worker has a queue of its own */
+	if (opt_async && svc_defer_init() < 0)
+		exit(1);
+
+	/* Threads don't survive daemon(), so we start this late */
+	if (opt_mmsg_batch
+	 && svc_mmsg_start(opt_mmsg_batch, SQUARE_PROG, SQUARE_VERS, squared_dispatch) < 0)
+		exit(1);
+
+	if (opt_epoll)
+		rpctest_svc_run_epoll();
+	else if (opt_threads)
+		rpctest_svc_run_pool(opt_threads, (opt_pinned && !opt_workers)? &opt_cpus : NULL);
+	else
+		svc_run();
+}
+
+/*
+ * Find a port we can bind both a TCP and a UDP socket to
+ */
+static int
+squared_pick_port(void)
+{
+	unsigned int attempt;
+
+	for (attempt = 0; attempt < 16; ++attempt) {
+		struct sockaddr_in sin;
+		socklen_t len = sizeof(sin);
+		int tcp_fd, udp_fd, one = 1, port = -1;
+
+		tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+		udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+		setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+		setsockopt(udp_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		if (bind(tcp_fd, (struct sockaddr *) &sin, sizeof(sin)) == 0
+		 && getsockname(tcp_fd, (struct sockaddr *) &sin, &len) == 0
+		 && bind(udp_fd, (struct sockaddr *) &sin, sizeof(sin)) == 0)
+			port = ntohs(sin.sin_port);
+
+		close(tcp_fd);
+		close(udp_fd);
+		if (port > 0)
+			return port;
+	}
+
+	return -1;
+}
+
+static void
+squared_worker(unsigned int index, int respawn)
+{
+	int flags = SVF_REUSEPORT;
+
+	my_stats = &worker_stats[index];
+	my_stats->pid = getpid();
+	svc_stats_set_slot(index);
+	if (respawn)
+		my_stats->restarts++;
+
+	if (opt_pinned && rpctest_cpuset_pin_thread(&opt_cpus, index) < 0)
+		exit(1);
+
+	/* Only the first incarnation of the first worker registers
+	 * with rpcbind. */
+	if (index != 0 || respawn)
+		flags |= SVF_NOREG;
+
+	if (!rpctest_svc_register_rpcb_flags(reuseport_reg, squared_dispatch, flags))
+		exit(1);
+
+	squared_run();
+}
+
+static void
+squared_report(void)
+{
+	unsigned long total = 0;
+	unsigned int i;
+
+	for (i = 0; i < opt_workers; ++i)
+		total += worker_stats[i].calls;
+
+	for (i = 0; i < opt_workers; ++i) {
+		const struct squared_worker_stats *ws = &worker_stats[i];
+
+		fprintf(stderr, "rpc.squared: worker %u pid %d: %lu calls (%.1f%%), %u restarts\n",
+				i, (int) ws->pid, ws->calls,
+				total? 100.0 * ws->calls / total : 0,
+				ws->restarts);
+	}
+	fprintf(stderr, "rpc.squared: total %lu calls\n", total);
+}
+
+static int
+squared_run_workers(void)
+{
+	int port;
+
+	if ((port = squared_pick_port()) < 0) {
+		log_error("unable to find a port for TCP and UDP");
+		return 1;
+	}
+	snprintf(reuseport_addr, sizeof(reuseport_addr), "0.0.0.0.%u.%u", port >> 8, port & 0xff);
+	fprintf(stderr, "rpc.squared: %u workers serving port %u\n", opt_workers, port);
+
+	worker_stats = mmap(NULL, opt_workers * sizeof(worker_stats[0]),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (worker_stats == MAP_FAILED) {
+		log_error("unable to allocate shared memory: %m");
+		return 1;
+	}
+	memset(worker_stats, 0, opt_workers * sizeof(worker_stats[0]));
+
+	rpctest_run_workers(opt_workers, squared_worker, squared_report);
+
+	rpcb_unset(SQUARE_PROG, SQUARE_VERS, NULL);
+	return 0;
+}
 
 int
 main(int argc, char **argv)
 {
 	const char *opt_hostname = NULL;
 	const char *opt_nettype[16];
+	struct rpctest_svc_bufsizes opt_bufsizes;
 	int opt_foreground = 0;
 	int opt_oldstyle = 0;
 	unsigned int num_nettypes = 0;
 	int c;
 
-	while ((c = getopt(argc, argv, "fh:oT:")) != EOF) {
+	memset(&opt_bufsizes, 0, sizeof(opt_bufsizes));
+	while ((c = getopt(argc, argv, "Ab:C:D:EF:fGh:j:M:n:oP:T:")) != EOF) {
 		switch (c) {
+		case 'A':
+			opt_async = 1;
+			break;
+
+		case 'b':
+			if (squared_parse_bufsizes(optarg, &opt_bufsizes) < 0)
+				return 1;
+			break;
+
+		case 'C':
+			if (rpctest_cpuset_parse(optarg, &opt_cpus) < 0)
+				return 1;
+			opt_pinned = 1;
+			break;
+
+		case 'D':
+			opt_drc_size = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'E':
+			opt_epoll = 1;
+			break;
+
+		case 'F':
+			if (squared_add_fd(strtol(optarg, NULL, 0)) < 0)
+				return 1;
+			break;
+
 		case 'f':
 			opt_foreground = 1;
 			break;
 
+		case 'G':
+			opt_generic_xdr = 1;
+			break;
+
 		case 'h':
 			opt_hostname = optarg;
 			break;
 
+		case 'j':
+			opt_threads = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'M':
+			opt_mmsg_batch = strtoul(optarg, NULL, 0);
+			if (opt_mmsg_batch == 0 || opt_mmsg_batch > 1024) {
+				log_error("bad batch size \"%s\"", optarg);
+				return 1;
+			}
+			break;
+
+		case 'n':
+			if (rpctest_parse_size(optarg, &opt_maxrec) < 0 || opt_maxrec == 0) {
+				log_error("bad record size \"%s\"", optarg);
+				return 1;
+			}
+			break;
+
 		case 'o':
 			opt_oldstyle = 1;
 			break;
 
+		case 'P':
+			opt_workers = strtoul(optarg, NULL, 0);
+			break;
+
 		case 'T':
 			if (optarg && *optarg == '\0')
 				optarg = NULL;
@@ -63,28 +481,88 @@ main(int argc, char **argv)
 		usage:
 			fprintf(stderr,
 				"Usage:\n"
-				"rpc.squared [-h hostname] [-T nettype]\n");
+				"rpc.squared [-h hostname] [-T nettype] [-F fd] [-C cpulist] [-j nthreads | -E] [-A] [-G] [-b bufsizes] [-n maxrec] [-D nentries] [-M batch]\n"
+				"rpc.squared [-C cpulist] [-j nthreads | -E] [-A] [-G] [-b bufsizes] [-n maxrec] [-D nentries] [-M batch] -P nworkers\n");
 			return 1;
 		}
 	}
 
-	if (optind != argc)
+	if (optind != argc || (opt_epoll && opt_threads) || (opt_async && opt_threads))
+		goto usage;
+	if (squared_listen_fds() < 0)
+		return 1;
+	if (opt_workers && (num_nettypes || opt_oldstyle || num_fds))
 		goto usage;
 
+	/* libtirpc sizes its transport table when the first transport
+	 * is registered, so do this before anything else */
+	rpctest_raise_fd_limit();
+
+	/* A client that goes away while we're sending a large reply
+	 * should not take us down */
+	signal(SIGPIPE, SIG_IGN);
+
+	squared_dispatch_init(!opt_generic_xdr, opt_async);
+	rpctest_svc_set_bufsizes(&opt_bufsizes);
+
+	/* This only affects connections accepted after the call */
+	if (opt_maxrec) {
+		int maxrec = opt_maxrec;
+
+		if (!rpc_control(RPC_SVC_CONNMAXREC_SET, &maxrec)) {
+			log_error("unable to set maximum record size");
+			return 1;
+		}
+	}
+
+	/* With -P, every worker gets its own slot */
+	if (svc_stats_init(opt_workers? : 1) < 0)
+		return 1;
+
+	/* With -P, every worker has a cache of its own. That's fine,
+	 * because a client's retransmissions go to the same worker. */
+	if (svc_drc_init(opt_drc_size) < 0)
+		return 1;
+
+	if (opt_pinned) {
+		struct rpctest_placement pl;
+
+		if (rpctest_cpuset_pin_thread(&opt_cpus, -1) < 0)
+			return 1;
+		rpctest_cpuset_topology(&opt_cpus, &pl);
+		fprintf(stderr, "rpc.squared: placement %s\n", rpctest_placement_print(&pl));
+	}
+
+	if (num_fds && !rpctest_svc_register_fds(opt_fds, num_fds, SQUARE_PROG, SQUARE_VERS, squared_dispatch, 0))
+		return 1;
+
+	if (opt_workers) {
+		/* Workers create their own transports */
+	} else
 	if (num_nettypes) {
 		unsigned int i = 0;
 
 		for (i = 0; i < num_nettypes; ++i) {
 			const char *nettype = opt_nettype[i];
 
-			if (!rpctest_register_service_nettype(SQUARE_PROG, SQUARE_VERS, square_prog_1, nettype))
+			/* svc_create does not know about a "local" nettype */
+			if (nettype && !strcmp(nettype, "local")) {
+				if (!rpctest_svc_register_rpcb(local_reg, squared_dispatch))
+					return 1;
+				continue;
+			}
+
+			if (!rpctest_register_service_nettype(SQUARE_PROG, SQUARE_VERS, squared_dispatch, nettype))
 				return 1;
 		}
 	} else
+	if (num_fds) {
+		/* Only serve the sockets we were given */
+	} else
 	if (opt_oldstyle) {
-		rpctest_run_oldstyle(SQUARE_PROG, SQUARE_VERS, square_prog_1);
+		rpctest_run_oldstyle(SQUARE_PROG, SQUARE_VERS, squared_dispatch);
 	} else {
-		rpctest_run_newstyle(SQUARE_PROG, SQUARE_VERS, square_prog_1);
+		rpctest_run_newstyle(SQUARE_PROG, SQUARE_VERS, squared_dispatch);
 	}
 
 	if (!opt_foreground && daemon(0, 0) < 0) {
@@ -92,6 +570,9 @@ main(int argc, char **argv)
 		return 1;
 	}
 
-	svc_run();
+	if (opt_workers)
+		return squared_run_workers();
+
+	squared_run();
 	exit(1);
 }
@@ -0,0 +1,63 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Count memory allocations in rpc.squared.
+ *
+ * We interpose malloc, calloc and realloc, and count calls per thread,
+ * including those made by libtirpc. The dispatcher records how many
+ * allocations every call took (see svc_stats_record). The memory itself
+ * still comes from glibc, through its __libc_* entry points, so free
+ * does not need to be wrapped.
+ */
+#include "rpctest.h"
+
+extern void *		__libc_malloc(size_t);
+extern void *		__libc_calloc(size_t, size_t);
+extern void *		__libc_realloc(void *, size_t);
+
+static __thread unsigned long	svc_malloc_calls;
+
+unsigned long
+svc_malloc_count(void)
+{
+	return svc_malloc_calls;
+}
+
+void *
+malloc(size_t size)
+{
+	svc_malloc_calls++;
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	svc_malloc_calls++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	svc_malloc_calls++;
+	return __libc_realloc(ptr, size);
+}
@@ -0,0 +1,382 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Batched UDP transport for rpc.squared.
+ *
+ * svc_dg does one recvmsg and one sendmsg per call. With rpc.squared -M,
+ * every UDP socket is served by a thread of its own instead, which
+ * receives up to N datagrams with one recvmmsg, dispatches them one by
+ * one, and sends all replies with one sendmmsg.
+ *
+ * The sockets are taken over after libtirpc has created and registered
+ * its transports: we find the datagram sockets in svc_pollfd, and remove
+ * them from there, so that none of the main loops polls them any longer.
+ * libtirpc does not export its fd to transport table, so we can't call
+ * xprt_unregister; the svc_dg transport just stays around, unused.
+ *
+ * Calls are dispatched through a transport of our own, whose ops decode
+ * arguments from the datagram, and encode replies into the next slot of
+ * the send batch. Like the duplicate request cache, we skip SVCAUTH_WRAP
+ * and SVCAUTH_UNWRAP, which is fine for AUTH_NONE and AUTH_SYS. Replies
+ * from the duplicate request cache (-D), which it encodes itself, are
+ * handed to us through SVC_CONTROL, and go out with the batch as well.
+ */
+#include <sys/socket.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include "rpctest.h"
+#include <rpc/rpc_com.h>
+#include <rpc/svc_mt.h>
+
+/* Same as libtirpc's UDPMSGSIZE and RQCRED_SIZE */
+#define MMSG_DEFAULT_BUFSZ	8800
+#define MMSG_RQCRED_SIZE	400
+
+struct svc_mmsg {
+	int			fd;
+	unsigned int		batch;
+	unsigned int		sendsz, recvsz;
+
+	rpcprog_t		prog;
+	rpcvers_t		vers;
+	rpc_program_fn_t *	dispatch;
+
+	struct mmsghdr *	in;
+	struct iovec *		in_iov;
+	struct sockaddr_storage *in_addr;
+	char *			in_buf;
+
+	struct mmsghdr *	out;
+	struct iovec *		out_iov;
+	char *			out_buf;
+	unsigned int		nout;
+
+	/* The datagram being dispatched */
+	unsigned int		cur;
+	uint32_t		xid;
+	XDR			xdrs;
+
+	SVCXPRT			xprt;
+	SVCXPRT_EXT		xprt_ext;
+	char			cred_area[2 * MAX_AUTH_BYTES + MMSG_RQCRED_SIZE];
+};
+
+static enum xprt_stat
+__svc_mmsg_stat(SVCXPRT *xprt)
+{
+	return XPRT_IDLE;
+}
+
+static bool_t
+__svc_mmsg_recv(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+	/* We never go through svc_getreq */
+	return FALSE;
+}
+
+static bool_t
+__svc_mmsg_getargs(SVCXPRT *xprt, xdrproc_t xdr_args, void *args_ptr)
+{
+	struct svc_mmsg *mm = xprt->xp_p2;
+
+	return xdr_args(&mm->xdrs, args_ptr);
+}
+
+static bool_t
+__svc_mmsg_freeargs(SVCXPRT *xprt, xdrproc_t xdr_args, void *args_ptr)
+{
+	XDR xdrs;
+
+	xdrs.x_op = XDR_FREE;
+	return xdr_args(&xdrs, args_ptr);
+}
+
+/*
+ * Queue the len bytes at the start of the next slot of the send batch
+ * for the caller of the datagram being dispatched
+ */
+static void
+__svc_mmsg_queue(struct svc_mmsg *mm, unsigned int len)
+{
+	unsigned int slot = mm->nout;
+	struct msghdr *hdr = &mm->out[slot].msg_hdr;
+
+	mm->out_iov[slot].iov_base = mm->out_buf + slot * mm->sendsz;
+	mm->out_iov[slot].iov_len = len;
+	hdr->msg_name = &mm->in_addr[mm->cur];
+	hdr->msg_namelen = mm->in[mm->cur].msg_hdr.msg_namelen;
+	mm->nout++;
+}
+
+/*
+ * Encode the reply into the next slot of the send batch
+ */
+static bool_t
+__svc_mmsg_reply(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+	struct svc_mmsg *mm = xprt->xp_p2;
+	bool_t ok;
+	XDR xdrs;
+
+	msg->rm_xid = mm->xid;
+	xdrmem_create(&xdrs, mm->out_buf + mm->nout * mm->sendsz, mm->sendsz, XDR_ENCODE);
+	ok = xdr_replymsg(&xdrs, msg);
+	if (ok)
+		__svc_mmsg_queue(mm, xdr_getpos(&xdrs));
+	xdr_destroy(&xdrs);
+	return ok;
+}
+
+static void
+__svc_mmsg_destroy(SVCXPRT *xprt)
+{
+}
+
+/*
+ * SVCSET_SENDREPLY_RAW copies a reply that the duplicate request cache
+ * has encoded already into the send batch.
+ */
+static bool_t
+__svc_mmsg_control(SVCXPRT *xprt, const u_int rq, void *in)
+{
+	struct svc_mmsg *mm = xprt->xp_p2;
+	const struct netbuf *reply = in;
+
+	if (rq != SVCSET_SENDREPLY_RAW || reply->len > mm->sendsz)
+		return FALSE;
+
+	memcpy(mm->out_buf + mm->nout * mm->sendsz, reply->buf, reply->len);
+	__svc_mmsg_queue(mm, reply->len);
+	return TRUE;
+}
+
+static const struct xp_ops	svc_mmsg_ops = {
+	.xp_recv	= __svc_mmsg_recv,
+	.xp_stat	= __svc_mmsg_stat,
+	.xp_getargs	= __svc_mmsg_getargs,
+	.xp_reply	= __svc_mmsg_reply,
+	.xp_freeargs	= __svc_mmsg_freeargs,
+	.xp_destroy	= __svc_mmsg_destroy,
+};
+
+static const struct xp_ops2	svc_mmsg_ops2 = {
+	.xp_control	= __svc_mmsg_control,
+};
+
+/*
+ * Dispatch one datagram, like svc_getreq_common does
+ */
+static void
+__svc_mmsg_dispatch(struct svc_mmsg *mm, unsigned int i)
+{
+	SVCXPRT *xprt = &mm->xprt;
+	char *buf = mm->in_buf + i * mm->recvsz;
+	struct rpc_msg msg;
+	struct svc_req req;
+	enum auth_stat why;
+
+	mm->cur = i;
+	xprt->xp_p1 = buf;
+	xprt->xp_rtaddr.buf = &mm->in_addr[i];
+	xprt->xp_rtaddr.len = mm->in[i].msg_hdr.msg_namelen;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.rm_call.cb_cred.oa_base = mm->cred_area;
+	msg.rm_call.cb_verf.oa_base = mm->cred_area + MAX_AUTH_BYTES;
+
+	xdrmem_create(&mm->xdrs, buf, mm->in[i].msg_len, XDR_DECODE);
+	if (!xdr_callmsg(&mm->xdrs, &msg) || msg.rm_direction != CALL)
+		goto out;
+	mm->xid = msg.rm_xid;
+
+	req.rq_xprt = xprt;
+	req.rq_prog = msg.rm_call.cb_prog;
+	req.rq_vers = msg.rm_call.cb_vers;
+	req.rq_proc = msg.rm_call.cb_proc;
+	req.rq_cred = msg.rm_call.cb_cred;
+	req.rq_clntcred = mm->cred_area + 2 * MAX_AUTH_BYTES;
+
+	if ((why = _authenticate(&req, &msg)) != AUTH_OK) {
+		svcerr_auth(xprt, why);
+		goto out;
+	}
+
+	if (req.rq_prog != mm->prog)
+		svcerr_noprog(xprt);
+	else if (req.rq_vers != mm->vers)
+		svcerr_progvers(xprt, mm->vers, mm->vers);
+	else
+		mm->dispatch(&req, xprt);
+
+out:
+	xdr_destroy(&mm->xdrs);
+}
+
+static void
+__svc_mmsg_flush(struct svc_mmsg *mm)
+{
+	unsigned int sent = 0;
+
+	while (sent < mm->nout) {
+		int n;
+
+		n = sendmmsg(mm->fd, mm->out + sent, mm->nout - sent, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			/* Drop the rest, as svc_dg would */
+			log_error("svc mmsg: sendmmsg: %m");
+			break;
+		}
+		sent += n;
+	}
+	mm->nout = 0;
+}
+
+static void *
+__svc_mmsg_thread(void *arg)
+{
+	struct svc_mmsg *mm = arg;
+
+	while (1) {
+		unsigned int i;
+		int n;
+
+		for (i = 0; i < mm->batch; ++i)
+			mm->in[i].msg_hdr.msg_namelen = sizeof(mm->in_addr[i]);
+
+		/* Wait for the first datagram, then take what is there */
+		n = recvmmsg(mm->fd, mm->in, mm->batch, MSG_WAITFORONE, NULL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_fatal("svc mmsg: recvmmsg: %m");
+		}
+
+		for (i = 0; i < n; ++i)
+			__svc_mmsg_dispatch(mm, i);
+
+		__svc_mmsg_flush(mm);
+	}
+
+	return NULL;
+}
+
+static struct svc_mmsg *
+svc_mmsg_new(int fd, const char *netid, unsigned int batch, rpcprog_t prog, rpcvers_t vers,
+		rpc_program_fn_t *dispatch)
+{
+	struct rpctest_svc_bufsizes bs;
+	struct svc_mmsg *mm;
+	unsigned int i;
+
+	rpctest_svc_get_bufsizes(&bs);
+
+	mm = calloc(1, sizeof(*mm));
+	mm->fd = fd;
+	mm->batch = batch;
+	mm->sendsz = bs.sendsz? : MMSG_DEFAULT_BUFSZ;
+	mm->recvsz = bs.recvsz? : MMSG_DEFAULT_BUFSZ;
+	mm->prog = prog;
+	mm->vers = vers;
+	mm->dispatch = dispatch;
+
+	mm->in = calloc(batch, sizeof(mm->in[0]));
+	mm->in_iov = calloc(batch, sizeof(mm->in_iov[0]));
+	mm->in_addr = calloc(batch, sizeof(mm->in_addr[0]));
+	mm->in_buf = malloc(batch * mm->recvsz);
+	mm->out = calloc(batch, sizeof(mm->out[0]));
+	mm->out_iov = calloc(batch, sizeof(mm->out_iov[0]));
+	mm->out_buf = malloc(batch * mm->sendsz);
+	if (!mm->in || !mm->in_iov || !mm->in_addr || !mm->in_buf
+	 || !mm->out || !mm->out_iov || !mm->out_buf) {
+		log_error("svc mmsg: unable to allocate buffers");
+		return NULL;
+	}
+
+	for (i = 0; i < batch; ++i) {
+		mm->in_iov[i].iov_base = mm->in_buf + i * mm->recvsz;
+		mm->in_iov[i].iov_len = mm->recvsz;
+		mm->in[i].msg_hdr.msg_iov = &mm->in_iov[i];
+		mm->in[i].msg_hdr.msg_iovlen = 1;
+		mm->in[i].msg_hdr.msg_name = &mm->in_addr[i];
+
+		mm->out[i].msg_hdr.msg_iov = &mm->out_iov[i];
+		mm->out[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	mm->xprt.xp_fd = fd;
+	mm->xprt.xp_ops = &svc_mmsg_ops;
+	mm->xprt.xp_ops2 = &svc_mmsg_ops2;
+	mm->xprt.xp_netid = strdup(netid);
+	mm->xprt.xp_rtaddr.maxlen = sizeof(struct sockaddr_storage);
+	mm->xprt.xp_verf = _null_auth;
+	mm->xprt.xp_p2 = mm;
+	mm->xprt.xp_p3 = &mm->xprt_ext;
+	mm->xprt.xp_type = SOCK_DGRAM;
+
+	return mm;
+}
+
+/*
+ * Take over all datagram transports registered with libtirpc, and
+ * serve each of them from a thread of its own. Call this after all
+ * transports have been created, and after daemon(). Returns the number
+ * of sockets taken over.
+ */
+int
+svc_mmsg_start(unsigned int batch, rpcprog_t prog, rpcvers_t vers, rpc_program_fn_t *dispatch)
+{
+	unsigned int count = 0;
+	int i;
+
+	for (i = 0; i < svc_max_pollfd; ++i) {
+		int fd = svc_pollfd[i].fd;
+		struct __rpc_sockinfo si;
+		const char *netid;
+		struct svc_mmsg *mm;
+		pthread_t thread;
+		int err;
+
+		if (fd < 0 || !__rpc_fd2sockinfo(fd, &si) || si.si_socktype != SOCK_DGRAM)
+			continue;
+		if (!__rpc_sockinfo2netid(&si, &netid))
+			netid = "udp";
+
+		if ((mm = svc_mmsg_new(fd, netid, batch, prog, vers, dispatch)) == NULL)
+			return -1;
+
+		/* From now on, this socket is ours */
+		svc_pollfd[i].fd = -1;
+		FD_CLR(fd, &svc_fdset);
+
+		err = pthread_create(&thread, NULL, __svc_mmsg_thread, mm);
+		if (err != 0) {
+			log_error("svc mmsg: cannot create thread: %s", strerror(err));
+			return -1;
+		}
+		count++;
+	}
+
+	return count;
+}
@@ -0,0 +1,332 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Multi-threaded replacement for svc_run().
+ *
+ * One I/O thread polls all transports; whenever a transport becomes
+ * readable, it is handed to one of N worker threads which calls
+ * svc_getreq_common() on it. Ownership works like this:
+ *
+ *  -	A transport fd is either IDLE (owned by the I/O thread, and polled)
+ *	or BUSY (owned by exactly one worker, and not polled).
+ *  -	The I/O thread marks a fd BUSY before queueing it. The worker
+ *	hands it back through the completion queue when svc_getreq_common
+ *	returns, and the I/O thread marks it IDLE again.
+ *  -	Listening sockets are never handed to a worker. Accepting a
+ *	connection creates a new transport, and xprt_register() may
+ *	realloc svc_pollfd, so this has to happen in the I/O thread.
+ *
+ * A worker may destroy its transport (eg when the client closes the
+ * connection). If the I/O thread accepts a new connection before the
+ * worker has handed back the fd, the new transport may get the same fd;
+ * it will simply not be polled until the fd is IDLE again.
+ *
+ * UDP transports are a single socket, so only one worker can serve
+ * a given UDP transport at a time. Datagram traffic does not scale
+ * with -j.
+ */
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include "rpctest.h"
+
+#define FD_IDLE		0
+#define FD_BUSY		1
+
+struct svc_fdqueue {
+	int *		fds;
+	unsigned int	size;
+	unsigned int	head, count;
+};
+
+struct svc_pool {
+	unsigned int	nthreads;
+	pthread_t *	threads;
+	const cpu_set_t *cpus;
+
+	pthread_mutex_t	lock;
+	pthread_cond_t	work_avail;
+	struct svc_fdqueue work;
+	struct svc_fdqueue done;
+
+	/* Written by workers when they hand back a transport */
+	int		wakeup[2];
+};
+
+struct svc_pool_worker {
+	struct svc_pool *pool;
+	unsigned int	index;
+};
+
+static void
+__svc_fdqueue_init(struct svc_fdqueue *q, unsigned int size)
+{
+	q->fds = calloc(size, sizeof(int));
+	q->size = size;
+	q->head = q->count = 0;
+}
+
+/*
+ * Each fd is in at most one queue at a time, so a queue with room
+ * for all possible fds never overflows.
+ */
+static void
+__svc_fdqueue_put(struct svc_fdqueue *q, int fd)
+{
+	q->fds[(q->head + q->count++) % q->size] = fd;
+}
+
+static int
+__svc_fdqueue_get(struct svc_fdqueue *q)
+{
+	int fd;
+
+	if (q->count == 0)
+		return -1;
+	fd = q->fds[q->head];
+	q->head = (q->head + 1) % q->size;
+	q->count--;
+	return fd;
+}
+
+static unsigned int
+__svc_max_fds(void)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0 || rlim.rlim_cur == RLIM_INFINITY)
+		return 65536;
+	return rlim.rlim_cur;
+}
+
+static void *
+__svc_pool_worker(void *arg)
+{
+	struct svc_pool_worker *w = arg;
+	struct svc_pool *pool = w->pool;
+
+	if (pool->cpus)
+		rpctest_cpuset_pin_thread(pool->cpus, w->index);
+
+	while (1) {
+		int fd;
+
+		pthread_mutex_lock(&pool->lock);
+		while ((fd = __svc_fdqueue_get(&pool->work)) < 0)
+			pthread_cond_wait(&pool->work_avail, &pool->lock);
+		pthread_mutex_unlock(&pool->lock);
+
+		svc_getreq_common(fd);
+
+		pthread_mutex_lock(&pool->lock);
+		__svc_fdqueue_put(&pool->done, fd);
+		pthread_mutex_unlock(&pool->lock);
+
+		/* The pipe is non-blocking; if it's full, the I/O thread
+		 * has plenty of wakeups pending already */
+		if (write(pool->wakeup[1], "", 1) < 0 && errno != EAGAIN)
+			log_error("svc pool: cannot wake up I/O thread: %m");
+	}
+
+	return NULL;
+}
+
+struct svc_pool *
+svc_pool_new(unsigned int nthreads, const cpu_set_t *cpus)
+{
+	struct svc_pool *pool;
+	unsigned int i, max_fds;
+
+	pool = calloc(1, sizeof(*pool));
+	pool->nthreads = nthreads;
+	pool->cpus = cpus;
+
+	max_fds = __svc_max_fds();
+	__svc_fdqueue_init(&pool->work, max_fds);
+	__svc_fdqueue_init(&pool->done, max_fds);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_avail, NULL);
+
+	if (pipe2(pool->wakeup, O_NONBLOCK | O_CLOEXEC) < 0) {
+		log_error("svc pool: cannot create pipe: %m");
+		return NULL;
+	}
+
+	pool->threads = calloc(nthreads, sizeof(pthread_t));
+	for (i = 0; i < nthreads; ++i) {
+		struct svc_pool_worker *w;
+		int err;
+
+		w = calloc(1, sizeof(*w));
+		w->pool = pool;
+		w->index = i;
+
+		err = pthread_create(&pool->threads[i], NULL, __svc_pool_worker, w);
+		if (err != 0) {
+			log_error("svc pool: cannot create thread: %s", strerror(err));
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+/*
+ * Hand a readable transport to a worker. The caller must not touch
+ * the fd until it has been returned by svc_pool_reap().
+ */
+void
+svc_pool_submit(struct svc_pool *pool, int fd)
+{
+	pthread_mutex_lock(&pool->lock);
+	__svc_fdqueue_put(&pool->work, fd);
+	pthread_cond_signal(&pool->work_avail);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * This fd becomes readable whenever a worker is done with a transport.
+ */
+int
+svc_pool_wakeup_fd(const struct svc_pool *pool)
+{
+	return pool->wakeup[0];
+}
+
+/*
+ * Collect the transports workers are done with.
+ */
+unsigned int
+svc_pool_reap(struct svc_pool *pool, int *fds, unsigned int max)
+{
+	unsigned int n = 0;
+	char dummy[64];
+
+	while (read(pool->wakeup[0], dummy, sizeof(dummy)) > 0)
+		;
+
+	pthread_mutex_lock(&pool->lock);
+	while (n < max && pool->done.count)
+		fds[n++] = __svc_fdqueue_get(&pool->done);
+	pthread_mutex_unlock(&pool->lock);
+
+	/* If we could not take everything, make sure we get called again */
+	if (n == max && write(pool->wakeup[1], "", 1) < 0 && errno != EAGAIN)
+		log_error("svc pool: cannot wake up I/O thread: %m");
+	return n;
+}
+
+/*
+ * Returns true if fd is a listening socket. We need to handle these
+ * in the I/O thread, because accepting creates a new transport.
+ */
+int
+svc_fd_is_listener(int fd)
+{
+	int val = 0;
+	socklen_t len = sizeof(val);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &val, &len) < 0)
+		return 0;
+	return val != 0;
+}
+
+void
+rpctest_svc_run_pool(unsigned int nthreads, const cpu_set_t *cpus)
+{
+	struct svc_pool *pool;
+	struct pollfd *pfd = NULL;
+	unsigned int max_fds, pfd_size = 0;
+	unsigned char *state, *listener;
+	int i;
+
+	if ((pool = svc_pool_new(nthreads, cpus)) == NULL)
+		log_fatal("unable to create thread pool");
+
+	max_fds = __svc_max_fds();
+	state = calloc(max_fds, 1);
+	listener = calloc(max_fds, 1);
+
+	/* All listening sockets exist before we enter the loop, and they
+	 * are never closed. So fds created later are never listeners. */
+	for (i = 0; i < svc_max_pollfd; ++i) {
+		int fd = svc_pollfd[i].fd;
+
+		if (fd >= 0 && fd < max_fds)
+			listener[fd] = svc_fd_is_listener(fd);
+	}
+
+	while (1) {
+		unsigned int n = 0, j;
+		int done[256];
+
+		if (pfd_size < svc_max_pollfd + 1) {
+			pfd_size = svc_max_pollfd + 64;
+			pfd = realloc(pfd, pfd_size * sizeof(*pfd));
+		}
+
+		pfd[n].fd = svc_pool_wakeup_fd(pool);
+		pfd[n].events = POLLIN;
+		pfd[n++].revents = 0;
+
+		for (i = 0; i < svc_max_pollfd; ++i) {
+			int fd = svc_pollfd[i].fd;
+
+			if (fd < 0 || fd >= max_fds || state[fd] != FD_IDLE)
+				continue;
+			pfd[n].fd = fd;
+			pfd[n].events = svc_pollfd[i].events;
+			pfd[n++].revents = 0;
+		}
+
+		if (poll(pfd, n, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			log_fatal("svc pool: poll: %m");
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			unsigned int count;
+
+			count = svc_pool_reap(pool, done, 256);
+			for (j = 0; j < count; ++j)
+				state[done[j]] = FD_IDLE;
+		}
+
+		for (j = 1; j < n; ++j) {
+			int fd = pfd[j].fd;
+
+			if (pfd[j].revents == 0)
+				continue;
+
+			if (listener[fd]) {
+				svc_getreq_common(fd);
+			} else {
+				state[fd] = FD_BUSY;
+				svc_pool_submit(pool, fd);
+			}
+		}
+	}
+}
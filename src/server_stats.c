@@ -0,0 +1,251 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Server side statistics for rpc.squared.
+ *
+ * For every procedure and transport, we count calls, errors, bytes
+ * of arguments and results, and keep a histogram of service times.
+ * The counters live in shared memory, with one slot per worker process
+ * (see rpc.squared -P), and are updated with atomic operations because
+ * several threads may be serving calls at the same time (-j).
+ * STATSPROC adds up the counters of all slots. The counters of the
+ * duplicate request cache (see server_drc.c) are kept here as well.
+ */
+#include <sys/mman.h>
+#include "rpctest.h"
+
+enum {
+	SVC_NETID_TCP,
+	SVC_NETID_UDP,
+	SVC_NETID_TCP6,
+	SVC_NETID_UDP6,
+	SVC_NETID_LOCAL,
+	SVC_NETID_OTHER,
+
+	SVC_NETID_MAX
+};
+
+static const char *	svc_stats_netid_names[SVC_NETID_MAX] = {
+	[SVC_NETID_TCP]		= "tcp",
+	[SVC_NETID_UDP]		= "udp",
+	[SVC_NETID_TCP6]	= "tcp6",
+	[SVC_NETID_UDP6]	= "udp6",
+	[SVC_NETID_LOCAL]	= "local",
+	[SVC_NETID_OTHER]	= "other",
+};
+
+struct svc_stats_entry {
+	unsigned long		calls;
+	unsigned long		errors;
+	unsigned long		bytes_in;
+	unsigned long		bytes_out;
+	unsigned long		allocs;
+	unsigned long		time_nsec;
+	unsigned long		max_nsec;
+	unsigned int		buckets[LATENCY_NBUCKETS];
+};
+
+struct svc_stats_slot {
+	struct svc_stats_entry	entry[SVC_STATS_MAXPROC][SVC_NETID_MAX];
+	unsigned long		drc[__SVC_DRC_MAX];
+};
+
+static struct svc_stats_slot *	svc_stats_slots;
+static unsigned int		svc_stats_nslots;
+static struct svc_stats_slot *	svc_stats_mine;
+
+/*
+ * Call this before forking workers, so that they all share
+ * the same memory.
+ */
+int
+svc_stats_init(unsigned int nslots)
+{
+	size_t size = nslots * sizeof(struct svc_stats_slot);
+
+	svc_stats_slots = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (svc_stats_slots == MAP_FAILED) {
+		log_error("unable to allocate shared memory for statistics: %m");
+		svc_stats_slots = NULL;
+		return -1;
+	}
+	memset(svc_stats_slots, 0, size);
+	svc_stats_nslots = nslots;
+	svc_stats_mine = svc_stats_slots;
+	return 0;
+}
+
+void
+svc_stats_set_slot(unsigned int slot)
+{
+	if (svc_stats_slots && slot < svc_stats_nslots)
+		svc_stats_mine = &svc_stats_slots[slot];
+}
+
+static unsigned int
+__svc_stats_netid(const SVCXPRT *xprt)
+{
+	const char *netid = xprt->xp_netid;
+	unsigned int i;
+
+	if (netid == NULL)
+		return SVC_NETID_OTHER;
+	for (i = 0; i < SVC_NETID_OTHER; ++i) {
+		if (!strcmp(netid, svc_stats_netid_names[i]))
+			return i;
+	}
+	return SVC_NETID_OTHER;
+}
+
+/*
+ * Record one call. t0 is the time the call was dispatched,
+ * as returned by rpctest_time(), and allocs the number of memory
+ * allocations it took.
+ */
+void
+svc_stats_record(unsigned int proc, const SVCXPRT *xprt, int error,
+			unsigned long bytes_in, unsigned long bytes_out,
+			unsigned long allocs, double t0)
+{
+	struct svc_stats_entry *e;
+	unsigned long nsec, max;
+	double usec;
+
+	if (svc_stats_mine == NULL)
+		return;
+	if (proc >= SVC_STATS_MAXPROC)
+		proc = SVC_STATS_MAXPROC - 1;
+
+	usec = 1e6 * (rpctest_time() - t0);
+	nsec = usec * 1000;
+
+	e = &svc_stats_mine->entry[proc][__svc_stats_netid(xprt)];
+	__atomic_fetch_add(&e->calls, 1, __ATOMIC_RELAXED);
+	if (error)
+		__atomic_fetch_add(&e->errors, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&e->bytes_in, bytes_in, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&e->bytes_out, bytes_out, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&e->allocs, allocs, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&e->time_nsec, nsec, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&e->buckets[latency_bucket(usec)], 1, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&e->max_nsec, __ATOMIC_RELAXED);
+	while (nsec > max && !__atomic_compare_exchange_n(&e->max_nsec, &max, nsec,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void
+svc_stats_record_drc(unsigned int event)
+{
+	if (svc_stats_mine == NULL || event >= __SVC_DRC_MAX)
+		return;
+	__atomic_fetch_add(&svc_stats_mine->drc[event], 1, __ATOMIC_RELAXED);
+}
+
+void
+svc_stats_reset(void)
+{
+	if (svc_stats_slots)
+		memset(svc_stats_slots, 0, svc_stats_nslots * sizeof(struct svc_stats_slot));
+}
+
+/*
+ * Fill in a STATSPROC reply. procnames is indexed by procedure number;
+ * procedures without a name are not reported. Only entries that saw
+ * any calls are returned.
+ */
+void
+svc_stats_collect(square_stats *result, const char **procnames)
+{
+	static __thread square_procstats buffer[SVC_STATS_MAXPROC * SVC_NETID_MAX];
+	unsigned int proc, netid, slot, count = 0;
+
+	for (proc = 0; proc < SVC_STATS_MAXPROC; ++proc) {
+		if (procnames[proc] == NULL)
+			continue;
+
+		for (netid = 0; netid < SVC_NETID_MAX; ++netid) {
+			square_procstats *ps = &buffer[count];
+			unsigned long time_nsec = 0, max_nsec = 0;
+			struct latency lat;
+			unsigned int i;
+
+			memset(ps, 0, sizeof(*ps));
+			latency_init(&lat);
+
+			for (slot = 0; slot < svc_stats_nslots; ++slot) {
+				const struct svc_stats_entry *e = &svc_stats_slots[slot].entry[proc][netid];
+
+				if (e->calls == 0)
+					continue;
+				ps->calls += e->calls;
+				ps->errors += e->errors;
+				ps->bytes_in += e->bytes_in;
+				ps->bytes_out += e->bytes_out;
+				ps->allocs += e->allocs;
+				time_nsec += e->time_nsec;
+				if (e->max_nsec > max_nsec)
+					max_nsec = e->max_nsec;
+				for (i = 0; i < LATENCY_NBUCKETS; ++i)
+					lat.buckets[i] += e->buckets[i];
+			}
+
+			if (ps->calls == 0)
+				continue;
+
+			/* We do not track the minimum, but percentiles
+			 * only use it for clamping */
+			lat.count = ps->calls;
+			lat.sum = time_nsec / 1000.0;
+			lat.max = max_nsec / 1000.0;
+
+			ps->proc = (char *) procnames[proc];
+			ps->netid = (char *) svc_stats_netid_names[netid];
+			ps->mean_usec = latency_mean(&lat);
+			ps->p50_usec = latency_percentile(&lat, 50);
+			ps->p99_usec = latency_percentile(&lat, 99);
+			ps->max_usec = lat.max;
+			count++;
+		}
+	}
+
+	result->square_stats_len = count;
+	result->square_stats_val = buffer;
+}
+
+/*
+ * Fill in a DRCSTATSPROC reply
+ */
+void
+svc_stats_collect_drc(square_drcstats *result)
+{
+	unsigned int slot;
+
+	memset(result, 0, sizeof(*result));
+	for (slot = 0; slot < svc_stats_nslots; ++slot) {
+		const struct svc_stats_slot *s = &svc_stats_slots[slot];
+
+		result->hits += s->drc[SVC_DRC_HIT];
+		result->misses += s->drc[SVC_DRC_MISS];
+		result->evictions += s->drc[SVC_DRC_EVICT];
+	}
+}
@@ -0,0 +1,160 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Supervisor for multi-process servers.
+ *
+ * We fork N worker processes and restart any of them that die. When
+ * we're told to terminate (SIGTERM, SIGINT or SIGHUP), we kill all
+ * workers and return to the caller, which can then clean up its
+ * rpcbind registrations. SIGUSR1 makes us call the report function.
+ */
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include "rpctest.h"
+
+static volatile sig_atomic_t	__workers_terminate;
+static volatile sig_atomic_t	__workers_report;
+
+static void
+__workers_signal(int sig)
+{
+	if (sig == SIGUSR1)
+		__workers_report = 1;
+	else
+		__workers_terminate = 1;
+}
+
+static pid_t
+__workers_spawn(unsigned int index, int respawn, void (*worker)(unsigned int, int))
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		log_error("unable to fork worker %u: %m", index);
+		return -1;
+	}
+
+	if (pid == 0) {
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGHUP, SIG_DFL);
+		signal(SIGUSR1, SIG_DFL);
+
+		worker(index, respawn);
+		exit(1);
+	}
+
+	return pid;
+}
+
+int
+rpctest_run_workers(unsigned int nworkers, void (*worker)(unsigned int, int), void (*report)(void))
+{
+	struct sigaction sa;
+	pid_t *pids;
+	double *started;
+	unsigned int i, nrunning = 0;
+
+	/* No SA_RESTART, so that waitpid returns when we get a signal */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = __workers_signal;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	pids = calloc(nworkers, sizeof(pids[0]));
+	started = calloc(nworkers, sizeof(started[0]));
+
+	for (i = 0; i < nworkers; ++i) {
+		if ((pids[i] = __workers_spawn(i, 0, worker)) < 0)
+			goto terminate;
+		started[i] = rpctest_time();
+		nrunning++;
+	}
+
+	while (!__workers_terminate) {
+		int status;
+		pid_t pid;
+
+		if (__workers_report) {
+			__workers_report = 0;
+			if (report)
+				report();
+		}
+
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("waitpid: %m");
+			break;
+		}
+
+		for (i = 0; i < nworkers && pids[i] != pid; ++i)
+			;
+		if (i >= nworkers)
+			continue;
+
+		pids[i] = 0;
+		nrunning--;
+		if (__workers_terminate)
+			break;
+
+		if (WIFSIGNALED(status))
+			log_error("worker %u (pid %d) killed by signal %d", i, pid, WTERMSIG(status));
+		else
+			log_error("worker %u (pid %d) exited with status %d", i, pid, WEXITSTATUS(status));
+
+		/* Don't spin if a worker keeps dying right away */
+		if (rpctest_time() - started[i] < 1)
+			sleep(1);
+
+		if ((pids[i] = __workers_spawn(i, 1, worker)) < 0)
+			break;
+		started[i] = rpctest_time();
+		nrunning++;
+	}
+
+terminate:
+	for (i = 0; i < nworkers; ++i) {
+		if (pids[i] > 0)
+			kill(pids[i], SIGTERM);
+	}
+	while (nrunning) {
+		if (waitpid(-1, NULL, 0) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		nrunning--;
+	}
+
+	if (report)
+		report();
+
+	free(pids);
+	free(started);
+	return __workers_terminate? 0 : -1;
+}
@@ -31,6 +31,54 @@ struct foodata {
 	} buffer;
 };
 typedef struct foodata foodata;
+#define SQUARE_STATS_RESET 1
+
+struct square_procstats {
+	char *proc;
+	char *netid;
+	u_quad_t calls;
+	u_quad_t errors;
+	u_quad_t bytes_in;
+	u_quad_t bytes_out;
+	u_quad_t allocs;
+	double mean_usec;
+	double p50_usec;
+	double p99_usec;
+	double max_usec;
+};
+typedef struct square_procstats square_procstats;
+
+typedef struct {
+	u_int square_stats_len;
+	square_procstats *square_stats_val;
+} square_stats;
+
+struct square_drcstats {
+	u_int size;
+	u_quad_t hits;
+	u_quad_t misses;
+	u_quad_t evictions;
+};
+typedef struct square_drcstats square_drcstats;
+#define SQUARE_BULK_MAX 67108864
+
+typedef struct {
+	u_int square_bulk_len;
+	char *square_bulk_val;
+} square_bulk;
+
+typedef struct {
+	u_int square_vec_len;
+	long *square_vec_val;
+} square_vec;
+#define SQUARE_WORK_MAX_MEM_KB 1048576
+
+struct square_work {
+	u_int spin_usec;
+	u_int sleep_usec;
+	u_int mem_kb;
+};
+typedef struct square_work square_work;
 
 #define SQUARE_PROG 202020
 #define SQUARE_VERS 1
@@ -63,6 +111,24 @@ extern  void * sinkproc_1_svc(foodata *, struct svc_req *);
 #define SUMPROC 11
 extern  u_int * sumproc_1(foodata *, CLIENT *);
 extern  u_int * sumproc_1_svc(foodata *, struct svc_req *);
+#define STATSPROC 12
+extern  square_stats * statsproc_1(u_int *, CLIENT *);
+extern  square_stats * statsproc_1_svc(u_int *, struct svc_req *);
+#define ECHOPROC 13
+extern  square_bulk * echoproc_1(square_bulk *, CLIENT *);
+extern  square_bulk * echoproc_1_svc(square_bulk *, struct svc_req *);
+#define GENPROC 14
+extern  square_bulk * genproc_1(u_int *, CLIENT *);
+extern  square_bulk * genproc_1_svc(u_int *, struct svc_req *);
+#define SQUAREVPROC 15
+extern  square_vec * squarevproc_1(square_vec *, CLIENT *);
+extern  square_vec * squarevproc_1_svc(square_vec *, struct svc_req *);
+#define WORKPROC 16
+extern  void * workproc_1(square_work *, CLIENT *);
+extern  void * workproc_1_svc(square_work *, struct svc_req *);
+#define DRCSTATSPROC 17
+extern  square_drcstats * drcstatsproc_1(void *, CLIENT *);
+extern  square_drcstats * drcstatsproc_1_svc(void *, struct svc_req *);
 extern int square_prog_1_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
@@ -93,6 +159,24 @@ extern  void * sinkproc_1_svc();
 #define SUMPROC 11
 extern  u_int * sumproc_1();
 extern  u_int * sumproc_1_svc();
+#define STATSPROC 12
+extern  square_stats * statsproc_1();
+extern  square_stats * statsproc_1_svc();
+#define ECHOPROC 13
+extern  square_bulk * echoproc_1();
+extern  square_bulk * echoproc_1_svc();
+#define GENPROC 14
+extern  square_bulk * genproc_1();
+extern  square_bulk * genproc_1_svc();
+#define SQUAREVPROC 15
+extern  square_vec * squarevproc_1();
+extern  square_vec * squarevproc_1_svc();
+#define WORKPROC 16
+extern  void * workproc_1();
+extern  void * workproc_1_svc();
+#define DRCSTATSPROC 17
+extern  square_drcstats * drcstatsproc_1();
+extern  square_drcstats * drcstatsproc_1_svc();
 extern int square_prog_1_freeresult ();
 #endif /* K&R C */
 
@@ -102,11 +186,23 @@ extern int square_prog_1_freeresult ();
 extern  bool_t xdr_square_in (XDR *, square_in*);
 extern  bool_t xdr_square_out (XDR *, square_out*);
 extern  bool_t xdr_foodata (XDR *, foodata*);
+extern  bool_t xdr_square_procstats (XDR *, square_procstats*);
+extern  bool_t xdr_square_stats (XDR *, square_stats*);
+extern  bool_t xdr_square_drcstats (XDR *, square_drcstats*);
+extern  bool_t xdr_square_bulk (XDR *, square_bulk*);
+extern  bool_t xdr_square_vec (XDR *, square_vec*);
+extern  bool_t xdr_square_work (XDR *, square_work*);
 
 #else /* K&R C */
 extern bool_t xdr_square_in ();
 extern bool_t xdr_square_out ();
 extern bool_t xdr_foodata ();
+extern bool_t xdr_square_procstats ();
+extern bool_t xdr_square_stats ();
+extern bool_t xdr_square_drcstats ();
+extern bool_t xdr_square_bulk ();
+extern bool_t xdr_square_vec ();
+extern bool_t xdr_square_work ();
 
 #endif /* K&R C */
 
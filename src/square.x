@@ -10,6 +10,66 @@ struct foodata {
 	unsigned int buffer<>;
 };
 
+/*
+ * Server side statistics, per procedure and transport.
+ * Times are service times in usec, from the moment the request
+ * is dispatched until the reply has been sent. allocs counts
+ * calls to malloc, calloc and realloc while serving the calls.
+ */
+const SQUARE_STATS_RESET = 1;
+
+struct square_procstats {
+	string		proc<32>;
+	string		netid<16>;
+	unsigned hyper	calls;
+	unsigned hyper	errors;
+	unsigned hyper	bytes_in;
+	unsigned hyper	bytes_out;
+	unsigned hyper	allocs;
+	double		mean_usec;
+	double		p50_usec;
+	double		p99_usec;
+	double		max_usec;
+};
+
+typedef square_procstats square_stats<>;
+
+/*
+ * Statistics of the duplicate request cache (rpc.squared -D).
+ * size is the number of entries, or 0 if the cache is disabled.
+ */
+struct square_drcstats {
+	unsigned int	size;
+	unsigned hyper	hits;
+	unsigned hyper	misses;
+	unsigned hyper	evictions;
+};
+
+/*
+ * Bulk data for bandwidth tests. GENPROC refuses to return more
+ * than SQUARE_BULK_MAX bytes.
+ */
+const SQUARE_BULK_MAX = 67108864;
+
+typedef opaque square_bulk<>;
+
+/*
+ * Arguments and results of SQUAREVPROC
+ */
+typedef long square_vec<>;
+
+/*
+ * Synthetic work for WORKPROC: first allocate and touch mem_kb KB
+ * of memory, then spin on the CPU, then sleep.
+ */
+const SQUARE_WORK_MAX_MEM_KB = 1048576;
+
+struct square_work {
+	unsigned int	spin_usec;
+	unsigned int	sleep_usec;
+	unsigned int	mem_kb;
+};
+
 program SQUARE_PROG {
 	version SQUARE_VERS {
 		square_out SQUAREPROC(square_in) = 1;
@@ -22,5 +82,11 @@ program SQUARE_PROG {
 
 		void SINKPROC(foodata) = 10;
 		unsigned int SUMPROC(foodata) = 11;
+		square_stats STATSPROC(unsigned int) = 12;
+		square_bulk ECHOPROC(square_bulk) = 13;
+		square_bulk GENPROC(unsigned int) = 14;
+		square_vec SQUAREVPROC(square_vec) = 15;
+		void WORKPROC(square_work) = 16;
+		square_drcstats DRCSTATSPROC(void) = 17;
 	} = 1;
 } = 202020;
@@ -22,17 +22,297 @@
  * Server procedures for square service
  */
 
-#include "square.h"
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "rpctest.h"
+
+/*
+ * Summation helpers. These work on 16 byte vectors (GCC vector
+ * extensions, which map to SSE2 or NEON), with four independent
+ * accumulators so that the additions can overlap.
+ */
+typedef uint32_t	sum_vec_t __attribute__((vector_size(16)));
+typedef uint8_t		sum_bytes_t __attribute__((vector_size(16)));
+
+#define SUM_VEC_WORDS	(sizeof(sum_vec_t) / 4)
+#define SUM_BLOCK_WORDS	(4 * SUM_VEC_WORDS)
+
+static inline sum_vec_t
+__sum_load(const void *p, int swap)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	static const sum_bytes_t bswap = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+#endif
+	sum_bytes_t b;
+
+	__builtin_memcpy(&b, p, sizeof(b));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (swap)
+		b = __builtin_shuffle(b, bswap);
+#endif
+	return (sum_vec_t) b;
+}
+
+static inline unsigned int
+__sum_words(const unsigned char *p, unsigned int n, int swap)
+{
+	sum_vec_t acc0 = { 0 }, acc1 = { 0 }, acc2 = { 0 }, acc3 = { 0 };
+	unsigned int i = 0, k, sum = 0;
+
+	for (; i + SUM_BLOCK_WORDS <= n; i += SUM_BLOCK_WORDS, p += 4 * SUM_BLOCK_WORDS) {
+		acc0 += __sum_load(p, swap);
+		acc1 += __sum_load(p + 16, swap);
+		acc2 += __sum_load(p + 32, swap);
+		acc3 += __sum_load(p + 48, swap);
+	}
+	for (; i + SUM_VEC_WORDS <= n; i += SUM_VEC_WORDS, p += 16)
+		acc0 += __sum_load(p, swap);
+
+	acc0 += acc1 + acc2 + acc3;
+	for (k = 0; k < SUM_VEC_WORDS; ++k)
+		sum += acc0[k];
+
+	for (; i < n; ++i, p += 4) {
+		uint32_t word;
+
+		__builtin_memcpy(&word, p, 4);
+		sum += swap? ntohl(word) : word;
+	}
+	return sum;
+}
+
+/*
+ * Sum an array of ints in host byte order
+ */
+unsigned int
+square_sum_host(const unsigned int *array, unsigned int n)
+{
+	return __sum_words((const unsigned char *) array, n, 0);
+}
+
+/*
+ * Sum an array of ints in network byte order
+ */
+unsigned int
+square_sum_net(const void *array, unsigned int n)
+{
+	return __sum_words(array, n, 1);
+}
+
+/*
+ * Consume count ints of a foodata buffer from the XDR stream without
+ * allocating an array for them. If sum is not NULL, add them up.
+ *
+ * We use XDR_INLINE to look at the data directly in the receive buffer.
+ * This fails if the request does not fit into what is left of the
+ * buffer, or crosses a record fragment; in that case we try again with
+ * half the size, until we're down to a single int, which we decode the
+ * regular way (making the stream refill its buffer).
+ *
+ * The count comes straight from the wire, so we never ask for more
+ * than fits into the u_int length that XDR_INLINE takes. A count that
+ * is larger than the rest of the message fails once we run out of data.
+ */
+#define FOODATA_MAX_CHUNK	(UINT_MAX / 4)
+
+static bool_t
+__xdr_foodata_consume(XDR *xdrs, u_int count, u_int *sum)
+{
+	u_int remaining, chunk;
+
+	remaining = chunk = count;
+	while (remaining) {
+		const int32_t *p;
+		u_int word;
+
+		if (chunk > remaining)
+			chunk = remaining;
+		if (chunk > FOODATA_MAX_CHUNK)
+			chunk = FOODATA_MAX_CHUNK;
+		if (chunk > 1 && (p = XDR_INLINE(xdrs, chunk * 4)) != NULL) {
+			if (sum)
+				*sum += square_sum_net(p, chunk);
+			remaining -= chunk;
+			continue;
+		}
+		if (chunk > 1) {
+			chunk /= 2;
+			continue;
+		}
+
+		if (!xdr_u_int(xdrs, &word))
+			return FALSE;
+		if (sum)
+			*sum += word;
+		remaining--;
+		chunk = remaining;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Decode a foodata argument, summing up the buffer on the fly
+ */
+bool_t
+xdr_foodata_sum(XDR *xdrs, foodata_sum *objp)
+{
+	if (xdrs->x_op == XDR_FREE)
+		return TRUE;
+	if (xdrs->x_op != XDR_DECODE)
+		return FALSE;
+
+	if (!xdr_u_int(xdrs, &objp->count))
+		return FALSE;
+	objp->sum = 0;
+	return __xdr_foodata_consume(xdrs, objp->count, &objp->sum);
+}
+
+/*
+ * Decode a foodata argument, skipping over the buffer. All we
+ * return is the number of ints.
+ */
+bool_t
+xdr_foodata_skip(XDR *xdrs, u_int *count)
+{
+	if (xdrs->x_op == XDR_FREE)
+		return TRUE;
+	if (xdrs->x_op != XDR_DECODE)
+		return FALSE;
+
+	if (!xdr_u_int(xdrs, count))
+		return FALSE;
+	return __xdr_foodata_consume(xdrs, *count, NULL);
+}
+
+/*
+ * Decode into memory from the request arena (see arena.c). There is
+ * nothing to free, and encoding is left to the rpcgen generated routines.
+ */
+bool_t
+xdr_square_bulk_arena(XDR *xdrs, square_bulk *bulk)
+{
+	if (xdrs->x_op == XDR_FREE)
+		return TRUE;
+	if (xdrs->x_op != XDR_DECODE)
+		return xdr_square_bulk(xdrs, bulk);
+
+	if (!xdr_u_int(xdrs, &bulk->square_bulk_len)
+	 || bulk->square_bulk_len > SQUARE_BULK_MAX)
+		return FALSE;
+	bulk->square_bulk_val = rpctest_arena_alloc(bulk->square_bulk_len);
+	if (bulk->square_bulk_val == NULL)
+		return FALSE;
+	return xdr_opaque(xdrs, bulk->square_bulk_val, bulk->square_bulk_len);
+}
+
+bool_t
+xdr_square_vec_arena(XDR *xdrs, square_vec *vec)
+{
+	if (xdrs->x_op == XDR_FREE)
+		return TRUE;
+	if (xdrs->x_op != XDR_DECODE)
+		return xdr_square_vec(xdrs, vec);
+
+	if (!xdr_u_int(xdrs, &vec->square_vec_len)
+	 || vec->square_vec_len > UINT_MAX / sizeof(long))
+		return FALSE;
+	vec->square_vec_val = rpctest_arena_alloc(vec->square_vec_len * sizeof(long));
+	if (vec->square_vec_val == NULL)
+		return FALSE;
+	return xdr_vector(xdrs, (char *) vec->square_vec_val, vec->square_vec_len,
+			sizeof(long), (xdrproc_t) xdr_long);
+}
 
 square_out *
 squareproc_1_svc(square_in *inp, struct svc_req *rqstp)
 {
-	static square_out out;
+	/* rpc.squared -j calls us from several threads at once */
+	static __thread square_out out;
 
 	out.res1 = inp->arg1 * inp->arg1;
 	return (&out);
 }
 
+/*
+ * Square a vector of numbers. The result comes from the request
+ * arena if there is one (see arena.c). Otherwise, each thread keeps
+ * a result buffer of the largest size asked for so far.
+ */
+square_vec *
+squarevproc_1_svc(square_vec *inp, struct svc_req *rqstp)
+{
+	static __thread square_vec out;
+	static __thread long *buffer;
+	static __thread u_int size;
+	u_int i;
+
+	out.square_vec_val = rpctest_arena_alloc(inp->square_vec_len * sizeof(long));
+	if (out.square_vec_val != NULL)
+		goto compute;
+
+	if (inp->square_vec_len > size) {
+		long *p;
+
+		if ((p = realloc(buffer, inp->square_vec_len * sizeof(long))) == NULL) {
+			svcerr_systemerr(rqstp->rq_xprt);
+			return NULL;
+		}
+		buffer = p;
+		size = inp->square_vec_len;
+	}
+	out.square_vec_val = buffer;
+
+compute:
+	for (i = 0; i < inp->square_vec_len; ++i)
+		out.square_vec_val[i] = inp->square_vec_val[i] * inp->square_vec_val[i];
+	out.square_vec_len = inp->square_vec_len;
+	return &out;
+}
+
+void *
+workproc_1_svc(square_work *inp, struct svc_req *rqstp)
+{
+	static __thread unsigned int x;
+
+	if (inp->mem_kb > SQUARE_WORK_MAX_MEM_KB) {
+		svcerr_systemerr(rqstp->rq_xprt);
+		return NULL;
+	}
+
+	if (inp->mem_kb) {
+		size_t i, size = (size_t) inp->mem_kb << 10;
+		volatile char *mem;
+
+		if ((mem = malloc(size)) == NULL) {
+			svcerr_systemerr(rqstp->rq_xprt);
+			return NULL;
+		}
+		for (i = 0; i < size; i += 4096)
+			mem[i] = i;
+		free((void *) mem);
+	}
+
+	if (inp->spin_usec) {
+		double end = rpctest_time() + inp->spin_usec * 1e-6;
+
+		while (rpctest_time() < end)
+			;
+	}
+
+	if (inp->sleep_usec) {
+		struct timespec ts;
+
+		ts.tv_sec = inp->sleep_usec / 1000000;
+		ts.tv_nsec = (inp->sleep_usec % 1000000) * 1000;
+		while (nanosleep(&ts, &ts) < 0)
+			;
+	}
+
+	return &x;
+}
+
 void *
 errnoprog_1_svc(void *inp, struct svc_req *rqstp)
 {
@@ -78,7 +358,18 @@ errweakauth_1_svc(void *inp, struct svc_req *rqstp)
 void *
 sinkproc_1_svc(foodata *inp, struct svc_req *rqstp)
 {
-	static unsigned int x;
+	static __thread unsigned int x;
+
+	return &x;
+}
+
+/*
+ * SINKPROC with the argument skipped by xdr_foodata_skip
+ */
+void *
+sinkproc_fast_1_svc(u_int *count, struct svc_req *rqstp)
+{
+	static __thread unsigned int x;
 
 	return &x;
 }
@@ -86,12 +377,85 @@ sinkproc_1_svc(foodata *inp, struct svc_req *rqstp)
 unsigned int *
 sumproc_1_svc(foodata *inp, struct svc_req *rqstp)
 {
-	static unsigned int sum;
-	unsigned int i;
+	static __thread unsigned int sum;
 
-	for (i = 0, sum = 0; i < inp->buffer.buffer_len; ++i) {
-		sum += inp->buffer.buffer_val[i];
-	}
+	sum = square_sum_host(inp->buffer.buffer_val, inp->buffer.buffer_len);
+	return &sum;
+}
+
+/*
+ * SUMPROC with the argument decoded by xdr_foodata_sum
+ */
+unsigned int *
+sumproc_fast_1_svc(foodata_sum *inp, struct svc_req *rqstp)
+{
+	static __thread unsigned int sum;
 
+	sum = inp->sum;
 	return &sum;
 }
+
+square_stats *
+statsproc_1_svc(u_int *flags, struct svc_req *rqstp)
+{
+	/* Only rpc.squared keeps statistics, see server_stats.c */
+	static __thread square_stats stats;
+
+	return &stats;
+}
+
+square_drcstats *
+drcstatsproc_1_svc(void *argp, struct svc_req *rqstp)
+{
+	static __thread square_drcstats stats;
+
+	return &stats;
+}
+
+/*
+ * Return the payload to the caller. The reply points into the
+ * argument buffer, which is freed only after the reply has been sent.
+ */
+square_bulk *
+echoproc_1_svc(square_bulk *inp, struct svc_req *rqstp)
+{
+	static __thread square_bulk result;
+
+	result = *inp;
+	return &result;
+}
+
+/*
+ * Return the requested number of bytes. Each thread keeps a buffer
+ * of the largest size asked for so far.
+ */
+square_bulk *
+genproc_1_svc(u_int *count, struct svc_req *rqstp)
+{
+	static __thread square_bulk result;
+	static __thread char *buffer;
+	static __thread u_int size;
+
+	if (*count > SQUARE_BULK_MAX) {
+		svcerr_systemerr(rqstp->rq_xprt);
+		return NULL;
+	}
+
+	if (*count > size) {
+		char *p;
+		u_int i;
+
+		if ((p = realloc(buffer, *count)) == NULL) {
+			svcerr_systemerr(rqstp->rq_xprt);
+			return NULL;
+		}
+		for (i = size; i < *count; ++i)
+			p[i] = i;
+		buffer = p;
+		size = *count;
+	}
+
+	result.square_bulk_val = buffer;
+	result.square_bulk_len = *count;
+	return &result;
+}
@@ -0,0 +1,149 @@
+/*
+ * Please do not edit this file.
+ * It was generated using rpcgen.
+ */
+
+#include "src/square.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <rpc/pmap_clnt.h>
+#include <string.h>
+#include <memory.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#ifndef SIG_PF
+#define SIG_PF void(*)(int)
+#endif
+
+void
+square_prog_1(struct svc_req *rqstp, register SVCXPRT *transp)
+{
+	union {
+		square_in squareproc_1_arg;
+		foodata sinkproc_1_arg;
+		foodata sumproc_1_arg;
+		u_int statsproc_1_arg;
+		square_bulk echoproc_1_arg;
+		u_int genproc_1_arg;
+		square_vec squarevproc_1_arg;
+		square_work workproc_1_arg;
+	} argument;
+	char *result;
+	xdrproc_t _xdr_argument, _xdr_result;
+	char *(*local)(char *, struct svc_req *);
+
+	switch (rqstp->rq_proc) {
+	case NULLPROC:
+		(void) svc_sendreply (transp, (xdrproc_t) xdr_void, (char *)NULL);
+		return;
+
+	case SQUAREPROC:
+		_xdr_argument = (xdrproc_t) xdr_square_in;
+		_xdr_result = (xdrproc_t) xdr_square_out;
+		local = (char *(*)(char *, struct svc_req *)) squareproc_1_svc;
+		break;
+
+	case ERRNOPROG:
+		_xdr_argument = (xdrproc_t) xdr_void;
+		_xdr_result = (xdrproc_t) xdr_void;
+		local = (char *(*)(char *, struct svc_req *)) errnoprog_1_svc;
+		break;
+
+	case ERRPROGVERS:
+		_xdr_argument = (xdrproc_t) xdr_void;
+		_xdr_result = (xdrproc_t) xdr_void;
+		local = (char *(*)(char *, struct svc_req *)) errprogvers_1_svc;
+		break;
+
+	case ERRNOPROC:
+		_xdr_argument = (xdrproc_t) xdr_void;
+		_xdr_result = (xdrproc_t) xdr_void;
+		local = (char *(*)(char *, struct svc_req *)) errnoproc_1_svc;
+		break;
+
+	case ERRDECODE:
+		_xdr_argument = (xdrproc_t) xdr_void;
+		_xdr_result = (xdrproc_t) xdr_void;
+		local = (char *(*)(char *, struct svc_req *)) errdecode_1_svc;
+		break;
+
+	case ERRSYSTEMERR:
+		_xdr_argument = (xdrproc_t) xdr_void;
+		_xdr_result = (xdrproc_t) xdr_void;
+		local = (char *(*)(char *, struct svc_req *)) errsystemerr_1_svc;
+		break;
+
+	case ERRWEAKAUTH:
+		_xdr_argument = (xdrproc_t) xdr_void;
+		_xdr_result = (xdrproc_t) xdr_void;
+		local = (char *(*)(char *, struct svc_req *)) errweakauth_1_svc;
+		break;
+
+	case SINKPROC:
+		_xdr_argument = (xdrproc_t) xdr_foodata;
+		_xdr_result = (xdrproc_t) xdr_void;
+		local = (char *(*)(char *, struct svc_req *)) sinkproc_1_svc;
+		break;
+
+	case SUMPROC:
+		_xdr_argument = (xdrproc_t) xdr_foodata;
+		_xdr_result = (xdrproc_t) xdr_u_int;
+		local = (char *(*)(char *, struct svc_req *)) sumproc_1_svc;
+		break;
+
+	case STATSPROC:
+		_xdr_argument = (xdrproc_t) xdr_u_int;
+		_xdr_result = (xdrproc_t) xdr_square_stats;
+		local = (char *(*)(char *, struct svc_req *)) statsproc_1_svc;
+		break;
+
+	case ECHOPROC:
+		_xdr_argument = (xdrproc_t) xdr_square_bulk;
+		_xdr_result = (xdrproc_t) xdr_square_bulk;
+		local = (char *(*)(char *, struct svc_req *)) echoproc_1_svc;
+		break;
+
+	case GENPROC:
+		_xdr_argument = (xdrproc_t) xdr_u_int;
+		_xdr_result = (xdrproc_t) xdr_square_bulk;
+		local = (char *(*)(char *, struct svc_req *)) genproc_1_svc;
+		break;
+
+	case SQUAREVPROC:
+		_xdr_argument = (xdrproc_t) xdr_square_vec;
+		_xdr_result = (xdrproc_t) xdr_square_vec;
+		local = (char *(*)(char *, struct svc_req *)) squarevproc_1_svc;
+		break;
+
+	case WORKPROC:
+		_xdr_argument = (xdrproc_t) xdr_square_work;
+		_xdr_result = (xdrproc_t) xdr_void;
+		local = (char *(*)(char *, struct svc_req *)) workproc_1_svc;
+		break;
+
+	case DRCSTATSPROC:
+		_xdr_argument = (xdrproc_t) xdr_void;
+		_xdr_result = (xdrproc_t) xdr_square_drcstats;
+		local = (char *(*)(char *, struct svc_req *)) drcstatsproc_1_svc;
+		break;
+
+	default:
+		svcerr_noproc (transp);
+		return;
+	}
+	memset ((char *)&argument, 0, sizeof (argument));
+	if (!svc_getargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
+		svcerr_decode (transp);
+		return;
+	}
+	result = (*local)((char *)&argument, rqstp);
+	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) _xdr_result, result)) {
+		svcerr_systemerr (transp);
+	}
+	if (!svc_freeargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
+		fprintf (stderr, "%s", "unable to free arguments");
+		exit (1);
+	}
+	return;
+}
@@ -0,0 +1,129 @@
+/*
+ * Please do not edit this file.
+ * It was generated using rpcgen.
+ */
+
+#include "src/square.h"
+
+bool_t
+xdr_square_in (XDR *xdrs, square_in *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_long (xdrs, &objp->arg1))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_square_out (XDR *xdrs, square_out *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_long (xdrs, &objp->res1))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_foodata (XDR *xdrs, foodata *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->buffer.buffer_val, (u_int *) &objp->buffer.buffer_len, ~0,
+		sizeof (u_int), (xdrproc_t) xdr_u_int))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_square_procstats (XDR *xdrs, square_procstats *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_string (xdrs, &objp->proc, 32))
+		 return FALSE;
+	 if (!xdr_string (xdrs, &objp->netid, 16))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->calls))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->errors))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->bytes_in))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->bytes_out))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->allocs))
+		 return FALSE;
+	 if (!xdr_double (xdrs, &objp->mean_usec))
+		 return FALSE;
+	 if (!xdr_double (xdrs, &objp->p50_usec))
+		 return FALSE;
+	 if (!xdr_double (xdrs, &objp->p99_usec))
+		 return FALSE;
+	 if (!xdr_double (xdrs, &objp->max_usec))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_square_stats (XDR *xdrs, square_stats *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->square_stats_val, (u_int *) &objp->square_stats_len, ~0,
+		sizeof (square_procstats), (xdrproc_t) xdr_square_procstats))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_square_drcstats (XDR *xdrs, square_drcstats *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_u_int (xdrs, &objp->size))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->hits))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->misses))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->evictions))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_square_bulk (XDR *xdrs, square_bulk *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_bytes (xdrs, (char **)&objp->square_bulk_val, (u_int *) &objp->square_bulk_len, ~0))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_square_vec (XDR *xdrs, square_vec *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->square_vec_val, (u_int *) &objp->square_vec_len, ~0,
+		sizeof (long), (xdrproc_t) xdr_long))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_square_work (XDR *xdrs, square_work *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_u_int (xdrs, &objp->spin_usec))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->sleep_usec))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->mem_kb))
+		 return FALSE;
+	return TRUE;
+}
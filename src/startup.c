@@ -0,0 +1,401 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Server startup time.
+ *
+ * We start rpc.squared over and over, and measure the time from starting
+ * it until a client that looks the service up through rpcbind gets its
+ * first successful call through. This is done in two modes:
+ *
+ *  nettype: rpc.squared -T tcp -T udp, which creates, binds and registers
+ *	a transport for every matching netconfig entry, with a round trip
+ *	to rpcbind for each.
+ *  fds: we bind a TCP and a UDP socket beforehand, like systemd socket
+ *	activation would, and pass them in LISTEN_FDS. rpc.squared
+ *	registers both with rpcbind in one batch.
+ *
+ * Any previous registration is removed before every start, so that the
+ * client does not find a stale address.
+ *
+ * Try this:
+ *  ./square startup runs=20 mode=nettype,fds
+ */
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include "rpctest.h"
+
+#define STARTUP_MAX_ARGS	32
+
+enum {
+	STARTUP_NETTYPE,
+	STARTUP_FDS,
+
+	__STARTUP_MAX
+};
+
+static const char *	startup_mode_names[__STARTUP_MAX] = {
+	[STARTUP_NETTYPE]	= "nettype",
+	[STARTUP_FDS]		= "fds",
+};
+
+struct startup_opts {
+	const char *		server;
+	char *			server_args[STARTUP_MAX_ARGS];
+	unsigned int		num_server_args;
+	unsigned int		runs;
+	int			modes[__STARTUP_MAX];
+	const char *		netid;
+	double			timeout;
+	double			poll_usec;
+	const char *		results_file;
+};
+
+static int
+startup_parse_modes(struct startup_opts *opt, char *value)
+{
+	char *name;
+
+	memset(opt->modes, 0, sizeof(opt->modes));
+	for (name = strtok(value, ","); name; name = strtok(NULL, ",")) {
+		unsigned int m;
+
+		for (m = 0; m < __STARTUP_MAX; ++m) {
+			if (!strcmp(name, startup_mode_names[m]))
+				break;
+		}
+		if (m >= __STARTUP_MAX) {
+			log_error("unknown mode \"%s\"", name);
+			return -1;
+		}
+		opt->modes[m] = 1;
+	}
+	return 0;
+}
+
+static int
+startup_opts_set(struct startup_opts *opt, int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		char *name = argv[i];
+		char *value, *s;
+
+		if ((value = strchr(name, '=')) != NULL)
+			*value++ = '\0';
+
+		if (value == NULL) {
+			log_error("missing value to %s argument", name);
+			return -1;
+		}
+
+		if (!strcmp(name, "server")) {
+			opt->server = value;
+		} else
+		if (!strcmp(name, "args")) {
+			for (s = strtok(value, " \t"); s; s = strtok(NULL, " \t")) {
+				if (opt->num_server_args >= STARTUP_MAX_ARGS - 1) {
+					log_error("too many server arguments");
+					return -1;
+				}
+				opt->server_args[opt->num_server_args++] = s;
+			}
+		} else
+		if (!strcmp(name, "mode")) {
+			if (startup_parse_modes(opt, value) < 0)
+				return -1;
+		} else
+		if (!strcmp(name, "netid")) {
+			opt->netid = value;
+		} else
+		if (!strcmp(name, "runs")) {
+			opt->runs = strtoul(value, &s, 0);
+			if (*s || opt->runs == 0) {
+				log_error("cannot parse numeric value to %s=%s", name, value);
+				return -1;
+			}
+		} else
+		if (!strcmp(name, "timeout")) {
+			opt->timeout = strtod(value, &s);
+			if (*s || opt->timeout <= 0) {
+				log_error("cannot parse numeric value to %s=%s", name, value);
+				return -1;
+			}
+		} else
+		if (!strcmp(name, "poll")) {
+			if (rpctest_parse_usec(value, &opt->poll_usec) < 0) {
+				log_error("cannot parse time value to %s=%s", name, value);
+				return -1;
+			}
+		} else
+		if (!strcmp(name, "results")) {
+			opt->results_file = value;
+		} else {
+			log_error("unknown argument \"%s\"", name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Bind a TCP and a UDP socket to the same port, like a service manager
+ * would for socket activation
+ */
+static int
+startup_bind_sockets(int *fds)
+{
+	unsigned int attempt;
+
+	for (attempt = 0; attempt < 16; ++attempt) {
+		struct sockaddr_in sin;
+		socklen_t len = sizeof(sin);
+
+		fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+		fds[1] = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fds[0] < 0 || fds[1] < 0) {
+			log_error("unable to create socket: %m");
+			return -1;
+		}
+
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		if (bind(fds[0], (struct sockaddr *) &sin, sizeof(sin)) == 0
+		 && getsockname(fds[0], (struct sockaddr *) &sin, &len) == 0
+		 && bind(fds[1], (struct sockaddr *) &sin, sizeof(sin)) == 0
+		 && listen(fds[0], SOMAXCONN) == 0)
+			return 0;
+
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	log_error("unable to find a port for TCP and UDP");
+	return -1;
+}
+
+static pid_t
+startup_spawn(const struct startup_opts *opt, int mode, const int *fds)
+{
+	char *argv[STARTUP_MAX_ARGS + 8];
+	unsigned int argc = 0, i;
+	pid_t pid;
+
+	argv[argc++] = (char *) opt->server;
+	argv[argc++] = "-f";
+	if (mode == STARTUP_NETTYPE) {
+		argv[argc++] = "-T";
+		argv[argc++] = "tcp";
+		argv[argc++] = "-T";
+		argv[argc++] = "udp";
+	}
+	for (i = 0; i < opt->num_server_args; ++i)
+		argv[argc++] = opt->server_args[i];
+	argv[argc] = NULL;
+
+	if ((pid = fork()) < 0) {
+		log_error("unable to fork: %m");
+		return -1;
+	}
+
+	if (pid == 0) {
+		if (mode == STARTUP_FDS) {
+			char pidbuf[32];
+
+			if (dup2(fds[0], 3) < 0 || dup2(fds[1], 4) < 0)
+				_exit(127);
+			snprintf(pidbuf, sizeof(pidbuf), "%d", (int) getpid());
+			setenv("LISTEN_FDS", "2", 1);
+			setenv("LISTEN_PID", pidbuf, 1);
+		}
+		execv(opt->server, argv);
+		_exit(127);
+	}
+
+	return pid;
+}
+
+/*
+ * Try to call the server until we succeed. Returns the time of
+ * the first successful call, or a negative value.
+ */
+static double
+startup_wait_first_call(const struct startup_opts *opt, const char *hostname, pid_t pid, double t0)
+{
+	struct timeval timeout = { 1, 0 };
+
+	while (rpctest_time() - t0 < opt->timeout) {
+		CLIENT *clnt;
+		int status;
+
+		clnt = clnt_create(hostname, SQUARE_PROG, SQUARE_VERS, opt->netid);
+		if (clnt != NULL) {
+			enum clnt_stat stat;
+
+			stat = clnt_call(clnt, NULLPROC,
+					(xdrproc_t) xdr_void, NULL,
+					(xdrproc_t) xdr_void, NULL,
+					timeout);
+			clnt_destroy(clnt);
+			if (stat == RPC_SUCCESS)
+				return rpctest_time();
+		}
+
+		if (waitpid(pid, &status, WNOHANG) == pid) {
+			log_error("server exited before it served a call");
+			return -1;
+		}
+
+		usleep(opt->poll_usec);
+	}
+
+	log_error("server did not answer within %.1f seconds", opt->timeout);
+	return -1;
+}
+
+static int
+startup_run(const struct startup_opts *opt, const char *hostname, int mode, double *elapsed)
+{
+	int fds[2] = { -1, -1 };
+	double t0, t1;
+	pid_t pid;
+
+	(void) rpcb_unset(SQUARE_PROG, SQUARE_VERS, NULL);
+
+	/* The sockets exist before the service is started */
+	if (mode == STARTUP_FDS && startup_bind_sockets(fds) < 0)
+		return -1;
+
+	t0 = rpctest_time();
+	pid = startup_spawn(opt, mode, fds);
+	if (mode == STARTUP_FDS) {
+		close(fds[0]);
+		close(fds[1]);
+	}
+	if (pid < 0)
+		return -1;
+
+	t1 = startup_wait_first_call(opt, hostname, pid, t0);
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	if (t1 < 0)
+		return -1;
+
+	*elapsed = t1 - t0;
+	return 0;
+}
+
+static int
+startup_compare(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+int
+do_startup(const char *hostname, const char *netid, int argc, char **argv)
+{
+	struct startup_opts opt;
+	double *times[__STARTUP_MAX], median[__STARTUP_MAX];
+	rpctest_results_t *res;
+	unsigned int run, m;
+	int exitval = 0;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.server = "./rpc.squared";
+	opt.runs = 10;
+	opt.modes[STARTUP_NETTYPE] = 1;
+	opt.modes[STARTUP_FDS] = 1;
+	opt.netid = netid? : "tcp";
+	opt.timeout = 10;
+	opt.poll_usec = 1000;
+	if (startup_opts_set(&opt, argc, argv) < 0)
+		return 1;
+
+	for (m = 0; m < __STARTUP_MAX; ++m) {
+		times[m] = calloc(opt.runs, sizeof(double));
+		median[m] = 0;
+	}
+
+	/* Alternate between the modes, so that both see the same
+	 * conditions on average */
+	for (run = 0; run < opt.runs; ++run) {
+		for (m = 0; m < __STARTUP_MAX; ++m) {
+			if (!opt.modes[m])
+				continue;
+			if (startup_run(&opt, hostname, m, &times[m][run]) < 0) {
+				log_error("%s: run %u failed", startup_mode_names[m], run);
+				return 1;
+			}
+		}
+	}
+
+	(void) rpcb_unset(SQUARE_PROG, SQUARE_VERS, NULL);
+
+	res = rpctest_results_new();
+	rpctest_results_set(res, "host", "%s", hostname);
+	rpctest_results_set(res, "netid", "%s", opt.netid);
+	rpctest_results_set(res, "runs", "%u", opt.runs);
+
+	printf("Time to first successful call over %s, %u runs:\n", opt.netid, opt.runs);
+	printf("%-10s %10s %10s %10s\n", "mode", "min ms", "median ms", "max ms");
+	for (m = 0; m < __STARTUP_MAX; ++m) {
+		const char *name = startup_mode_names[m];
+		double *t = times[m];
+		char key[64];
+
+		if (!opt.modes[m])
+			continue;
+
+		qsort(t, opt.runs, sizeof(double), startup_compare);
+		median[m] = t[opt.runs / 2];
+		printf("%-10s %10.2f %10.2f %10.2f\n", name,
+				1e3 * t[0], 1e3 * median[m], 1e3 * t[opt.runs - 1]);
+
+		snprintf(key, sizeof(key), "%s.first-call-msec-min", name);
+		rpctest_results_set(res, key, "%.3f", 1e3 * t[0]);
+		snprintf(key, sizeof(key), "%s.first-call-msec-median", name);
+		rpctest_results_set(res, key, "%.3f", 1e3 * median[m]);
+		snprintf(key, sizeof(key), "%s.first-call-msec-max", name);
+		rpctest_results_set(res, key, "%.3f", 1e3 * t[opt.runs - 1]);
+	}
+
+	if (opt.modes[STARTUP_NETTYPE] && opt.modes[STARTUP_FDS] && median[STARTUP_FDS] > 0)
+		printf("Inherited sockets start up %.1fx as fast\n",
+				median[STARTUP_NETTYPE] / median[STARTUP_FDS]);
+
+	if (opt.results_file && rpctest_results_write(res, opt.results_file) < 0)
+		exitval = 1;
+	rpctest_results_free(res);
+
+	for (m = 0; m < __STARTUP_MAX; ++m)
+		free(times[m]);
+	return exitval;
+}
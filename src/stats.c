@@ -0,0 +1,163 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Retrieve server side statistics from rpc.squared.
+ *
+ *  ./square stats
+ *  ./square stats reset
+ *
+ * The latter clears the server's counters after retrieving them.
+ * The allocs column is the mean number of memory allocations per call.
+ * If the server has a duplicate request cache (rpc.squared -D), its
+ * counters are printed as well.
+ */
+
+#include "rpctest.h"
+
+static struct timeval	stats_call_timeout = { 25, 0 };
+
+/*
+ * Call STATSPROC. The caller must release the result with
+ * xdr_free(xdr_square_stats, ...)
+ */
+int
+square_get_server_stats(CLIENT *clnt, unsigned int flags, square_stats *result)
+{
+	enum clnt_stat stat;
+
+	memset(result, 0, sizeof(*result));
+	stat = clnt_call(clnt, STATSPROC,
+			(xdrproc_t) xdr_u_int, (caddr_t) &flags,
+			(xdrproc_t) xdr_square_stats, (caddr_t) result,
+			stats_call_timeout);
+	if (stat != RPC_SUCCESS) {
+		log_error("%s", clnt_sperror(clnt, "STATSPROC"));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Call DRCSTATSPROC. Older servers don't have it; we don't complain
+ * about that.
+ */
+int
+square_get_drc_stats(CLIENT *clnt, square_drcstats *result)
+{
+	enum clnt_stat stat;
+
+	memset(result, 0, sizeof(*result));
+	stat = clnt_call(clnt, DRCSTATSPROC,
+			(xdrproc_t) xdr_void, NULL,
+			(xdrproc_t) xdr_square_drcstats, (caddr_t) result,
+			stats_call_timeout);
+	if (stat != RPC_SUCCESS) {
+		if (stat != RPC_PROCUNAVAIL)
+			log_error("%s", clnt_sperror(clnt, "DRCSTATSPROC"));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Find the entry for a procedure. If it was called over several
+ * transports, return the one with the most calls.
+ */
+const square_procstats *
+square_find_server_stats(const square_stats *stats, const char *proc)
+{
+	const square_procstats *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < stats->square_stats_len; ++i) {
+		const square_procstats *ps = &stats->square_stats_val[i];
+
+		if (strcmp(ps->proc, proc))
+			continue;
+		if (best == NULL || ps->calls > best->calls)
+			best = ps;
+	}
+	return best;
+}
+
+int
+do_stats(const char *hostname, const char *netid, int argc, char **argv)
+{
+	unsigned int flags = 0;
+	square_drcstats drc;
+	square_stats stats;
+	CLIENT *clnt;
+	unsigned int i;
+	int rv = 0;
+
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "reset")) {
+			flags |= SQUARE_STATS_RESET;
+		} else {
+			log_error("unknown argument \"%s\"", argv[i]);
+			return 1;
+		}
+	}
+
+	clnt = clnt_create(hostname, SQUARE_PROG, SQUARE_VERS, netid? : "tcp");
+	if (clnt == NULL) {
+		log_error("%s", clnt_spcreateerror("unable to create client"));
+		return 1;
+	}
+
+	/* Get these first, a reset clears them as well */
+	if (square_get_drc_stats(clnt, &drc) < 0)
+		drc.size = 0;
+
+	if (square_get_server_stats(clnt, flags, &stats) < 0) {
+		rv = 1;
+		goto out;
+	}
+
+	printf("%-14s %-6s %10s %8s %12s %12s %8s %10s %10s %10s %10s\n",
+			"proc", "netid", "calls", "errors", "bytes-in", "bytes-out", "allocs",
+			"mean(us)", "p50(us)", "p99(us)", "max(us)");
+	for (i = 0; i < stats.square_stats_len; ++i) {
+		const square_procstats *ps = &stats.square_stats_val[i];
+
+		printf("%-14s %-6s %10llu %8llu %12llu %12llu %8.2f %10.1f %10.1f %10.1f %10.1f\n",
+				ps->proc, ps->netid,
+				(unsigned long long) ps->calls,
+				(unsigned long long) ps->errors,
+				(unsigned long long) ps->bytes_in,
+				(unsigned long long) ps->bytes_out,
+				(double) ps->allocs / ps->calls,
+				ps->mean_usec, ps->p50_usec, ps->p99_usec, ps->max_usec);
+	}
+
+	xdr_free((xdrproc_t) xdr_square_stats, (char *) &stats);
+
+	if (drc.size) {
+		printf("\nDuplicate request cache (%u entries): %llu hits, %llu misses, %llu evictions\n",
+				drc.size,
+				(unsigned long long) drc.hits,
+				(unsigned long long) drc.misses,
+				(unsigned long long) drc.evictions);
+	}
+
+out:
+	clnt_destroy(clnt);
+	return rv;
+}
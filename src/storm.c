@@ -0,0 +1,414 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2011-2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * UDP retransmit storm.
+ *
+ * A number of UDP clients call WORKPROC, each with one call outstanding,
+ * and retransmit every call at a fixed interval until the reply arrives.
+ * Unlike clnt_dg, we don't back off, so if the interval is shorter than
+ * the time the server needs to get to a call, the server sees every call
+ * several times. We report goodput (calls completed per second), how
+ * many datagrams it took, and how many calls the server executed, which
+ * is where a duplicate request cache (rpc.squared -D) makes a difference.
+ *
+ * Try this:
+ *  ./rpc.squared -T udp [-D 4096]
+ *  ./square storm clients=32 spin=500us retrans=5ms runtime=10
+ */
+
+#include <sys/socket.h>
+#include <sys/poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include "rpctest.h"
+
+struct storm_opts {
+	unsigned int		nclients;
+	double			spin_usec;
+	double			retrans_usec;
+	unsigned int		max_retrans;
+	double			runtime;
+	const char *		results_file;
+};
+
+struct storm_client {
+	int			fd;
+	uint32_t		xid;
+	double			call_begin;
+	double			last_sent;
+	unsigned int		ntx;
+
+	char			buf[256];
+	unsigned int		len;
+};
+
+struct storm_stats {
+	unsigned long		calls;
+	unsigned long		failed;
+	unsigned long		sent;
+	unsigned long		stale_replies;
+	unsigned long		errors;
+	struct latency		latency;
+};
+
+static int
+storm_opts_set(struct storm_opts *opt, int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		char *name = argv[i];
+		char *value, *s;
+
+		if ((value = strchr(name, '=')) != NULL)
+			*value++ = '\0';
+
+		if (value == NULL) {
+			log_error("missing value to %s argument", name);
+			return -1;
+		}
+
+		if (!strcmp(name, "spin") || !strcmp(name, "retrans")) {
+			double usec;
+
+			if (rpctest_parse_usec(value, &usec) < 0) {
+				log_error("cannot parse time value to %s=%s", name, value);
+				return -1;
+			}
+			if (!strcmp(name, "spin"))
+				opt->spin_usec = usec;
+			else
+				opt->retrans_usec = usec;
+		} else
+		if (!strcmp(name, "runtime")) {
+			opt->runtime = strtod(value, &s);
+			if (*s || opt->runtime <= 0) {
+				log_error("cannot parse numeric value to %s=%s", name, value);
+				return -1;
+			}
+		} else
+		if (!strcmp(name, "clients") || !strcmp(name, "max-retrans")) {
+			unsigned long number;
+
+			number = strtoul(value, &s, 0);
+			if (*s || number == 0) {
+				log_error("cannot parse numeric value to %s=%s", name, value);
+				return -1;
+			}
+			if (!strcmp(name, "clients"))
+				opt->nclients = number;
+			else
+				opt->max_retrans = number;
+		} else
+		if (!strcmp(name, "results")) {
+			opt->results_file = value;
+		} else {
+			log_error("unknown argument \"%s\"", name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Build a new WORKPROC call with a fresh XID
+ */
+static int
+storm_build_call(struct storm_client *sc, const struct storm_opts *opt)
+{
+	static uint32_t xid = 0x5a5a0000;
+	struct rpc_msg msg;
+	square_work work;
+	XDR xdrs;
+	int rv = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.rm_xid = sc->xid = xid++;
+	msg.rm_direction = CALL;
+	msg.rm_call.cb_rpcvers = 2;
+	msg.rm_call.cb_prog = SQUARE_PROG;
+	msg.rm_call.cb_vers = SQUARE_VERS;
+	msg.rm_call.cb_proc = WORKPROC;
+
+	memset(&work, 0, sizeof(work));
+	work.spin_usec = opt->spin_usec;
+
+	xdrmem_create(&xdrs, sc->buf, sizeof(sc->buf), XDR_ENCODE);
+	if (!xdr_callmsg(&xdrs, &msg) || !xdr_square_work(&xdrs, &work)) {
+		log_error("failed to encode rpc message");
+		rv = -1;
+	}
+	sc->len = xdr_getpos(&xdrs);
+	xdr_destroy(&xdrs);
+
+	sc->ntx = 0;
+	sc->call_begin = rpctest_time();
+	return rv;
+}
+
+static void
+storm_send(struct storm_client *sc, struct storm_stats *st)
+{
+	if (send(sc->fd, sc->buf, sc->len, 0) < 0) {
+		/* A full socket buffer is just like a lost packet */
+		if (errno != EAGAIN && errno != ENOBUFS && errno != ECONNREFUSED)
+			log_error("send: %m");
+	} else {
+		st->sent++;
+	}
+	sc->last_sent = rpctest_time();
+	sc->ntx++;
+}
+
+/*
+ * Receive a reply. Replies to calls we have already given up on, or
+ * that were already answered, are counted as stale.
+ */
+static int
+storm_recv(struct storm_client *sc, struct storm_stats *st)
+{
+	struct rpc_msg msg;
+	char buf[256];
+	XDR xdrs;
+	int n, done = 0;
+
+	n = recv(sc->fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (n < 0) {
+		if (errno != EAGAIN && errno != ECONNREFUSED)
+			log_error("recv: %m");
+		return 0;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.acpted_rply.ar_results.where = NULL;
+	msg.acpted_rply.ar_results.proc = (xdrproc_t) xdr_void;
+
+	xdrmem_create(&xdrs, buf, n, XDR_DECODE);
+	if (!xdr_replymsg(&xdrs, &msg)) {
+		st->errors++;
+	} else
+	if (msg.rm_xid != sc->xid) {
+		st->stale_replies++;
+	} else
+	if (msg.rm_reply.rp_stat != MSG_ACCEPTED || msg.acpted_rply.ar_stat != SUCCESS) {
+		st->errors++;
+		done = 1;
+	} else {
+		latency_add_since(&st->latency, sc->call_begin);
+		st->calls++;
+		done = 1;
+	}
+	xdr_destroy(&xdrs);
+
+	return done;
+}
+
+static int
+storm_run(const struct sockaddr_storage *addr, socklen_t addrlen,
+		const struct storm_opts *opt, struct storm_stats *st)
+{
+	struct storm_client *clients;
+	struct pollfd *pfd;
+	double t0, now, retrans = opt->retrans_usec * 1e-6;
+	unsigned int i;
+	int rv = -1;
+
+	clients = calloc(opt->nclients, sizeof(clients[0]));
+	pfd = calloc(opt->nclients, sizeof(pfd[0]));
+
+	for (i = 0; i < opt->nclients; ++i) {
+		struct storm_client *sc = &clients[i];
+
+		sc->fd = socket(addr->ss_family, SOCK_DGRAM, 0);
+		if (sc->fd < 0 || connect(sc->fd, (const struct sockaddr *) addr, addrlen) < 0) {
+			log_error("unable to create UDP socket: %m");
+			goto out;
+		}
+		pfd[i].fd = sc->fd;
+		pfd[i].events = POLLIN;
+	}
+
+	t0 = rpctest_time();
+	for (i = 0; i < opt->nclients; ++i) {
+		if (storm_build_call(&clients[i], opt) < 0)
+			goto out;
+		storm_send(&clients[i], st);
+	}
+
+	while ((now = rpctest_time()) - t0 < opt->runtime) {
+		double next = t0 + opt->runtime;
+		int timeout;
+
+		for (i = 0; i < opt->nclients; ++i) {
+			if (clients[i].last_sent + retrans < next)
+				next = clients[i].last_sent + retrans;
+		}
+
+		timeout = 1000 * (next - now) + 1;
+		if (timeout < 0)
+			timeout = 0;
+		if (poll(pfd, opt->nclients, timeout) < 0 && errno != EINTR) {
+			log_error("poll: %m");
+			goto out;
+		}
+
+		now = rpctest_time();
+		for (i = 0; i < opt->nclients; ++i) {
+			struct storm_client *sc = &clients[i];
+			int done = 0;
+
+			if (pfd[i].revents & POLLIN)
+				done = storm_recv(sc, st);
+
+			if (!done && now - sc->last_sent >= retrans) {
+				if (sc->ntx <= opt->max_retrans) {
+					storm_send(sc, st);
+					continue;
+				}
+				st->failed++;
+				done = 1;
+			}
+
+			if (done) {
+				if (storm_build_call(sc, opt) < 0)
+					goto out;
+				storm_send(sc, st);
+			}
+		}
+	}
+	rv = 0;
+
+out:
+	for (i = 0; i < opt->nclients; ++i) {
+		if (clients[i].fd > 0)
+			close(clients[i].fd);
+	}
+	free(clients);
+	free(pfd);
+	return rv;
+}
+
+int
+do_storm(const char *hostname, const char *netid, int argc, char **argv)
+{
+	struct sockaddr_storage addr;
+	struct netconfig *nconf;
+	struct storm_opts opt;
+	struct storm_stats st;
+	square_drcstats drc;
+	square_stats stats;
+	const square_procstats *ps;
+	unsigned long executed = 0;
+	rpctest_results_t *res;
+	CLIENT *stats_clnt;
+	struct netbuf abuf;
+	int have_drc, exitval = 0;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.nclients = 32;
+	opt.spin_usec = 500;
+	opt.retrans_usec = 5000;
+	opt.max_retrans = 20;
+	opt.runtime = 10;
+	if (storm_opts_set(&opt, argc, argv) < 0)
+		return 1;
+
+	abuf.buf = &addr;
+	abuf.len = abuf.maxlen = sizeof(addr);
+
+	nconf = getnetconfigent("udp");
+	if (!rpcb_getaddr(SQUARE_PROG, SQUARE_VERS, nconf, &abuf, hostname)) {
+		log_error("Cannot find square service on host %s", hostname);
+		return 1;
+	}
+	freenetconfigent(nconf);
+
+	/* Server side counters are queried over TCP, so that they
+	 * don't get lost in the storm */
+	stats_clnt = clnt_create(hostname, SQUARE_PROG, SQUARE_VERS, "tcp");
+	if (stats_clnt == NULL) {
+		log_error("%s", clnt_spcreateerror("unable to create client for server stats"));
+		return 1;
+	}
+	if (square_get_server_stats(stats_clnt, SQUARE_STATS_RESET, &stats) < 0)
+		return 1;
+	xdr_free((xdrproc_t) xdr_square_stats, (char *) &stats);
+
+	memset(&st, 0, sizeof(st));
+	latency_init(&st.latency);
+	if (storm_run(&addr, abuf.len, &opt, &st) < 0)
+		return 1;
+
+	/* Let the server drain its queue before we ask */
+	usleep(100000);
+
+	have_drc = square_get_drc_stats(stats_clnt, &drc) == 0 && drc.size;
+	if (square_get_server_stats(stats_clnt, 0, &stats) == 0) {
+		if ((ps = square_find_server_stats(&stats, "WORKPROC")) != NULL)
+			executed = ps->calls;
+		xdr_free((xdrproc_t) xdr_square_stats, (char *) &stats);
+	}
+	clnt_destroy(stats_clnt);
+
+	printf("Goodput: %.1f calls/s (%lu calls, %lu failed)\n",
+			st.calls / opt.runtime, st.calls, st.failed);
+	printf("Datagrams sent: %.1f/s, %.2f per call\n",
+			st.sent / opt.runtime, st.calls? (double) st.sent / st.calls : 0);
+	printf("Stale replies: %lu\n", st.stale_replies);
+	printf("Latency: mean %.1f usec, p99 %.1f usec\n",
+			latency_mean(&st.latency), latency_percentile(&st.latency, 99));
+	printf("Server executed %lu calls, %.2f per call\n",
+			executed, st.calls? (double) executed / st.calls : 0);
+	if (have_drc)
+		printf("Duplicate request cache: %llu hits, %llu misses, %llu evictions\n",
+				(unsigned long long) drc.hits,
+				(unsigned long long) drc.misses,
+				(unsigned long long) drc.evictions);
+	if (st.errors) {
+		printf("Encountered %lu errors\n", st.errors);
+		exitval = 1;
+	}
+
+	res = rpctest_results_new();
+	rpctest_results_set(res, "host", "%s", hostname);
+	rpctest_results_set(res, "clients", "%u", opt.nclients);
+	rpctest_results_set(res, "spin-usec", "%.0f", opt.spin_usec);
+	rpctest_results_set(res, "retrans-usec", "%.0f", opt.retrans_usec);
+	rpctest_results_set(res, "runtime", "%.3f", opt.runtime);
+	rpctest_results_set(res, "calls", "%lu", st.calls);
+	rpctest_results_set(res, "calls-per-sec", "%.1f", st.calls / opt.runtime);
+	rpctest_results_set(res, "failed", "%lu", st.failed);
+	rpctest_results_set(res, "errors", "%lu", st.errors);
+	rpctest_results_set(res, "sent-per-call", "%.2f", st.calls? (double) st.sent / st.calls : 0);
+	rpctest_results_set(res, "executed-per-call", "%.2f", st.calls? (double) executed / st.calls : 0);
+	rpctest_results_set(res, "latency-mean-usec", "%.1f", latency_mean(&st.latency));
+	rpctest_results_set(res, "latency-p99-usec", "%.1f", latency_percentile(&st.latency, 99));
+	if (have_drc) {
+		rpctest_results_set(res, "drc.hits", "%llu", (unsigned long long) drc.hits);
+		rpctest_results_set(res, "drc.misses", "%llu", (unsigned long long) drc.misses);
+		rpctest_results_set(res, "drc.evictions", "%llu", (unsigned long long) drc.evictions);
+	}
+	if (opt.results_file && rpctest_results_write(res, opt.results_file) < 0)
+		exitval = 1;
+	rpctest_results_free(res);
+
+	return exitval;
+}
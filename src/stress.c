@@ -26,6 +26,69 @@
  *  ./rpc.sqaured
  *  ./square stress runtime=60 jobs=120 trace=1
  *
+ * To find the capacity of the server, use sweep mode:
+ *  ./square sweep min-jobs=1 max-jobs=512 factor=2 step-time=10 slo=2ms
+ * This steps the number of concurrent jobs geometrically, runs each
+ * step until the call rate has settled, and prints throughput versus
+ * latency. It reports the knee of the curve (the step with the best
+ * ratio of throughput to p99 latency), and the highest rate that still
+ * meets the latency SLO.
+ *
+ * For use in automated pipelines, a run can be checked against the
+ * results file of an earlier run, and against absolute SLOs:
+ *  ./square stress runtime=60 baseline=last.out tolerance=10%,p99:20% 'slo=p99<2ms,calls/s>5000'
+ * The exit status is non-zero if any metric regressed by more than its
+ * tolerance, or any SLO was violated.
+ *
+ * To make runs on multi-socket machines comparable, pin the client
+ * with cpus=<cpulist> (see cpuset.c for the syntax), and the server
+ * with rpc.squared -C <cpulist>. With results=<file>, the outcome of
+ * the run is written to a file, including the CPU placement.
+ *
+ * With server-stats, the server's statistics are reset at the start of
+ * the run and fetched at the end (see STATSPROC). We then report the
+ * server's service time next to the latency observed by the client;
+ * the difference is what the network and queueing add.
+ *
+ * With size=<n>, every call sums up n ints, rather than a random number
+ * up to 64K. Combined with server-stats, this gives the server time per
+ * MB of arguments for a given request size:
+ *  ./square stress runtime=30 size=65536 server-stats
+ *
+ * With proc=sink, we call SINKPROC instead of SUMPROC. The server
+ * discards the data without looking at it, so this measures transport
+ * throughput. proc=echo sends size ints and gets them back (ECHOPROC),
+ * proc=gen asks the server for that much data (GENPROC). The bytes
+ * per second in each direction are printed at the end of the run.
+ *
+ * proc=square calls SQUAREPROC, and proc=work calls WORKPROC, which
+ * spins, sleeps and touches memory as told. Spin and sleep times are
+ * drawn from a distribution for every call, e.g.
+ *  ./square stress proc=work spin=exp:200us sleep=bimodal:0:10ms:1% mem=64k
+ * where a plain time is fixed, exp:MEAN is exponential, uniform:MIN:MAX
+ * is uniform, and bimodal:A:B:PCT returns B in PCT of the calls and A
+ * otherwise. To mix procedures, give their weights with mix=:
+ *  ./square stress mix=square:90,work:10 spin=exp:1ms server-stats
+ *
+ * To measure bandwidth for a range of payload sizes, use bulk mode:
+ *  ./square bulk sizes=1k,64k,1m procs=echo,gen jobs=16 step-time=5
+ * Sizes are in bytes here; jobs, step-time, warmup and results are
+ * as for sweep mode. Bulk mode sets TCP_NODELAY, because we send calls
+ * in random pieces, which makes small calls wait for delayed ACKs
+ * otherwise. Use nodelay to do the same in stress mode.
+ *
+ * With slow=N, the first N jobs are slow senders: they send every call
+ * in four pieces, and pause slow-delay (default 50ms) between them.
+ * Their calls are reported separately, so the call rate and latency of
+ * the run are those of the other clients. This shows how much a server
+ * that reads records in blocking mode suffers from such clients, and
+ * what rpc.squared -n (non-blocking mode) costs:
+ *  ./square stress runtime=30 jobs=32 slow=4 slow-delay=20ms
+ *
+ * With port=N, we connect to this TCP port rather than asking rpcbind
+ * for the address of the service. This is how to drive rpc.rawsquared
+ * when it runs with -R.
+ *
  * FIXME:
  *  Introduce UDP jobs
  */
@@ -36,11 +99,32 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <netinet/tcp.h>
+#include <math.h>
+#include <netdb.h>
 #include "rpctest.h"
 #include "src/square.h"
 
 #define BASE_PORT		0
 #define HIST_MAX		100
+#define STRESS_MAX_MIX		8
+
+enum {
+	STRESS_DIST_FIXED,
+	STRESS_DIST_UNIFORM,
+	STRESS_DIST_EXP,
+	STRESS_DIST_BIMODAL,
+};
+
+/*
+ * Distribution of WORKPROC spin and sleep times, in usec.
+ * uniform picks from [a, b], exp has mean a, and bimodal
+ * returns b with probability p and a otherwise.
+ */
+struct stress_dist {
+	int			type;
+	double			a, b, p;
+};
 
 struct stress_opts {
 	int			trace;
@@ -53,6 +137,74 @@ struct stress_opts {
 	unsigned int		njobs;
 	unsigned int		max_errors;
 	time_t			end_time;
+
+	/* Number of ints per SUMPROC call; random if 0 */
+	unsigned int		num_ints;
+
+	/* SUMPROC, SINKPROC, ECHOPROC, GENPROC, SQUAREPROC or WORKPROC */
+	unsigned int		proc;
+
+	/* If given, pick the procedure for each call from this mix */
+	unsigned int		num_mix;
+	struct {
+		unsigned int	proc;
+		unsigned int	weight;
+	}			mix[STRESS_MAX_MIX];
+	unsigned int		mix_total;
+
+	/* WORKPROC arguments */
+	struct stress_dist	work_spin;
+	struct stress_dist	work_sleep;
+	unsigned int		work_mem_kb;
+
+	int			pinned;
+	cpu_set_t		cpus;
+
+	const char *		results_file;
+
+	/* Progress report once a second, unless quiet */
+	int			quiet;
+
+	/* Fetch server side statistics via STATSPROC */
+	int			server_stats;
+
+	/* Set TCP_NODELAY on all connections */
+	int			nodelay;
+
+	/* Connect to this port instead of asking rpcbind */
+	unsigned int		port;
+
+	/* Number of slow senders, and how long they pause, in usec */
+	unsigned int		slow_jobs;
+	double			slow_delay;
+
+	/* Sweep mode */
+	unsigned int		sweep_min_jobs;
+	unsigned int		sweep_max_jobs;
+	double			sweep_factor;
+	double			sweep_step_time;
+	double			sweep_warmup;
+
+	/* Regression gating */
+	const char *		baseline_file;
+	const char *		tolerances;
+	unsigned int		num_slo;
+	struct rpctest_slo	slo[16];
+
+	/* p99 latency bound from the SLO, used by sweep mode */
+	double			slo_usec;
+};
+
+struct stress_stats {
+	unsigned int		njobs;
+	double			elapsed;
+	unsigned long		ncalls;
+	unsigned int		errors;
+	double			rate;
+	unsigned long		bytes_sent;
+	unsigned long		bytes_recv;
+	int			steady;
+	struct latency		latency;
 };
 
 struct sumclnt {
@@ -64,6 +216,17 @@ struct sumclnt {
 	/* Number of calls made */
 	unsigned long		ncalls;
 
+	/* Bytes on the wire, including RPC headers */
+	unsigned long		bytes_sent;
+	unsigned long		bytes_recv;
+
+	/* Time from building a call packet to receiving the reply */
+	struct latency		call_latency;
+
+	/* Calls made by slow senders are not counted above */
+	unsigned long		slow_calls;
+	struct latency		slow_latency;
+
 	struct sumjob **	jobs;
 
 	unsigned int		errors;
@@ -82,17 +245,22 @@ struct sumjob {
 
 	int			fd;
 	int			proto;
+	unsigned int		proc;
 	struct pollfd *		pollfd;
 
 	struct timeval		ctime;
 	struct timeval		timeout;
 	uint32_t		xid;
+	double			call_begin;
 
 	unsigned int		ncalls;
 	unsigned int		max_calls;
 
 	unsigned int		num_ints;
 
+	/* Send calls piecemeal, see slow= */
+	int			slow;
+
 	struct {
 		struct timeval	begin;
 
@@ -100,6 +268,9 @@ struct sumjob {
 		unsigned int	size;
 		unsigned int	len;
 		unsigned int	pos;
+
+		/* Slow senders pause until then */
+		struct timeval	resume;
 	} send;
 	struct {
 		struct timeval	begin;
@@ -108,8 +279,20 @@ struct sumjob {
 		unsigned int	size;
 		unsigned int	len;
 		unsigned int	pos;
+
+		/* TCP record marking */
+		unsigned char	marker[4];
+		unsigned int	marker_pos;
+		unsigned int	frag_left;
+		int		last_frag;
 	} recv;
 
+	/* Offset of the ECHOPROC payload in send.buf */
+	unsigned int		payload_pos;
+
+	/* SQUAREPROC argument */
+	long			square_arg;
+
 	unsigned int		sum;
 
 	/* If we got EMFILE when trying to create the socket, then
@@ -128,16 +311,32 @@ struct timeout {
 
 static unsigned int	xid = 0x1234abcd;
 
+static const struct stress_proc {
+	const char *		name;
+	unsigned int		proc;
+	const char *		procname;
+} stress_procs[] = {
+	{ "sum",	SUMPROC,	"SUMPROC"	},
+	{ "sink",	SINKPROC,	"SINKPROC"	},
+	{ "echo",	ECHOPROC,	"ECHOPROC"	},
+	{ "gen",	GENPROC,	"GENPROC"	},
+	{ "square",	SQUAREPROC,	"SQUAREPROC"	},
+	{ "work",	WORKPROC,	"WORKPROC"	},
+	{ NULL }
+};
+
 
 
 static struct sumclnt *	sumclnt_new(const char *hostname, struct stress_opts *opt);
+static int		stress_resolve(const char *, unsigned int, struct sockaddr_storage *, socklen_t *);
 static void		sumclnt_free(struct sumclnt *clnt);
 static int		sumclnt_poll(struct sumclnt *clnt);
 
 static struct sumjob *	sumjob_new(struct sumclnt *clnt, unsigned int jobid, unsigned int num_ints);
 static int		sumjob_connect(struct sumclnt *clnt, struct sumjob *job);
-static int		sumjob_build_packet(struct sumjob *job);
+static int		sumjob_build_packet(const struct sumclnt *clnt, struct sumjob *job);
 static void		sumjob_drop_buffers(struct sumjob *job);
+static void		__sumjob_set_timeout(struct timeval *deadline, unsigned long timeout_usec);
 static void		sumjob_set_timeout(struct sumclnt *clnt, struct sumjob *job);
 static void		sumjob_close(struct sumjob *job);
 static int		sumjob_send(struct sumclnt *clnt, struct sumjob *job);
@@ -155,13 +354,155 @@ static void		hist_init(struct histogram *h, double xrange);
 static void		hist_record(struct histogram *h, const struct timeval *t0);
 static void		hist_print(struct histogram *h, unsigned int nlines);
 
+static const struct stress_proc *
+stress_proc_by_name(const char *name)
+{
+	const struct stress_proc *sp;
+
+	for (sp = stress_procs; sp->name; ++sp) {
+		if (!strcmp(sp->name, name))
+			return sp;
+	}
+	return NULL;
+}
+
+/*
+ * The names proc= accepts, for error messages
+ */
+static const char *
+stress_proc_names(void)
+{
+	static char buffer[128];
+	const struct stress_proc *sp;
+	size_t len = 0;
+
+	for (sp = stress_procs; sp->name && len < sizeof(buffer); ++sp)
+		len += snprintf(buffer + len, sizeof(buffer) - len, "%s%s",
+				len? ", " : "", sp->name);
+	return buffer;
+}
+
+static const char *
+stress_procname(unsigned int proc)
+{
+	const struct stress_proc *sp;
+
+	for (sp = stress_procs; sp->name; ++sp) {
+		if (sp->proc == proc)
+			return sp->procname;
+	}
+	return "unknown";
+}
+
+/*
+ * Parse a distribution such as 200us, exp:200us, uniform:100us:300us
+ * or bimodal:100us:10ms:1%
+ */
+static int
+stress_dist_parse(char *value, struct stress_dist *dist)
+{
+	char *words[4], *s;
+	unsigned int n = 0, i;
+	double v[2] = { 0, 0 };
+
+	memset(dist, 0, sizeof(*dist));
+	for (s = strtok(value, ":"); s; s = strtok(NULL, ":")) {
+		if (n >= 4)
+			goto bad;
+		words[n++] = s;
+	}
+	if (n == 0)
+		goto bad;
+
+	if (n == 1) {
+		dist->type = STRESS_DIST_FIXED;
+		return rpctest_parse_usec(words[0], &dist->a);
+	}
+
+	if (!strcmp(words[0], "exp") && n == 2)
+		dist->type = STRESS_DIST_EXP;
+	else if (!strcmp(words[0], "uniform") && n == 3)
+		dist->type = STRESS_DIST_UNIFORM;
+	else if (!strcmp(words[0], "bimodal") && n == 4)
+		dist->type = STRESS_DIST_BIMODAL;
+	else
+		goto bad;
+
+	for (i = 1; i < n && i < 3; ++i) {
+		if (rpctest_parse_usec(words[i], &v[i - 1]) < 0)
+			goto bad;
+	}
+	dist->a = v[0];
+	dist->b = v[1];
+
+	if (dist->type == STRESS_DIST_BIMODAL) {
+		dist->p = strtod(words[3], &s);
+		if (*s == '%') {
+			dist->p /= 100;
+			s++;
+		}
+		if (*s || dist->p < 0 || dist->p > 1)
+			goto bad;
+	}
+	return 0;
+
+bad:
+	log_error("cannot parse distribution; expected N, exp:MEAN, uniform:MIN:MAX or bimodal:A:B:PCT");
+	return -1;
+}
+
+static unsigned int
+stress_dist_sample(const struct stress_dist *dist)
+{
+	double r = random() / (RAND_MAX + 1.0);
+	double v;
+
+	switch (dist->type) {
+	case STRESS_DIST_UNIFORM:
+		v = dist->a + (dist->b - dist->a) * r;
+		break;
+	case STRESS_DIST_EXP:
+		v = -dist->a * log(1 - r);
+		break;
+	case STRESS_DIST_BIMODAL:
+		v = (r < dist->p)? dist->b : dist->a;
+		break;
+	default:
+		v = dist->a;
+		break;
+	}
+	return v < 0? 0 : v;
+}
+
+static unsigned int
+stress_pick_proc(const struct stress_opts *opt)
+{
+	unsigned int i, r;
+
+	if (opt->num_mix == 0)
+		return opt->proc;
+
+	r = random() % opt->mix_total;
+	for (i = 0; r >= opt->mix[i].weight; ++i)
+		r -= opt->mix[i].weight;
+	return opt->mix[i].proc;
+}
+
 static void
 stress_opts_init_defaults(struct stress_opts *opt)
 {
 	memset(opt, 0, sizeof(*opt));
 	opt->max_calls = 32;
 	opt->njobs = 128;
+	opt->proc = SUMPROC;
 	opt->max_errors = 256;
+	opt->slow_delay = 50000;
+
+	opt->sweep_min_jobs = 1;
+	opt->sweep_max_jobs = 1024;
+	opt->sweep_factor = 2;
+	opt->sweep_step_time = 10;
+	opt->sweep_warmup = 2;
 }
 
 static int
@@ -181,12 +522,198 @@ stress_opts_set(struct stress_opts *opt, int argc, char **argv)
 			opt->trace = 1;
 			continue;
 		}
+		if (!strcmp(name, "server-stats")) {
+			opt->server_stats = 1;
+			continue;
+		}
+		if (!strcmp(name, "nodelay")) {
+			opt->nodelay = 1;
+			continue;
+		}
+
+		if (!strcmp(name, "proc")) {
+			const struct stress_proc *sp;
+
+			if (!value || !(sp = stress_proc_by_name(value))) {
+				log_error("proc must be one of %s", stress_proc_names());
+				goto ignore_arg;
+			}
+			opt->proc = sp->proc;
+			continue;
+		}
+
+		if (!strcmp(name, "mix")) {
+			char *item;
+
+			if (!value) {
+				log_error("missing value to %s argument", name);
+				goto ignore_arg;
+			}
+			opt->num_mix = opt->mix_total = 0;
+			for (item = strtok(value, ","); item; item = strtok(NULL, ",")) {
+				const struct stress_proc *sp;
+				unsigned long weight = 1;
+				char *w;
+
+				if ((w = strchr(item, ':')) != NULL) {
+					*w++ = '\0';
+					weight = strtoul(w, &w, 0);
+					if (*w || weight == 0) {
+						log_error("bad weight for %s in mix=", item);
+						opt->num_mix = 0;
+						goto ignore_arg;
+					}
+				}
+				if ((sp = stress_proc_by_name(item)) == NULL || opt->num_mix >= STRESS_MAX_MIX) {
+					log_error("bad procedure %s in mix=", item);
+					opt->num_mix = 0;
+					goto ignore_arg;
+				}
+				opt->mix[opt->num_mix].proc = sp->proc;
+				opt->mix[opt->num_mix].weight = weight;
+				opt->mix_total += weight;
+				opt->num_mix++;
+			}
+			continue;
+		}
+
+		if (!strcmp(name, "slow-delay")) {
+			if (!value || rpctest_parse_usec(value, &opt->slow_delay) < 0) {
+				log_error("cannot parse time value to %s", name);
+				goto ignore_arg;
+			}
+			continue;
+		}
+
+		if (!strcmp(name, "spin") || !strcmp(name, "sleep")) {
+			if (!value) {
+				log_error("missing value to %s argument", name);
+				goto ignore_arg;
+			}
+			if (stress_dist_parse(value, !strcmp(name, "spin")? &opt->work_spin : &opt->work_sleep) < 0)
+				goto ignore_arg;
+			continue;
+		}
+
+		if (!strcmp(name, "mem")) {
+			unsigned long kb;
+			char *s;
+
+			if (!value) {
+				log_error("missing value to %s argument", name);
+				goto ignore_arg;
+			}
+			kb = strtoul(value, &s, 0);
+			if (*s == 'k' || *s == 'K') {
+				s++;
+			} else
+			if (*s == 'm' || *s == 'M') {
+				kb <<= 10;
+				s++;
+			} else
+			if (*s == '\0') {
+				kb >>= 10;
+			}
+			if (*s || kb > SQUARE_WORK_MAX_MEM_KB) {
+				log_error("cannot parse memory size %s=%s", name, value);
+				goto ignore_arg;
+			}
+			opt->work_mem_kb = kb;
+			continue;
+		}
+
+		/* A gate that we cannot parse must not let the run pass */
+		if (!strcmp(name, "baseline")
+		 || !strcmp(name, "tolerance")
+		 || !strcmp(name, "slo")) {
+			if (!value) {
+				log_error("missing value to %s argument", name);
+				return -1;
+			}
+			if (!strcmp(name, "baseline")) {
+				opt->baseline_file = value;
+			} else
+			if (!strcmp(name, "tolerance")) {
+				if (rpctest_tolerance_check(value) < 0)
+					return -1;
+				opt->tolerances = value;
+			} else {
+				unsigned int k;
+				int n;
+
+				rpctest_slo_free(opt->slo, opt->num_slo);
+				opt->num_slo = 0;
+				opt->slo_usec = 0;
+
+				n = rpctest_slo_parse(value, opt->slo, ARRAY_COUNT(opt->slo));
+				if (n < 0)
+					return -1;
+				opt->num_slo = n;
+				for (k = 0; k < opt->num_slo; ++k) {
+					if (!strcmp(opt->slo[k].metric, "latency-p99-usec")
+					 && opt->slo[k].op == '<')
+						opt->slo_usec = opt->slo[k].value;
+				}
+			}
+			continue;
+		}
+
+		if (!strcmp(name, "cpus")
+		 || !strcmp(name, "results")) {
+			if (!value) {
+				log_error("missing value to %s argument", name);
+				goto ignore_arg;
+			}
+			if (!strcmp(name, "results")) {
+				opt->results_file = value;
+			} else {
+				if (rpctest_cpuset_parse(value, &opt->cpus) < 0)
+					goto ignore_arg;
+				opt->pinned = 1;
+			}
+			continue;
+		}
+
+		if (!strcmp(name, "factor")
+		 || !strcmp(name, "step-time")
+		 || !strcmp(name, "warmup")) {
+			double v;
+			char *s;
+
+			if (!value) {
+				log_error("missing value to %s argument", name);
+				goto ignore_arg;
+			}
+
+			v = strtod(value, &s);
+			if (*s || v < 0) {
+				log_error("cannot parse numeric value to %s=%s", name, value);
+				goto ignore_arg;
+			}
+			if (!strcmp(name, "factor")) {
+				if (v <= 1) {
+					log_error("sweep factor must be greater than 1");
+					goto ignore_arg;
+				}
+				opt->sweep_factor = v;
+			} else
+			if (!strcmp(name, "step-time"))
+				opt->sweep_step_time = v;
+			else
+				opt->sweep_warmup = v;
+			continue;
+		}
 
 		if (!strcmp(name, "runtime")
 		 || !strcmp(name, "jobs")
+		 || !strcmp(name, "min-jobs")
+		 || !strcmp(name, "max-jobs")
 		 || !strcmp(name, "job-timeout")
 		 || !strcmp(name, "max-calls")
-		 || !strcmp(name, "max-errors")) {
+		 || !strcmp(name, "max-errors")
+		 || !strcmp(name, "slow")
+		 || !strcmp(name, "port")
+		 || !strcmp(name, "size")) {
 			char *s;
 
 			if (!value) {
@@ -224,6 +751,14 @@ stress_opts_set(struct stress_opts *opt, int argc, char **argv)
 			opt->njobs = number;
 			continue;
 		}
+		if (!strcmp(name, "min-jobs")) {
+			opt->sweep_min_jobs = number;
+			continue;
+		}
+		if (!strcmp(name, "max-jobs")) {
+			opt->sweep_max_jobs = number;
+			continue;
+		}
 		if (!strcmp(name, "job-timeout")) {
 			opt->job_timeout = number;
 			continue;
@@ -236,6 +771,22 @@ stress_opts_set(struct stress_opts *opt, int argc, char **argv)
 			opt->max_errors = number;
 			continue;
 		}
+		if (!strcmp(name, "size")) {
+			opt->num_ints = number;
+			continue;
+		}
+		if (!strcmp(name, "slow")) {
+			opt->slow_jobs = number;
+			continue;
+		}
+		if (!strcmp(name, "port")) {
+			if (number > 65535) {
+				log_error("bad port number %s=%s", name, value);
+				goto ignore_arg;
+			}
+			opt->port = number;
+			continue;
+		}
 
 		log_error("unknown argument \"%s\"", name);
 ignore_arg:
@@ -252,18 +803,183 @@ ignore_arg:
 	return 0;
 }
 
+/*
+ * Compare the results of this run against a baseline and the SLO,
+ * if given. Returns non-zero if the run should be considered a failure.
+ */
+static int
+stress_check_results(const struct stress_opts *opt, const rpctest_results_t *res)
+{
+	int failed = 0;
+
+	if (opt->baseline_file) {
+		rpctest_results_t *base;
+		int n;
+
+		if ((base = rpctest_results_read(opt->baseline_file)) == NULL)
+			return 1;
+
+		printf("\nComparison with baseline %s\n", opt->baseline_file);
+		n = rpctest_results_compare(res, base, opt->tolerances);
+		if (n < 0) {
+			failed = 1;
+		} else if (n > 0) {
+			printf("%d metric(s) regressed\n", n);
+			failed = 1;
+		}
+		rpctest_results_free(base);
+	}
+
+	if (opt->num_slo) {
+		int n;
+
+		printf("\nChecking service level objectives\n");
+		n = rpctest_results_check_slo(res, opt->slo, opt->num_slo);
+		if (n > 0) {
+			printf("%d SLO(s) violated\n", n);
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
+
+/*
+ * With a call mix, the client latency covers all procedures, so
+ * we only show the server's service time for each of them.
+ */
+static void
+stress_server_stats_mix(const square_stats *stats, const struct sumclnt *clnt, rpctest_results_t *res)
+{
+	unsigned int i;
+
+	printf("\nServer statistics for the call mix\n");
+	for (i = 0; i < clnt->conf.num_mix; ++i) {
+		const char *procname = stress_procname(clnt->conf.mix[i].proc);
+		const square_procstats *ps;
+		char name[64];
+
+		if ((ps = square_find_server_stats(stats, procname)) == NULL) {
+			printf("  %-12s no calls\n", procname);
+			continue;
+		}
+		printf("  %-12s calls %llu, errors %llu, service time: mean %.1f us, p99 %.1f us\n",
+				procname,
+				(unsigned long long) ps->calls, (unsigned long long) ps->errors,
+				ps->mean_usec, ps->p99_usec);
+
+		snprintf(name, sizeof(name), "server.%s.calls", procname);
+		rpctest_results_set(res, name, "%llu", (unsigned long long) ps->calls);
+		snprintf(name, sizeof(name), "server.%s.latency-mean-usec", procname);
+		rpctest_results_set(res, name, "%.1f", ps->mean_usec);
+		snprintf(name, sizeof(name), "server.%s.latency-p99-usec", procname);
+		rpctest_results_set(res, name, "%.1f", ps->p99_usec);
+	}
+}
+
+/*
+ * Compare the server's service time for our procedure with the
+ * latency we observed.
+ */
+static void
+stress_server_stats(CLIENT *stats_clnt, const struct sumclnt *clnt, rpctest_results_t *res)
+{
+	const char *procname = stress_procname(clnt->conf.proc);
+	const square_procstats *ps;
+	square_stats stats;
+	double client_mean;
+
+	if (square_get_server_stats(stats_clnt, 0, &stats) < 0)
+		return;
+
+	if (clnt->conf.num_mix) {
+		stress_server_stats_mix(&stats, clnt, res);
+		goto out;
+	}
+
+	if ((ps = square_find_server_stats(&stats, procname)) == NULL) {
+		printf("Server did not report any %s calls\n", procname);
+		goto out;
+	}
+
+	client_mean = latency_mean(&clnt->call_latency);
+	printf("\nServer statistics for %s over %s\n", procname, ps->netid);
+	printf("  calls %llu, errors %llu\n",
+			(unsigned long long) ps->calls, (unsigned long long) ps->errors);
+	printf("  service time: mean %.1f us, p99 %.1f us\n", ps->mean_usec, ps->p99_usec);
+	printf("  memory allocations per call: %.2f\n", (double) ps->allocs / ps->calls);
+	if (ps->bytes_in + ps->bytes_out) {
+		double usec_per_mb = ps->mean_usec * ps->calls / ((ps->bytes_in + ps->bytes_out) / 1e6);
+
+		printf("  server time per MB of arguments and results: %.1f us\n", usec_per_mb);
+		rpctest_results_set(res, "server.usec-per-mb", "%.1f", usec_per_mb);
+	}
+	printf("  client latency: mean %.1f us, p99 %.1f us\n",
+			client_mean, latency_percentile(&clnt->call_latency, 99));
+	printf("  network and queueing overhead: mean %.1f us (%.0f%% of latency)\n",
+			client_mean - ps->mean_usec,
+			client_mean? 100 * (client_mean - ps->mean_usec) / client_mean : 0);
+
+	rpctest_results_set(res, "server.calls", "%llu", (unsigned long long) ps->calls);
+	rpctest_results_set(res, "server.latency-mean-usec", "%.1f", ps->mean_usec);
+	rpctest_results_set(res, "server.latency-p99-usec", "%.1f", ps->p99_usec);
+	rpctest_results_set(res, "server.allocs-per-call", "%.2f", (double) ps->allocs / ps->calls);
+	rpctest_results_set(res, "overhead-mean-usec", "%.1f", client_mean - ps->mean_usec);
+
+out:
+	xdr_free((xdrproc_t) xdr_square_stats, (char *) &stats);
+}
+
 int
 do_stress(const char *hostname, const char *netid, int argc, char **argv)
 {
 	struct stress_opts opt;
 	struct sumclnt *clnt;
+	CLIENT *stats_clnt = NULL;
+	rpctest_results_t *res;
+	cpu_set_t cpus;
+	double t0, elapsed;
 	int exitval = 0;
 
 	srandom(getpid());
 	stress_opts_init_defaults(&opt);
-	stress_opts_set(&opt, argc, argv);
+	if (stress_opts_set(&opt, argc, argv) < 0)
+		return 1;
+
+	if (opt.pinned && rpctest_cpuset_pin_thread(&opt.cpus, -1) < 0)
+		return 1;
+	if (rpctest_cpuset_current(&cpus) == 0) {
+		struct rpctest_placement pl;
+
+		rpctest_cpuset_topology(&cpus, &pl);
+		printf("Client placement: %s\n", rpctest_placement_print(&pl));
+	}
+
+	if (opt.server_stats) {
+		square_stats stats;
+
+		if (opt.port) {
+			struct sockaddr_in sin;
+			socklen_t alen;
+			int sock = RPC_ANYSOCK;
+
+			if (stress_resolve(hostname, opt.port, (struct sockaddr_storage *) &sin, &alen) < 0)
+				return 1;
+			stats_clnt = clnttcp_create(&sin, SQUARE_PROG, SQUARE_VERS, &sock, 0, 0);
+		} else {
+			stats_clnt = clnt_create(hostname, SQUARE_PROG, SQUARE_VERS, "tcp");
+		}
+		if (stats_clnt == NULL) {
+			log_error("%s", clnt_spcreateerror("unable to create client for server stats"));
+			return 1;
+		}
+		if (square_get_server_stats(stats_clnt, SQUARE_STATS_RESET, &stats) < 0)
+			return 1;
+		xdr_free((xdrproc_t) xdr_square_stats, (char *) &stats);
+	}
 
 	clnt = sumclnt_new(hostname, &opt);
+	t0 = rpctest_time();
 
 	/* FIXME: warn if the runtime is smaller than the default job timeout */
 
@@ -279,6 +995,8 @@ do_stress(const char *hostname, const char *netid, int argc, char **argv)
 		}
 	}
 
+	elapsed = rpctest_time() - t0;
+
 	if (!opt.trace)
 		printf("\n");
 
@@ -287,16 +1005,469 @@ do_stress(const char *hostname, const char *netid, int argc, char **argv)
 		exitval = 1;
 	}
 
+	printf("Throughput: %.2f MB/s to the server, %.2f MB/s from the server\n",
+			clnt->bytes_sent / elapsed / 1e6,
+			clnt->bytes_recv / elapsed / 1e6);
+
+	if (opt.slow_jobs) {
+		printf("Other clients: %.1f calls/s, mean %.1f usec, p99 %.1f usec\n",
+				clnt->ncalls / elapsed,
+				latency_mean(&clnt->call_latency),
+				latency_percentile(&clnt->call_latency, 99));
+		printf("Slow senders: %.1f calls/s, mean %.1f usec, p99 %.1f usec\n",
+				clnt->slow_calls / elapsed,
+				latency_mean(&clnt->slow_latency),
+				latency_percentile(&clnt->slow_latency, 99));
+	}
+
 	printf("\n\nSend histogram (time needed to send a full packet)\n");
 	hist_print(&clnt->send_histogram, 16);
 
 	printf("\n\nReceive histogram (time taken to receive a full reply)\n");
 	hist_print(&clnt->recv_histogram, 16);
- 
+
+	res = rpctest_results_new();
+	rpctest_results_set(res, "host", "%s", hostname);
+	rpctest_results_set(res, "jobs", "%u", opt.njobs);
+	rpctest_results_set(res, "runtime", "%.3f", elapsed);
+	rpctest_results_set(res, "calls", "%lu", clnt->ncalls);
+	rpctest_results_set(res, "calls-per-sec", "%.1f", clnt->ncalls / elapsed);
+	rpctest_results_set(res, "errors", "%u", clnt->errors);
+	rpctest_results_set(res, "send-bytes-per-sec", "%.0f", clnt->bytes_sent / elapsed);
+	rpctest_results_set(res, "recv-bytes-per-sec", "%.0f", clnt->bytes_recv / elapsed);
+	rpctest_results_set(res, "latency-mean-usec", "%.1f", latency_mean(&clnt->call_latency));
+	rpctest_results_set(res, "latency-p50-usec", "%.1f", latency_percentile(&clnt->call_latency, 50));
+	rpctest_results_set(res, "latency-p99-usec", "%.1f", latency_percentile(&clnt->call_latency, 99));
+	if (opt.slow_jobs) {
+		rpctest_results_set(res, "slow-jobs", "%u", opt.slow_jobs);
+		rpctest_results_set(res, "slow-calls", "%lu", clnt->slow_calls);
+		rpctest_results_set(res, "slow-latency-p99-usec", "%.1f",
+				latency_percentile(&clnt->slow_latency, 99));
+	}
+	rpctest_results_set_placement(res, "client", &cpus);
+
+	if (stats_clnt) {
+		stress_server_stats(stats_clnt, clnt, res);
+		clnt_destroy(stats_clnt);
+	}
+
+	if (opt.results_file && rpctest_results_write(res, opt.results_file) < 0)
+		exitval = 1;
+	if (stress_check_results(&opt, res) != 0)
+		exitval = 1;
+	rpctest_results_free(res);
+	rpctest_slo_free(opt.slo, opt.num_slo);
+
 	sumclnt_free(clnt);
 	return exitval;
 }
 
+/*
+ * Run one step of a sweep with the given number of jobs.
+ * After a warmup period, we measure for step_time seconds. If the
+ * call rates in the first and second half of the measurement window
+ * differ by more than 10%, we consider the server not to be in steady
+ * state yet, and measure again (up to three times).
+ */
+static int
+stress_sweep_step(const char *hostname, const struct stress_opts *opt, unsigned int njobs,
+			struct stress_stats *st)
+{
+	struct stress_opts step_opt = *opt;
+	struct sumclnt *clnt;
+	unsigned int attempt;
+	double t0;
+	int rv = -1;
+
+	memset(st, 0, sizeof(*st));
+	st->njobs = njobs;
+
+	step_opt.njobs = njobs;
+	step_opt.quiet = 1;
+	clnt = sumclnt_new(hostname, &step_opt);
+
+	t0 = rpctest_time();
+	while (rpctest_time() < t0 + opt->sweep_warmup) {
+		if (sumclnt_poll(clnt) < 0)
+			goto out;
+	}
+
+	for (attempt = 0; attempt < 3; ++attempt) {
+		unsigned long calls0, calls_mid = 0, sent0, recv0;
+		unsigned int errors0;
+		double begin, now, first_half, second_half, diff;
+		int have_mid = 0;
+
+		latency_init(&clnt->call_latency);
+		calls0 = clnt->ncalls;
+		errors0 = clnt->errors;
+		sent0 = clnt->bytes_sent;
+		recv0 = clnt->bytes_recv;
+		begin = now = rpctest_time();
+
+		while (now < begin + opt->sweep_step_time) {
+			if (sumclnt_poll(clnt) < 0)
+				goto out;
+			if (clnt->errors - errors0 >= opt->max_errors) {
+				log_error("Too many errors with %u jobs, aborting this step", njobs);
+				goto out;
+			}
+
+			now = rpctest_time();
+			if (!have_mid && now >= begin + opt->sweep_step_time / 2) {
+				calls_mid = clnt->ncalls;
+				have_mid = 1;
+			}
+		}
+
+		st->elapsed = now - begin;
+		st->ncalls = clnt->ncalls - calls0;
+		st->errors = clnt->errors - errors0;
+		st->rate = st->ncalls / st->elapsed;
+		st->bytes_sent = clnt->bytes_sent - sent0;
+		st->bytes_recv = clnt->bytes_recv - recv0;
+		st->latency = clnt->call_latency;
+
+		first_half = calls_mid - calls0;
+		second_half = clnt->ncalls - calls_mid;
+		diff = first_half - second_half;
+		if (diff < 0)
+			diff = -diff;
+		if (diff <= 0.1 * (first_half + second_half) / 2) {
+			st->steady = 1;
+			break;
+		}
+	}
+
+	rv = 0;
+
+out:
+	sumclnt_free(clnt);
+	return rv;
+}
+
+int
+do_sweep(const char *hostname, const char *netid, int argc, char **argv)
+{
+	struct stress_opts opt;
+	struct stress_stats *steps, *knee = NULL, *best = NULL;
+	rpctest_results_t *res;
+	unsigned int i, nsteps = 0, njobs;
+	cpu_set_t cpus;
+	int exitval = 0;
+
+	srandom(getpid());
+	stress_opts_init_defaults(&opt);
+	if (stress_opts_set(&opt, argc, argv) < 0)
+		return 1;
+
+	if (opt.sweep_min_jobs > opt.sweep_max_jobs) {
+		log_error("min-jobs must not exceed max-jobs");
+		return 1;
+	}
+
+	/* The SLO selects the highest rate that meets a p99 bound. There
+	 * is no single result to check any other condition against. */
+	for (i = 0; i < opt.num_slo; ++i) {
+		if (strcmp(opt.slo[i].metric, "latency-p99-usec") || opt.slo[i].op != '<') {
+			log_error("sweep supports only a p99 latency bound as SLO, such as slo=p99<2ms");
+			return 1;
+		}
+	}
+
+	if (opt.pinned && rpctest_cpuset_pin_thread(&opt.cpus, -1) < 0)
+		return 1;
+	if (rpctest_cpuset_current(&cpus) == 0) {
+		struct rpctest_placement pl;
+
+		rpctest_cpuset_topology(&cpus, &pl);
+		printf("Client placement: %s\n", rpctest_placement_print(&pl));
+	}
+
+	steps = calloc(64, sizeof(steps[0]));
+
+	printf("%8s %12s %10s %10s %10s  %s\n",
+			"jobs", "calls/s", "mean(us)", "p50(us)", "p99(us)", "state");
+	for (njobs = opt.sweep_min_jobs; nsteps < 64; ) {
+		struct stress_stats *st = &steps[nsteps];
+
+		if (stress_sweep_step(hostname, &opt, njobs, st) < 0) {
+			exitval = 1;
+			break;
+		}
+		nsteps++;
+
+		printf("%8u %12.1f %10.1f %10.1f %10.1f  %s\n",
+				st->njobs, st->rate,
+				latency_mean(&st->latency),
+				latency_percentile(&st->latency, 50),
+				latency_percentile(&st->latency, 99),
+				st->steady? "steady" : "unsteady");
+		fflush(stdout);
+
+		if (njobs >= opt.sweep_max_jobs)
+			break;
+
+		i = njobs * opt.sweep_factor;
+		njobs = (i > njobs)? i : njobs + 1;
+		if (njobs > opt.sweep_max_jobs)
+			njobs = opt.sweep_max_jobs;
+	}
+
+	/* The knee is where the ratio of throughput and latency peaks;
+	 * beyond this point, adding load buys more latency than throughput. */
+	for (i = 0; i < nsteps; ++i) {
+		struct stress_stats *st = &steps[i];
+		double p99 = latency_percentile(&st->latency, 99);
+
+		if (st->ncalls == 0 || p99 <= 0)
+			continue;
+		if (knee == NULL || st->rate / p99 > knee->rate / latency_percentile(&knee->latency, 99))
+			knee = st;
+		if (opt.slo_usec && p99 <= opt.slo_usec && (best == NULL || st->rate > best->rate))
+			best = st;
+	}
+
+	res = rpctest_results_new();
+	rpctest_results_set(res, "host", "%s", hostname);
+	for (i = 0; i < nsteps; ++i) {
+		struct stress_stats *st = &steps[i];
+		char name[64];
+
+		snprintf(name, sizeof(name), "step%u.jobs", i);
+		rpctest_results_set(res, name, "%u", st->njobs);
+		snprintf(name, sizeof(name), "step%u.calls-per-sec", i);
+		rpctest_results_set(res, name, "%.1f", st->rate);
+		snprintf(name, sizeof(name), "step%u.latency-p99-usec", i);
+		rpctest_results_set(res, name, "%.1f", latency_percentile(&st->latency, 99));
+		snprintf(name, sizeof(name), "step%u.steady", i);
+		rpctest_results_set(res, name, "%d", st->steady);
+	}
+	rpctest_results_set_placement(res, "client", &cpus);
+
+	if (knee) {
+		printf("\nKnee at %u jobs: %.1f calls/s, p99 latency %.1f usec\n",
+				knee->njobs, knee->rate, latency_percentile(&knee->latency, 99));
+		rpctest_results_set(res, "knee.jobs", "%u", knee->njobs);
+		rpctest_results_set(res, "knee.calls-per-sec", "%.1f", knee->rate);
+		rpctest_results_set(res, "knee.latency-p99-usec", "%.1f",
+				latency_percentile(&knee->latency, 99));
+	}
+
+	if (opt.slo_usec) {
+		if (best) {
+			printf("Max sustainable rate with p99 <= %.0f usec: %.1f calls/s at %u jobs\n",
+					opt.slo_usec, best->rate, best->njobs);
+			rpctest_results_set(res, "slo.jobs", "%u", best->njobs);
+			rpctest_results_set(res, "slo.calls-per-sec", "%.1f", best->rate);
+		} else {
+			printf("No step met the latency SLO of p99 <= %.0f usec\n", opt.slo_usec);
+			exitval = 1;
+		}
+	}
+
+	if (opt.results_file && rpctest_results_write(res, opt.results_file) < 0)
+		exitval = 1;
+
+	/* The SLO has been applied to the sweep steps already; only
+	 * compare against the baseline here. */
+	rpctest_slo_free(opt.slo, opt.num_slo);
+	opt.num_slo = 0;
+	if (stress_check_results(&opt, res) != 0)
+		exitval = 1;
+	rpctest_results_free(res);
+
+	free(steps);
+	return exitval;
+}
+
+/*
+ * Parse a payload size in bytes, with an optional k or m suffix
+ */
+static int
+__bulk_parse_size(const char *value, unsigned int *ret)
+{
+	unsigned long size;
+	char *s;
+
+	size = strtoul(value, &s, 0);
+	if (*s == 'k' || *s == 'K') {
+		size <<= 10;
+		s++;
+	} else
+	if (*s == 'm' || *s == 'M') {
+		size <<= 20;
+		s++;
+	}
+	if (*s || size < 4 || size > SQUARE_BULK_MAX) {
+		log_error("bad payload size \"%s\" (must be between 4 and %u bytes)", value, SQUARE_BULK_MAX);
+		return -1;
+	}
+	*ret = size;
+	return 0;
+}
+
+/*
+ * Measure bandwidth in both directions for a range of payload sizes.
+ * For every procedure and size, we run a sweep step with a fixed
+ * number of jobs, and report the bytes per second sent and received
+ * (including RPC headers and record marks).
+ */
+int
+do_bulk(const char *hostname, const char *netid, int argc, char **argv)
+{
+	unsigned int sizes[16], nsizes = 0;
+	unsigned int procs[8], nprocs = 0;
+	struct stress_opts opt;
+	rpctest_results_t *res;
+	char **stress_argv;
+	unsigned int i, j;
+	int k, stress_argc = 1;
+	cpu_set_t cpus;
+	int exitval = 0;
+
+	srandom(getpid());
+	stress_opts_init_defaults(&opt);
+	opt.njobs = 16;
+	opt.nodelay = 1;
+	opt.sweep_step_time = 5;
+	opt.sweep_warmup = 1;
+
+	/* Pick out our own arguments, and pass the rest on */
+	stress_argv = calloc(argc + 1, sizeof(char *));
+	stress_argv[0] = argv[0];
+	for (k = 1; k < argc; ++k) {
+		char *s;
+
+		if (!strncmp(argv[k], "sizes=", 6)) {
+			for (nsizes = 0, s = strtok(argv[k] + 6, ","); s; s = strtok(NULL, ",")) {
+				if (nsizes >= ARRAY_COUNT(sizes)) {
+					log_error("too many values in sizes=");
+					return 1;
+				}
+				if (__bulk_parse_size(s, &sizes[nsizes++]) < 0)
+					return 1;
+			}
+		} else
+		if (!strncmp(argv[k], "procs=", 6)) {
+			for (nprocs = 0, s = strtok(argv[k] + 6, ","); s; s = strtok(NULL, ",")) {
+				const struct stress_proc *sp;
+
+				if (nprocs >= ARRAY_COUNT(procs)) {
+					log_error("too many values in procs=");
+					return 1;
+				}
+				if ((sp = stress_proc_by_name(s)) == NULL) {
+					log_error("unknown procedure \"%s\" in procs=", s);
+					return 1;
+				}
+				procs[nprocs++] = sp->proc;
+			}
+		} else {
+			stress_argv[stress_argc++] = argv[k];
+		}
+	}
+	if (stress_opts_set(&opt, stress_argc, stress_argv) < 0) {
+		free(stress_argv);
+		return 1;
+	}
+	free(stress_argv);
+
+	if (nsizes == 0) {
+		sizes[nsizes++] = 1 << 10;
+		sizes[nsizes++] = 16 << 10;
+		sizes[nsizes++] = 256 << 10;
+		sizes[nsizes++] = 1 << 20;
+	}
+	if (nprocs == 0) {
+		procs[nprocs++] = ECHOPROC;
+		procs[nprocs++] = GENPROC;
+	}
+
+	if (opt.pinned && rpctest_cpuset_pin_thread(&opt.cpus, -1) < 0)
+		return 1;
+	if (rpctest_cpuset_current(&cpus) == 0) {
+		struct rpctest_placement pl;
+
+		rpctest_cpuset_topology(&cpus, &pl);
+		printf("Client placement: %s\n", rpctest_placement_print(&pl));
+	}
+
+	res = rpctest_results_new();
+	rpctest_results_set(res, "host", "%s", hostname);
+	rpctest_results_set(res, "jobs", "%u", opt.njobs);
+
+	printf("%-9s %10s %10s %12s %12s %10s\n",
+			"proc", "size", "calls/s", "out(MB/s)", "in(MB/s)", "p99(us)");
+	for (i = 0; i < nprocs; ++i) {
+		for (j = 0; j < nsizes; ++j) {
+			struct stress_opts step_opt = opt;
+			struct stress_stats st;
+			char name[64];
+
+			step_opt.proc = procs[i];
+			step_opt.num_mix = 0;
+			step_opt.num_ints = sizes[j] / 4;
+			if (stress_sweep_step(hostname, &step_opt, opt.njobs, &st) < 0) {
+				exitval = 1;
+				goto out;
+			}
+
+			printf("%-9s %10u %10.1f %12.2f %12.2f %10.1f\n",
+					stress_procname(procs[i]), 4 * step_opt.num_ints, st.rate,
+					st.bytes_sent / st.elapsed / 1e6,
+					st.bytes_recv / st.elapsed / 1e6,
+					latency_percentile(&st.latency, 99));
+			fflush(stdout);
+
+			snprintf(name, sizeof(name), "%s.%u.calls-per-sec",
+					stress_procname(procs[i]), 4 * step_opt.num_ints);
+			rpctest_results_set(res, name, "%.1f", st.rate);
+			snprintf(name, sizeof(name), "%s.%u.send-bytes-per-sec",
+					stress_procname(procs[i]), 4 * step_opt.num_ints);
+			rpctest_results_set(res, name, "%.0f", st.bytes_sent / st.elapsed);
+			snprintf(name, sizeof(name), "%s.%u.recv-bytes-per-sec",
+					stress_procname(procs[i]), 4 * step_opt.num_ints);
+			rpctest_results_set(res, name, "%.0f", st.bytes_recv / st.elapsed);
+		}
+	}
+	rpctest_results_set_placement(res, "client", &cpus);
+
+	if (opt.results_file && rpctest_results_write(res, opt.results_file) < 0)
+		exitval = 1;
+	if (stress_check_results(&opt, res) != 0)
+		exitval = 1;
+
+out:
+	rpctest_results_free(res);
+	rpctest_slo_free(opt.slo, opt.num_slo);
+	return exitval;
+}
+
+/*
+ * Find the IPv4 address of the server, for port=
+ */
+static int
+stress_resolve(const char *hostname, unsigned int port, struct sockaddr_storage *ss, socklen_t *alen)
+{
+	struct addrinfo hints, *res;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(hostname, NULL, &hints, &res) != 0) {
+		log_error("unable to resolve hostname \"%s\"", hostname);
+		return -1;
+	}
+
+	memset(ss, 0, sizeof(*ss));
+	memcpy(ss, res->ai_addr, res->ai_addrlen);
+	((struct sockaddr_in *) ss)->sin_port = htons(port);
+	*alen = res->ai_addrlen;
+	freeaddrinfo(res);
+	return 0;
+}
+
 struct sumclnt *
 sumclnt_new(const char *hostname, struct stress_opts *opt)
 {
@@ -310,14 +1481,21 @@ sumclnt_new(const char *hostname, struct stress_opts *opt)
 	abuf.buf = &clnt->svc_addr;
 	abuf.len = abuf.maxlen = sizeof(clnt->svc_addr);
 
-	nconf = getnetconfigent("tcp");
+	if (opt->port) {
+		if (stress_resolve(hostname, opt->port, &clnt->svc_addr, &clnt->svc_addrlen) < 0)
+			exit(1);
+	} else {
+		nconf = getnetconfigent("tcp");
 
-	if (!rpcb_getaddr(SQUARE_PROG, SQUARE_VERS, nconf, &abuf, hostname))
-		log_fatal("Cannot find square service on host %s", hostname);
-	freenetconfigent(nconf);
-	clnt->svc_addrlen = abuf.len;
+		if (!rpcb_getaddr(SQUARE_PROG, SQUARE_VERS, nconf, &abuf, hostname))
+			log_fatal("Cannot find square service on host %s", hostname);
+		freenetconfigent(nconf);
+		clnt->svc_addrlen = abuf.len;
+	}
 
 	clnt->jobs = calloc(opt->njobs, sizeof(clnt->jobs[0]));
+	latency_init(&clnt->call_latency);
+	latency_init(&clnt->slow_latency);
 
 	/* Send histogram is 0..500 msec */
 	hist_init(&clnt->send_histogram, 500 * 1e-3);
@@ -349,10 +1527,11 @@ int
 sumclnt_poll(struct sumclnt *clnt)
 {
 	struct pollfd *pfd;
-	struct timeout timeout;
+	struct timeout timeout, pause;
 	unsigned int i, nfds;
 
 	timeout_init(&timeout, 10000);
+	timeout_init(&pause, -1);
 
 	pfd = alloca(clnt->conf.njobs * sizeof(pfd[0]));
 	for (i = nfds = 0; i < clnt->conf.njobs; ++i) {
@@ -360,7 +1539,7 @@ sumclnt_poll(struct sumclnt *clnt)
 		struct pollfd *p;
 
 		if (job == NULL) {
-			job = sumjob_new(clnt, i, random() % 65536);
+			job = sumjob_new(clnt, i, clnt->conf.num_ints? : random() % 65536);
 			if (job == NULL)
 				log_fatal("Unable to create new sum job");
 			if (sumjob_connect(clnt, job) < 0) {
@@ -382,7 +1561,12 @@ sumclnt_poll(struct sumclnt *clnt)
 		if (job->send.pos >= job->send.len) {
 			/* We already sent everything. */
 			p->events = POLLIN;
+		} else
+		if (timerisset(&job->send.resume) && timeout_update(&pause, &job->send.resume) >= 0) {
+			/* Slow sender, taking a break */
+			job->last_activity = 'z';
 		} else {
+			timerclear(&job->send.resume);
 			p->events = POLLOUT | POLLHUP;
 			job->last_activity = '.';
 		}
@@ -391,6 +1575,9 @@ sumclnt_poll(struct sumclnt *clnt)
 		p->revents = 0;
 	}
 
+	if (timeout_value(&pause) >= 0 && timeout_value(&pause) < timeout_value(&timeout))
+		timeout = pause;
+
 	if (poll(pfd, nfds, timeout_value(&timeout)) < 0)
 		log_fatal("poll: %m");
 
@@ -450,7 +1637,8 @@ sumclnt_poll(struct sumclnt *clnt)
 		}
 		printf(":\n");
 		fflush(stdout);
-	} else {
+	} else
+	if (!clnt->conf.quiet) {
 		static time_t next_report;
 		time_t now = time(NULL);
 
@@ -517,6 +1705,12 @@ sumjob_connect(struct sumclnt *clnt, struct sumjob *job)
 		}
 	}
 
+	if (clnt->conf.nodelay) {
+		int on = 1;
+
+		setsockopt(job->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+
 	/* Set NDELAY for non-blocking connect */
 	fcntl(job->fd, F_SETFL, O_NDELAY);
 
@@ -560,7 +1754,10 @@ sumjob_send(struct sumclnt *clnt, struct sumjob *job)
 	}
 
 	avail = job->send.len - job->send.pos;
-	nbytes = random() % job->send.len;
+	if (job->slow)
+		nbytes = (job->send.len + 3) / 4;
+	else
+		nbytes = random() % job->send.len;
 	if (nbytes == 0)
 		nbytes = 1;
 	else if (nbytes > avail)
@@ -574,14 +1771,19 @@ sumjob_send(struct sumclnt *clnt, struct sumjob *job)
 
 	job->last_activity = 'x';
 	job->send.pos += rv;
+	clnt->bytes_sent += rv;
 	nbytes = rv;
 
 	if (job->send.pos >= job->send.len) {
 		/* We sent everything */
 		job->last_activity = 'X';
 
-		sumclnt_record_send_delay(clnt, job);
+		if (!job->slow)
+			sumclnt_record_send_delay(clnt, job);
 		gettimeofday(&job->recv.begin, NULL);
+	} else
+	if (job->slow) {
+		__sumjob_set_timeout(&job->send.resume, clnt->conf.slow_delay);
 	}
 
 	return 0;
@@ -591,6 +1793,8 @@ static int
 sumjob_recv(struct sumclnt *clnt, struct sumjob *job)
 {
 	unsigned int want;
+	unsigned char *dst;
+	int marker = 0;
 	int rv;
 
 	if (job->recv.buf == NULL) {
@@ -598,14 +1802,27 @@ sumjob_recv(struct sumclnt *clnt, struct sumjob *job)
 		job->recv.size = 1024;
 
 		if (job->proto == IPPROTO_TCP) {
-			job->recv.len = 4; /* receive record marker first */
+			job->recv.len = ~0U; /* until we've seen the last fragment */
 		} else {
 			job->recv.len = job->recv.size;
 		}
 	}
 
-	want = job->recv.len - job->recv.pos;
-	rv = recv(job->fd, job->recv.buf + job->recv.pos, want, MSG_DONTWAIT);
+	if (job->proto != IPPROTO_TCP) {
+		dst = job->recv.buf + job->recv.pos;
+		want = job->recv.len - job->recv.pos;
+	} else
+	if (job->recv.frag_left == 0) {
+		/* Receive the next record marker */
+		dst = job->recv.marker + job->recv.marker_pos;
+		want = 4 - job->recv.marker_pos;
+		marker = 1;
+	} else {
+		dst = job->recv.buf + job->recv.pos;
+		want = job->recv.frag_left;
+	}
+
+	rv = recv(job->fd, dst, want, MSG_DONTWAIT);
 	if (rv == 0) {
 		log_error("%s: unexpected end of file on socket", __func__);
 		return -1;
@@ -616,36 +1833,63 @@ sumjob_recv(struct sumclnt *clnt, struct sumjob *job)
 	}
 
 	job->last_activity = 'r';
-	job->recv.pos += rv;
-	if (job->proto == IPPROTO_TCP && job->recv.pos == 4 && job->recv.len == 4) {
-		uint32_t marker;
+	clnt->bytes_recv += rv;
 
-		/* We received the record marker */
-		memcpy(&marker, job->recv.buf, 4);
-		marker = ntohl(marker);
-		if (!(marker & 0x80000000))
-			log_fatal("%s: TCP record without last-record marker", __func__);
-		marker &= 0x7fffffff;
+	if (marker) {
+		uint32_t value;
 
-		if (marker < 16)
-			log_fatal("%s: short RPC record from server (%u bytes)", __func__, marker);
-		job->recv.len = marker;
-		job->recv.pos = 0;
+		job->recv.marker_pos += rv;
+		if (job->recv.marker_pos < 4)
+			return 0;
+
+		/* We received the record marker */
+		memcpy(&value, job->recv.marker, 4);
+		value = ntohl(value);
+		job->recv.marker_pos = 0;
+		job->recv.last_frag = !!(value & 0x80000000);
+		job->recv.frag_left = value & 0x7fffffff;
+
+		if (job->recv.last_frag && job->recv.pos + job->recv.frag_left < 16)
+			log_fatal("%s: short RPC record from server (%u bytes)", __func__,
+					job->recv.pos + job->recv.frag_left);
+
+		if (job->recv.pos + job->recv.frag_left > job->recv.size) {
+			job->recv.size = job->recv.pos + job->recv.frag_left;
+			job->recv.buf = realloc(job->recv.buf, job->recv.size);
+			if (job->recv.buf == NULL)
+				log_fatal("%s: out of memory", __func__);
+		}
+	} else {
+		job->recv.pos += rv;
+		if (job->proto == IPPROTO_TCP)
+			job->recv.frag_left -= rv;
 	}
 
+	if (job->proto == IPPROTO_TCP && job->recv.last_frag && job->recv.frag_left == 0)
+		job->recv.len = job->recv.pos;
+
 	if (job->recv.pos >= job->recv.len) {
 		/* We've received the entire message */
 		if (sumjob_check_reply(job) < 0)
 			log_fatal("%s: bad reply from server", __func__);
 
-		sumclnt_record_recv_delay(clnt, job);
 		job->last_activity = 'R';
 		job->ncalls++;
-		clnt->ncalls++;
+		if (job->slow) {
+			latency_add_since(&clnt->slow_latency, job->call_begin);
+			clnt->slow_calls++;
+
+			/* Every call takes a while, don't count that against us */
+			sumjob_set_timeout(clnt, job);
+		} else {
+			sumclnt_record_recv_delay(clnt, job);
+			latency_add_since(&clnt->call_latency, job->call_begin);
+			clnt->ncalls++;
+		}
 
 		if (job->ncalls < job->max_calls) {
 			sumjob_drop_buffers(job);
-			if (!sumjob_build_packet(job) < 0)
+			if (!sumjob_build_packet(clnt, job) < 0)
 				log_fatal("Failed to rebuild packet");
 		} else {
 			job->last_activity = '@';
@@ -661,13 +1905,33 @@ sumjob_check_reply(struct sumjob *job)
 {
 	struct rpc_msg msg;
 	u_int32_t sum = 12345678;
+	square_out square;
+	square_bulk bulk;
 	XDR xdrs;
 	int rv = -1;
 
 	memset(&msg, 0, sizeof(msg));
-
-	msg.rm_reply.rp_acpt.ar_results.where = (caddr_t) &sum;
-	msg.rm_reply.rp_acpt.ar_results.proc = (xdrproc_t) xdr_u_int;
+	memset(&bulk, 0, sizeof(bulk));
+
+	switch (job->proc) {
+	case SINKPROC:
+	case WORKPROC:
+		msg.rm_reply.rp_acpt.ar_results.proc = (xdrproc_t) xdr_void;
+		break;
+	case SQUAREPROC:
+		msg.rm_reply.rp_acpt.ar_results.where = (caddr_t) &square;
+		msg.rm_reply.rp_acpt.ar_results.proc = (xdrproc_t) xdr_square_out;
+		break;
+	case ECHOPROC:
+	case GENPROC:
+		msg.rm_reply.rp_acpt.ar_results.where = (caddr_t) &bulk;
+		msg.rm_reply.rp_acpt.ar_results.proc = (xdrproc_t) xdr_square_bulk;
+		break;
+	default:
+		msg.rm_reply.rp_acpt.ar_results.where = (caddr_t) &sum;
+		msg.rm_reply.rp_acpt.ar_results.proc = (xdrproc_t) xdr_u_int;
+		break;
+	}
 
 	xdrmem_create(&xdrs, (char *) job->recv.buf, job->recv.len, XDR_DECODE);
 	if (!xdr_replymsg(&xdrs, &msg)) {
@@ -692,14 +1956,30 @@ sumjob_check_reply(struct sumjob *job)
 		goto failed;
 	}
 
-	if (sum != job->sum) {
+	if (job->proc == SUMPROC && sum != job->sum) {
 		log_error("Reply has wrong sum (expect %u, got %u)", job->sum, sum);
 		goto failed;
 	}
+	if (job->proc == SQUAREPROC && square.res1 != job->square_arg * job->square_arg) {
+		log_error("Reply has wrong square (expect %ld, got %ld)",
+				job->square_arg * job->square_arg, square.res1);
+		goto failed;
+	}
+	if ((job->proc == ECHOPROC || job->proc == GENPROC)
+	 && bulk.square_bulk_len != 4 * job->num_ints) {
+		log_error("Reply has wrong size (expect %u, got %u)", 4 * job->num_ints, bulk.square_bulk_len);
+		goto failed;
+	}
+	if (job->proc == ECHOPROC
+	 && memcmp(bulk.square_bulk_val, job->send.buf + job->payload_pos, bulk.square_bulk_len)) {
+		log_error("Reply does not match the data we sent");
+		goto failed;
+	}
 
 	rv = 0;
 
 failed:
+	xdr_free((xdrproc_t) xdr_square_bulk, (char *) &bulk);
 	xdr_free((xdrproc_t) xdr_callmsg, &msg);
 	xdr_destroy(&xdrs);
 	return rv;
@@ -735,6 +2015,7 @@ sumjob_new(struct sumclnt *clnt, unsigned int jobid, unsigned int num_ints)
 
 	job->max_calls = random() % clnt->conf.max_calls;
 	job->num_ints = num_ints;
+	job->slow = jobid < clnt->conf.slow_jobs;
 
 	gettimeofday(&job->ctime, NULL);
 
@@ -745,7 +2026,7 @@ sumjob_new(struct sumclnt *clnt, unsigned int jobid, unsigned int num_ints)
 	job->xid = xid;
 	job->xid += job->max_calls;
 
-	if (sumjob_build_packet(job) < 0) {
+	if (sumjob_build_packet(clnt, job) < 0) {
 		sumjob_free(job);
 		return NULL;
 	}
@@ -754,7 +2035,7 @@ sumjob_new(struct sumclnt *clnt, unsigned int jobid, unsigned int num_ints)
 }
 
 static int
-sumjob_build_packet(struct sumjob *job)
+sumjob_build_packet(const struct sumclnt *clnt, struct sumjob *job)
 {
 	unsigned int *input = NULL;
 	struct rpc_msg msg;
@@ -781,18 +2062,60 @@ sumjob_build_packet(struct sumjob *job)
 	msg.rm_call.cb_rpcvers = 2;
 	msg.rm_call.cb_prog = SQUARE_PROG;
 	msg.rm_call.cb_vers = SQUARE_VERS;
-	msg.rm_call.cb_proc = SUMPROC;
+	job->proc = stress_pick_proc(&clnt->conf);
+	msg.rm_call.cb_proc = job->proc;
 	if (!xdr_callmsg(&xdrs, &msg)) {
 		log_error("failed to encode rpc message");
 		goto out;
 	}
 
+	if (job->proc == SQUAREPROC) {
+		square_in in;
+
+		in.arg1 = job->square_arg = random() % 65536;
+		if (!xdr_square_in(&xdrs, &in))
+			goto out;
+		goto done;
+	}
+
+	if (job->proc == WORKPROC) {
+		square_work work;
+
+		work.spin_usec = stress_dist_sample(&clnt->conf.work_spin);
+		work.sleep_usec = stress_dist_sample(&clnt->conf.work_sleep);
+		work.mem_kb = clnt->conf.work_mem_kb;
+		if (!xdr_square_work(&xdrs, &work))
+			goto out;
+		goto done;
+	}
+
+	if (job->proc == GENPROC) {
+		u_int count = 4 * job->num_ints;
+
+		if (!xdr_u_int(&xdrs, &count))
+			goto out;
+		goto done;
+	}
+
 	input = calloc(job->num_ints, sizeof(input[0]));
 	for (i = 0, job->sum = 0; i < job->num_ints; ++i) {
 		input[i] = random();
 		job->sum += input[i];
 	}
 
+	if (job->proc == ECHOPROC) {
+		square_bulk bulk;
+
+		bulk.square_bulk_val = (char *) input;
+		bulk.square_bulk_len = 4 * job->num_ints;
+
+		/* The payload follows the length word */
+		job->payload_pos = xdr_getpos(&xdrs) + 4;
+		if (!xdr_square_bulk(&xdrs, &bulk))
+			goto out;
+		goto done;
+	}
+
 	memset(&args, 0, sizeof(args));
 	args.buffer.buffer_val = input;
 	args.buffer.buffer_len = job->num_ints;
@@ -800,6 +2123,7 @@ sumjob_build_packet(struct sumjob *job)
 	if (!xdr_foodata(&xdrs, &args))
 		goto out;
 
+done:
 	job->send.len = xdr_getpos(&xdrs);
 
 	/* Update the record marker */
@@ -826,6 +2150,7 @@ sumjob_build_packet(struct sumjob *job)
 	/* Count xmit time from the point where we built the
 	 * packet */
 	gettimeofday(&job->send.begin, NULL);
+	job->call_begin = rpctest_time();
 
 out:
 	xdr_destroy(&xdrs);
@@ -953,7 +2278,8 @@ timeout_update(struct timeout *tmo, const struct timeval *expire)
 	if (value == 0)
 		return -1;
 
-	tmo->current = value;
+	if (tmo->current < 0 || value < tmo->current)
+		tmo->current = value;
 	return value;
 }
 
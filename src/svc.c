@@ -60,6 +60,8 @@ static RPCB		local_reg[] = {
 static unsigned int	num_transports;
 static SVCXPRT *	all_transports[64];
 
+static struct rpctest_svc_bufsizes svc_bufsizes;
+
 static void	rpctest_verify_svc_register_nettype(const char *);
 static void	rpctest_verify_svc_bindings(const RPCB *);
 static void	rpctest_svc_free_all(void);
@@ -77,6 +79,11 @@ rpctest_verify_svc_register(void)
 
 	log_test_group("svcreg", "Verify service registration functions");
 
+	rpctest_rpcb_fixup(square_regs);
+	rpctest_rpcb_fixup(ipv4_reg);
+	rpctest_rpcb_fixup(ipv6_reg);
+	rpctest_rpcb_fixup(local_reg);
+
 	unsetenv("NETPATH");
 
 	nettypes = rpctest_get_nettypes();
@@ -87,7 +94,7 @@ rpctest_verify_svc_register(void)
 	rpctest_verify_svc_bindings(ipv6_reg);
 	rpctest_verify_svc_bindings(local_reg);
 
-	unlink(SQUARE_LOCAL_ADDR);
+	unlink(rpctest_local_addr);
 }
 
 void
@@ -118,7 +125,7 @@ done:
 
 	/* FIXME: verify that the program is no longer registered */
 
-	rpctest_rpcb_unset_wildcard(SQUARE_PROG);
+	rpctest_rpcb_unset_wildcard(rpctest_prog);
 }
 
 void
@@ -138,13 +145,88 @@ done:
 
 	/* FIXME: verify that the program is no longer registered */
 
-	rpctest_rpcb_unset_wildcard(SQUARE_PROG);
+	rpctest_rpcb_unset_wildcard(rpctest_prog);
+}
+
+void
+rpctest_svc_set_bufsizes(const struct rpctest_svc_bufsizes *bs)
+{
+	svc_bufsizes = *bs;
+}
+
+/*
+ * Returns 1 if any of the buffer sizes has been set
+ */
+int
+rpctest_svc_get_bufsizes(struct rpctest_svc_bufsizes *bs)
+{
+	if (bs)
+		*bs = svc_bufsizes;
+	return svc_bufsizes.sendsz || svc_bufsizes.recvsz
+	    || svc_bufsizes.sndbuf || svc_bufsizes.rcvbuf;
+}
+
+/*
+ * Apply the configured SO_SNDBUF and SO_RCVBUF. Connections accepted
+ * on a listening socket inherit them.
+ */
+void
+rpctest_svc_set_sockbufs(int fd)
+{
+	if (svc_bufsizes.sndbuf
+	 && setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &svc_bufsizes.sndbuf, sizeof(svc_bufsizes.sndbuf)) < 0)
+		log_error("unable to set SO_SNDBUF to %u: %m", svc_bufsizes.sndbuf);
+	if (svc_bufsizes.rcvbuf
+	 && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &svc_bufsizes.rcvbuf, sizeof(svc_bufsizes.rcvbuf)) < 0)
+		log_error("unable to set SO_RCVBUF to %u: %m", svc_bufsizes.rcvbuf);
+}
+
+/*
+ * svc_tli_create with the configured buffer sizes. With RPC_ANYFD,
+ * libtirpc creates and binds the socket for us.
+ */
+SVCXPRT *
+rpctest_svc_tli_create(int fd, const struct netconfig *nconf)
+{
+	SVCXPRT *xprt;
+
+	if (fd != RPC_ANYFD)
+		rpctest_svc_set_sockbufs(fd);
+
+	xprt = svc_tli_create(fd, nconf, NULL, svc_bufsizes.sendsz, svc_bufsizes.recvsz);
+	if (xprt && fd == RPC_ANYFD)
+		rpctest_svc_set_sockbufs(xprt->xp_fd);
+	return xprt;
+}
+
+/*
+ * Same as svc_tp_create, but with the configured buffer sizes. If
+ * none are set, we leave it to libtirpc, which is what the test
+ * cases want to exercise.
+ */
+SVCXPRT *
+rpctest_svc_tp_create(rpc_program_fn_t *dispatch, rpcprog_t prog, rpcvers_t vers, const struct netconfig *nconf)
+{
+	SVCXPRT *xprt;
+
+	if (!rpctest_svc_get_bufsizes(NULL))
+		return svc_tp_create(dispatch, prog, vers, nconf);
+
+	if ((xprt = rpctest_svc_tli_create(RPC_ANYFD, nconf)) == NULL)
+		return NULL;
+
+	(void) rpcb_unset(prog, vers, (struct netconfig *) nconf);
+	if (!svc_reg(xprt, prog, vers, dispatch, nconf)) {
+		svc_destroy(xprt);
+		return NULL;
+	}
+	return xprt;
 }
 
 int
 rpctest_register_service_nettype(unsigned long prog, unsigned long vers, rpc_program_fn_t *progfn, const char *nettype)
 {
-	if (!svc_create(progfn, prog, vers, nettype)) {
+	if (!rpctest_svc_create(progfn, prog, vers, nettype)) {
 		fprintf (stderr, "unable to register (%lu, %lu, nettype=%s).\n", prog, vers, nettype);
 		return 0;
 	}
@@ -154,6 +236,18 @@ rpctest_register_service_nettype(unsigned long prog, unsigned long vers, rpc_pro
 
 int
 rpctest_svc_register_rpcb(const RPCB *rpcb, rpc_program_fn_t *dispatch)
+{
+	return rpctest_svc_register_rpcb_flags(rpcb, dispatch, 0);
+}
+
+/*
+ * With SVF_REUSEPORT, sockets bound to an explicit address are created
+ * with SO_REUSEPORT, so that several processes can serve the same port.
+ * With SVF_NOREG, the transports are created but not registered with
+ * rpcbind (because some other process already did).
+ */
+int
+rpctest_svc_register_rpcb_flags(const RPCB *rpcb, rpc_program_fn_t *dispatch, int flags)
 {
 	const RPCB *rb;
 	int success = 1;
@@ -170,7 +264,7 @@ rpctest_svc_register_rpcb(const RPCB *rpcb, rpc_program_fn_t *dispatch)
 			/* Don't create */
 		} else
 		if (!strcmp(rb->r_addr, "*")) {
-			xprt = svc_tp_create(dispatch, rb->r_prog, rb->r_vers, nconf);
+			xprt = rpctest_svc_tp_create(dispatch, rb->r_prog, rb->r_vers, nconf);
 			if (xprt == NULL) {
 				log_fail("svc_tp_create(%lu, %lu, %s) failed",
 						rb->r_prog, rb->r_vers, rb->r_netid);
@@ -199,21 +293,33 @@ rpctest_svc_register_rpcb(const RPCB *rpcb, rpc_program_fn_t *dispatch)
 				goto create_failed;
 			}
 
+			if (flags & SVF_REUSEPORT) {
+				int one = 1;
+
+				if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+					log_fail("Unable to set SO_REUSEPORT on %s socket: %m", rb->r_netid);
+					goto create_failed;
+				}
+			}
+
 			if (bind(fd, (struct sockaddr *) nb->buf, nb->len) < 0) {
 				log_fail("Unable to bind %s socket to address %s: %m", rb->r_netid, rb->r_addr);
 				goto create_failed;
 			}
 
-			/* If it's a SOCK_STREAM, we want to listen on it */
-			(void) listen(fd, 0);
+			/* If it's a SOCK_STREAM, we want to listen on it.
+			 * Shared ports are for benchmarking, so give them
+			 * a real backlog */
+			(void) listen(fd, (flags & SVF_REUSEPORT)? SOMAXCONN : 0);
 
-			xprt = svc_tli_create(fd, nconf, NULL, 0, 0);
+			xprt = rpctest_svc_tli_create(fd, nconf);
 			if (xprt == NULL) {
 				log_fail("svc_tli_create(%s) failed", rb->r_netid);
 				goto create_failed;
 			}
 
-			if (!svc_reg(xprt, rb->r_prog, rb->r_vers, dispatch, nconf)) {
+			if (!svc_reg(xprt, rb->r_prog, rb->r_vers, dispatch,
+						(flags & SVF_NOREG)? NULL : nconf)) {
 				log_fail("svc_reg(%lu, %lu, %s, %s) failed",
 						rb->r_prog, rb->r_vers, rb->r_netid, rb->r_addr);
 				svc_destroy(xprt);
@@ -240,6 +346,160 @@ create_failed:
 	return success;
 }
 
+/*
+ * Register the transports created from inherited sockets with rpcbind.
+ * rpcb_set and rpcb_unset connect to rpcbind anew for every call; here,
+ * we use a single connection to drop whatever a previous incarnation of
+ * the service registered, and then add one mapping per transport.
+ */
+static int
+__rpctest_svc_register_batch(rpcprog_t prog, rpcvers_t vers, SVCXPRT **xprts, unsigned int count)
+{
+	struct timeval timeout = { 5, 0 };
+	char *tgtaddr = NULL, owner[32];
+	enum clnt_stat status;
+	unsigned int i;
+	CLIENT *clnt;
+	RPCB parms;
+	bool_t result;
+	int success = 1;
+
+	clnt = rpctest_rpcb_client("local", NULL, RPCBVERS, &tgtaddr);
+	if (clnt == NULL)
+		return 0;
+	free(tgtaddr);
+
+	snprintf(owner, sizeof(owner), "%d", (int) geteuid());
+	memset(&parms, 0, sizeof(parms));
+	parms.r_prog = prog;
+	parms.r_vers = vers;
+	parms.r_owner = owner;
+
+	/* An empty netid unsets all of them */
+	parms.r_netid = "";
+	parms.r_addr = "";
+	status = clnt_call(clnt, RPCBPROC_UNSET,
+			(xdrproc_t) xdr_rpcb, (caddr_t) &parms,
+			(xdrproc_t) xdr_bool, (caddr_t) &result,
+			timeout);
+	if (status != RPC_SUCCESS) {
+		log_fail("rpcbind UNSET(%lu, %lu) failed: %s", prog, vers, clnt_sperrno(status));
+		success = 0;
+		goto out;
+	}
+
+	for (i = 0; i < count; ++i) {
+		SVCXPRT *xprt = xprts[i];
+		struct netconfig *nconf;
+
+		if ((nconf = getnetconfigent(xprt->xp_netid)) == NULL) {
+			log_fail("Bad netid %s", xprt->xp_netid);
+			success = 0;
+			continue;
+		}
+
+		parms.r_netid = xprt->xp_netid;
+		parms.r_addr = taddr2uaddr(nconf, &xprt->xp_ltaddr);
+		freenetconfigent(nconf);
+		if (parms.r_addr == NULL) {
+			log_fail("cannot get universal address of %s transport", xprt->xp_netid);
+			success = 0;
+			continue;
+		}
+
+		result = FALSE;
+		status = clnt_call(clnt, RPCBPROC_SET,
+				(xdrproc_t) xdr_rpcb, (caddr_t) &parms,
+				(xdrproc_t) xdr_bool, (caddr_t) &result,
+				timeout);
+		if (status != RPC_SUCCESS || !result) {
+			log_fail("rpcbind SET(%lu, %lu, %s, %s) failed: %s",
+					prog, vers, parms.r_netid, parms.r_addr,
+					status != RPC_SUCCESS? clnt_sperrno(status) : "refused");
+			success = 0;
+		}
+		free(parms.r_addr);
+	}
+
+out:
+	clnt_destroy(clnt);
+	return success;
+}
+
+/*
+ * Serve a program on sockets we inherited, eg from systemd socket
+ * activation (LISTEN_FDS) or a supervisor that bound them before
+ * starting us. The sockets must be bound already; stream sockets that
+ * are not listening yet are put into listening state. Unless SVF_NOREG
+ * is given, the transports are registered with rpcbind in one batch.
+ */
+int
+rpctest_svc_register_fds(const int *fds, unsigned int nfds, rpcprog_t prog, rpcvers_t vers,
+			rpc_program_fn_t *dispatch, int flags)
+{
+	SVCXPRT *xprts[64];
+	unsigned int i, count = 0;
+
+	if (nfds > 64) {
+		log_fail("too many sockets (%u)", nfds);
+		return 0;
+	}
+
+	for (i = 0; i < nfds; ++i) {
+		struct __rpc_sockinfo si;
+		struct netconfig *nconf;
+		const char *netid;
+		SVCXPRT *xprt;
+		int fd = fds[i];
+
+		if (!__rpc_fd2sockinfo(fd, &si) || !__rpc_sockinfo2netid(&si, &netid)) {
+			log_fail("fd %d is not a socket for any known netid", fd);
+			return 0;
+		}
+
+		if (!__rpc_sockisbound(fd)) {
+			log_fail("%s socket (fd %d) is not bound", netid, fd);
+			return 0;
+		}
+
+		if (si.si_socktype == SOCK_STREAM) {
+			socklen_t len = sizeof(int);
+			int listening = 0;
+
+			(void) getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len);
+			if (!listening && listen(fd, SOMAXCONN) < 0) {
+				log_fail("unable to listen on %s socket (fd %d): %m", netid, fd);
+				return 0;
+			}
+		}
+
+		if ((nconf = getnetconfigent(netid)) == NULL)
+			log_fatal("Bad netid %s", netid);
+
+		xprt = rpctest_svc_tli_create(fd, nconf);
+		freenetconfigent(nconf);
+		if (xprt == NULL) {
+			log_fail("svc_tli_create(%s, fd %d) failed", netid, fd);
+			return 0;
+		}
+
+		/* Don't talk to rpcbind yet */
+		if (!svc_reg(xprt, prog, vers, dispatch, NULL)) {
+			log_fail("svc_reg(%lu, %lu, %s) failed", prog, vers, netid);
+			svc_destroy(xprt);
+			return 0;
+		}
+
+		xprts[count++] = xprt;
+		all_transports[num_transports++] = xprt;
+	}
+
+	if (flags & SVF_NOREG)
+		return 1;
+
+	return __rpctest_svc_register_batch(prog, vers, xprts, count);
+}
+
 void
 rpctest_svc_cleanup(RPCB *rblist)
 {
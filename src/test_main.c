@@ -21,11 +21,235 @@
  *
  * Test suite main function
  */
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <getopt.h>
+#include <fnmatch.h>
 #include "rpctest.h"
 
 static int	opt_flags;
 
+struct rpctest_group {
+	const char *	name;
+	const char *	description;
+	void		(*run)(void);
+};
+
+#define MAX_PATTERNS	32
+
+struct rpctest_filter {
+	unsigned int	count;
+	const char *	pattern[MAX_PATTERNS];
+};
+
+static struct rpctest_filter	opt_only;
+static struct rpctest_filter	opt_skip;
+
+static void
+rpctest_run_pmap(void)
+{
+	rpctest_verify_pmap_all(opt_flags);
+}
+
+static void
+rpctest_run_rpcb(void)
+{
+	rpctest_verify_rpcb_all(opt_flags);
+}
+
+/*
+ * Groups that do not depend on each other, in the order in which
+ * they are run and reported.
+ */
+static struct rpctest_group	rpctest_groups[] = {
+	{ "netpath",	"netpath functions",			rpctest_verify_netpath_all	},
+	{ "netconfig",	"netconfig functions",			rpctest_verify_netconfig_all	},
+	{ "sockinfo",	"sockinfo functions",			rpctest_verify_sockinfo_all	},
+	{ "addrconv",	"uaddr2taddr/taddr2uaddr functions",	rpctest_verify_addrconv_all	},
+	{ "socket",	"socket functions",			rpctest_verify_sockets_all	},
+	{ "portmap",	"portmap client functions",		rpctest_run_pmap		},
+	{ "rpcbind",	"rpcbind client functions",		rpctest_run_rpcb		},
+	{ "svcreg",	"service registration functions",	rpctest_verify_svc_register	},
+	{ "client",	"client functions",			rpctest_verify_clnt_funcs	},
+	{ "xdr",	"XDR decoders",				rpctest_verify_xdr_all		},
+	{ NULL }
+};
+
+#define NUM_GROUPS	(sizeof(rpctest_groups) / sizeof(rpctest_groups[0]) - 1)
+
+/*
+ * --only and --skip take comma separated lists of glob patterns,
+ * and can be given more than once. A pattern without a dot is matched
+ * against group names, one with a dot against test names, which are
+ * the group name and the test's tag, e.g. netconfig.udp6 or
+ * client.testcase12.
+ */
+static void
+rpctest_filter_add(struct rpctest_filter *f, char *arg)
+{
+	char *s;
+
+	for (s = strtok(arg, ","); s; s = strtok(NULL, ",")) {
+		if (f->count >= MAX_PATTERNS)
+			log_fatal("too many test group patterns");
+		f->pattern[f->count++] = s;
+	}
+}
+
+/*
+ * Match a pattern against a test, or against a group if test is NULL.
+ * For groups, test patterns match if their group part does.
+ */
+static int
+rpctest_pattern_match(const char *pattern, const char *group, const char *test)
+{
+	const char *dot = strchr(pattern, '.');
+	char buffer[256];
+
+	if (dot == NULL)
+		return fnmatch(pattern, group, 0) == 0;
+
+	if (test == NULL) {
+		snprintf(buffer, sizeof(buffer), "%.*s", (int) (dot - pattern), pattern);
+		return fnmatch(buffer, group, 0) == 0;
+	}
+
+	snprintf(buffer, sizeof(buffer), "%s.%s", group, test);
+	return fnmatch(pattern, buffer, 0) == 0;
+}
+
+static int
+rpctest_filter_match(const struct rpctest_filter *f, const char *group, const char *test)
+{
+	unsigned int i;
+
+	for (i = 0; i < f->count; ++i) {
+		if (rpctest_pattern_match(f->pattern[i], group, test))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * A group is run if it may contain a selected test. Test patterns in
+ * --skip leave the rest of the group, so they don't skip it.
+ */
+static int
+rpctest_group_selected(const struct rpctest_group *g)
+{
+	unsigned int i;
+
+	if (opt_only.count && !rpctest_filter_match(&opt_only, g->name, NULL))
+		return 0;
+
+	for (i = 0; i < opt_skip.count; ++i) {
+		if (!strchr(opt_skip.pattern[i], '.') && fnmatch(opt_skip.pattern[i], g->name, 0) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Called by log_test* for every test of a group we run
+ */
+static int
+rpctest_test_selected(const char *group, const char *test)
+{
+	if (opt_only.count && !rpctest_filter_match(&opt_only, group, test))
+		return 0;
+	return !rpctest_filter_match(&opt_skip, group, test);
+}
+
+struct rpctest_worker {
+	pid_t		pid;
+	FILE *		output;
+	int		status;
+};
+
+/*
+ * Run group number i in a child process. It registers a program
+ * number and local socket of its own, so that it does not trip over
+ * the registrations of the other workers, and logs into a temporary
+ * file that the parent replays when the worker is done.
+ */
+static void
+rpctest_start_worker(unsigned int i, struct rpctest_worker *w)
+{
+	static char local_addr[128];
+
+	if ((w->output = tmpfile()) == NULL)
+		log_fatal("unable to create temporary file: %m");
+
+	fflush(stdout);
+	fflush(stderr);
+
+	w->pid = fork();
+	if (w->pid < 0)
+		log_fatal("unable to fork: %m");
+
+	if (w->pid == 0) {
+		dup2(fileno(w->output), 1);
+		dup2(fileno(w->output), 2);
+
+		snprintf(local_addr, sizeof(local_addr), "%s.%u", SQUARE_LOCAL_ADDR, i + 1);
+		rpctest_set_program(SQUARE_PROG + i + 1, local_addr);
+
+		log_capture();
+		rpctest_groups[i].run();
+		log_capture_finish();
+		exit(0);
+	}
+}
+
+static void
+rpctest_run_parallel(const unsigned int *groups, unsigned int ngroups, unsigned int njobs)
+{
+	struct rpctest_worker workers[NUM_GROUPS];
+	unsigned int started = 0, running = 0, replayed = 0, i;
+	int status;
+	pid_t pid;
+
+	while (replayed < ngroups) {
+		while (running < njobs && started < ngroups) {
+			rpctest_start_worker(groups[started], &workers[started]);
+			started++;
+			running++;
+		}
+
+		/* Report finished groups in order */
+		if (workers[replayed].pid == 0) {
+			struct rpctest_worker *w = &workers[replayed];
+
+			rewind(w->output);
+			log_replay(w->output);
+			fclose(w->output);
+
+			if (!WIFEXITED(w->status) || WEXITSTATUS(w->status) != 0) {
+				log_error("test group %s: worker exited abnormally (status 0x%x)",
+						rpctest_groups[groups[replayed]].name, w->status);
+				num_fails++;
+			}
+			replayed++;
+			continue;
+		}
+
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0)
+			log_fatal("waitpid: %m");
+
+		for (i = 0; i < started; ++i) {
+			if (workers[i].pid == pid) {
+				workers[i].pid = 0;
+				workers[i].status = status;
+				running--;
+			}
+		}
+	}
+}
+
 int
 main(int argc, char **argv)
 {
@@ -35,14 +259,22 @@ main(int argc, char **argv)
 		{ "quiet",		no_argument,		NULL,	'q' },
 		{ "log-format",		required_argument,	NULL,	'l' },
 		{ "log-file",		required_argument,	NULL,	'f' },
+		{ "jobs",		required_argument,	NULL,	'j' },
+		{ "only",		required_argument,	NULL,	'O' },
+		{ "skip",		required_argument,	NULL,	'S' },
+		{ "list",		no_argument,		NULL,	'L' },
 		{ NULL }
 	};
 	const char *opt_hostname = NULL;
 	const char *opt_log_format = NULL;
 	const char *opt_log_file = NULL;
+	unsigned int opt_jobs = 1;
+	int opt_list = 0;
+	unsigned int groups[NUM_GROUPS], ngroups = 0;
+	unsigned int i;
 	int c;
 
-	while ((c = getopt_long(argc, argv, "Dh:ql:f:", options, NULL)) != EOF) {
+	while ((c = getopt_long(argc, argv, "Dh:ql:f:j:", options, NULL)) != EOF) {
 		switch (c) {
 		case 'D':
 			opt_flags |= RPF_DISPUTED;
@@ -64,11 +296,33 @@ main(int argc, char **argv)
 			opt_log_file = optarg;
 			break;
 
+		case 'j':
+			opt_jobs = strtoul(optarg, NULL, 0);
+			if (opt_jobs == 0)
+				goto usage;
+			break;
+
+		case 'O':
+			rpctest_filter_add(&opt_only, optarg);
+			break;
+
+		case 'S':
+			rpctest_filter_add(&opt_skip, optarg);
+			break;
+
+		case 'L':
+			opt_list = 1;
+			break;
+
 		default:
 		usage:
 			fprintf(stderr,
 				"Usage:\n"
-				"rpctest [-h hostname]\n");
+				"rpctest [-Dq] [-h hostname] [-j jobs] [-l log-format] [-f log-file]\n"
+				"        [--only patterns] [--skip patterns] [--list]\n"
+				"Patterns match group names, or test names (group.tag) if they\n"
+				"contain a dot. --list prints the groups; test names appear in\n"
+				"the junit and jlogger output, and in the summary.\n");
 			return 1;
 		}
 	}
@@ -76,20 +330,38 @@ main(int argc, char **argv)
 	if (optind != argc)
 		goto usage;
 
+	for (i = 0; i < NUM_GROUPS; ++i) {
+		if (rpctest_group_selected(&rpctest_groups[i]))
+			groups[ngroups++] = i;
+	}
+
+	if (opt_list) {
+		for (i = 0; i < ngroups; ++i)
+			printf("%-12s %s\n", rpctest_groups[groups[i]].name,
+					rpctest_groups[groups[i]].description);
+		return 0;
+	}
+
+	if (ngroups == 0) {
+		fprintf(stderr, "No test groups selected; try --list\n");
+		return 1;
+	}
+
 	if (opt_flags & RPF_QUIET)
 		log_quiet();
 
 	log_init(opt_log_format, "rpcunit", opt_log_file);
+	if (opt_only.count || opt_skip.count)
+		log_set_filter(rpctest_test_selected);
 	if (!rpctest_init_nettypes())
 		return 1;
 
-	rpctest_verify_netpath_all();
-	rpctest_verify_netconfig_all();
-	rpctest_verify_sockets_all();
-	rpctest_verify_pmap_all(opt_flags);
-	rpctest_verify_rpcb_all(opt_flags);
-	rpctest_verify_svc_register();
-	rpctest_verify_clnt_funcs();
+	if (opt_jobs > 1) {
+		rpctest_run_parallel(groups, ngroups, opt_jobs);
+	} else {
+		for (i = 0; i < ngroups; ++i)
+			rpctest_groups[groups[i]].run();
+	}
 
 	log_finish();
 
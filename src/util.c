@@ -22,6 +22,7 @@
  * Utility functions
  */
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <signal.h>
 #include <arpa/inet.h>
@@ -34,6 +35,36 @@ struct rpctest_process {
 	pid_t	pid;
 };
 
+/*
+ * The program number and local socket path the unit tests register.
+ * rpctest -j gives every worker process its own, so that parallel
+ * groups don't trip over each other's registrations with rpcbind.
+ */
+rpcprog_t	rpctest_prog = SQUARE_PROG;
+const char *	rpctest_local_addr = SQUARE_LOCAL_ADDR;
+
+void
+rpctest_set_program(rpcprog_t prog, const char *local_addr)
+{
+	rpctest_prog = prog;
+	rpctest_local_addr = local_addr;
+}
+
+/*
+ * The tests keep their registrations in static tables, which name
+ * SQUARE_PROG and SQUARE_LOCAL_ADDR. Point them at ours.
+ */
+void
+rpctest_rpcb_fixup(RPCB *rb)
+{
+	for (; rb->r_prog; ++rb) {
+		if (rb->r_prog == SQUARE_PROG)
+			rb->r_prog = rpctest_prog;
+		if (rb->r_addr && !strcmp(rb->r_addr, SQUARE_LOCAL_ADDR))
+			rb->r_addr = (char *) rpctest_local_addr;
+	}
+}
+
 void
 rpctest_drop_privileges(void)
 {
@@ -57,6 +88,53 @@ rpctest_resume_privileges(void)
 		log_fatal("lost effective uid 0");
 }
 
+/*
+ * Raise the soft limit on open files to the hard limit, so that
+ * we can deal with many thousands of connections.
+ * Returns the new limit.
+ */
+unsigned int
+rpctest_raise_fd_limit(void)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0)
+		return 1024;
+	if (rlim.rlim_cur != rlim.rlim_max) {
+		rlim.rlim_cur = rlim.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &rlim) < 0)
+			getrlimit(RLIMIT_NOFILE, &rlim);
+	}
+	if (rlim.rlim_cur == RLIM_INFINITY)
+		return 65536;
+	return rlim.rlim_cur;
+}
+
+/*
+ * Parse a size with an optional k or m suffix
+ */
+int
+rpctest_parse_size(const char *value, unsigned int *result)
+{
+	unsigned long size;
+	char *s;
+
+	size = strtoul(value, &s, 0);
+	if (*s == 'k' || *s == 'K') {
+		size <<= 10;
+		s++;
+	} else
+	if (*s == 'm' || *s == 'M') {
+		size <<= 20;
+		s++;
+	}
+	if (s == value || *s || size > INT_MAX)
+		return -1;
+
+	*result = size;
+	return 0;
+}
+
 rpctest_process_t *
 rpctest_fork_server(void)
 {
@@ -0,0 +1,222 @@
+/*
+ * RPC Test suite
+ *
+ * Copyright (C) 2015, Olaf Kirch <okir@suse.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ *
+ * Verify the XDR decoders of the square service that rpc.squared
+ * and rpc.rawsquared use on their fast path
+ */
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include "rpctest.h"
+
+static void	rpctest_verify_foodata_decode(const char *, xdrproc_t, u_int, u_int);
+static void	rpctest_verify_foodata_udp(void);
+
+void
+rpctest_verify_xdr_all(void)
+{
+	log_test_group("xdr", "Verify XDR decoders");
+
+	rpctest_verify_foodata_decode("xdr_foodata_sum", (xdrproc_t) xdr_foodata_sum, 0, 0);
+	rpctest_verify_foodata_decode("xdr_foodata_sum", (xdrproc_t) xdr_foodata_sum, 17, 17);
+	rpctest_verify_foodata_decode("xdr_foodata_sum", (xdrproc_t) xdr_foodata_sum, 18, 17);
+	rpctest_verify_foodata_decode("xdr_foodata_sum", (xdrproc_t) xdr_foodata_sum, 0x40000001, 2);
+	rpctest_verify_foodata_decode("xdr_foodata_sum", (xdrproc_t) xdr_foodata_sum, 0xffffffff, 2);
+
+	rpctest_verify_foodata_decode("xdr_foodata_skip", (xdrproc_t) xdr_foodata_skip, 17, 17);
+	rpctest_verify_foodata_decode("xdr_foodata_skip", (xdrproc_t) xdr_foodata_skip, 18, 17);
+	rpctest_verify_foodata_decode("xdr_foodata_skip", (xdrproc_t) xdr_foodata_skip, 0x40000001, 2);
+	rpctest_verify_foodata_decode("xdr_foodata_skip", (xdrproc_t) xdr_foodata_skip, 0xffffffff, 2);
+
+	rpctest_verify_foodata_udp();
+}
+
+/*
+ * Decode a foodata argument with the given count from a buffer that
+ * holds only nwords ints. This happens in a child process, so that a
+ * decoder that runs off the end of the buffer does not take us down.
+ */
+static void
+rpctest_verify_foodata_decode(const char *name, xdrproc_t xdr_decode, u_int count, u_int nwords)
+{
+	static uint32_t buffer[64];
+	u_int i, expect_sum = 0;
+	int expect_ok = nwords >= count;
+	int termsig, rv;
+
+	log_test("Verify %s with count %u and %u ints of data", name, count, nwords);
+
+	buffer[0] = htonl(count);
+	for (i = 0; i < nwords; ++i) {
+		buffer[1 + i] = htonl(i * 0x01010101);
+		expect_sum += i * 0x01010101;
+	}
+
+	switch (rpctest_try_catch_crash(&termsig, &rv)) {
+	default:
+		/* An error occurred when trying to fork etc. */
+		return;
+
+	case 0:
+		{
+			/* xdr_foodata_skip only fills in the count */
+			foodata_sum result = { 0, expect_sum };
+			XDR xdrs;
+
+			xdrmem_create(&xdrs, (char *) buffer, 4 * (1 + nwords), XDR_DECODE);
+			if (!xdr_decode(&xdrs, &result))
+				exit(1);
+			if (result.count != count || result.sum != expect_sum)
+				exit(2);
+			exit(0);
+		}
+
+	case 1:
+		break;
+
+	case 2:
+		log_fail("%s CRASHED with signal %u", name, termsig);
+		return;
+	}
+
+	if (rv == 2)
+		log_fail("%s returned the wrong count or sum", name);
+	else if (expect_ok && rv != 0)
+		log_fail("%s failed to decode a valid argument", name);
+	else if (!expect_ok && rv == 0)
+		log_fail("%s accepted a count larger than the message", name);
+}
+
+/*
+ * SUMPROC and SINKPROC, decoded the way rpc.squared and rpc.rawsquared
+ * do on their fast path
+ */
+static void
+rpctest_foodata_dispatch(struct svc_req *rqstp, SVCXPRT *xprt)
+{
+	foodata_sum argument;
+
+	switch (rqstp->rq_proc) {
+	case NULLPROC:
+		svc_sendreply(xprt, (xdrproc_t) xdr_void, NULL);
+		break;
+
+	case SUMPROC:
+		if (!svc_getargs(xprt, (xdrproc_t) xdr_foodata_sum, (caddr_t) &argument)) {
+			svcerr_decode(xprt);
+			break;
+		}
+		svc_sendreply(xprt, (xdrproc_t) xdr_u_int, (caddr_t) sumproc_fast_1_svc(&argument, rqstp));
+		break;
+
+	case SINKPROC:
+		if (!svc_getargs(xprt, (xdrproc_t) xdr_foodata_skip, (caddr_t) &argument.count)) {
+			svcerr_decode(xprt);
+			break;
+		}
+		svc_sendreply(xprt, (xdrproc_t) xdr_void, NULL);
+		break;
+
+	default:
+		svcerr_noproc(xprt);
+	}
+}
+
+/*
+ * A foodata argument that claims 0x40000001 ints, but carries only two
+ */
+static bool_t
+xdr_foodata_oversized(XDR *xdrs, void *unused)
+{
+	u_int count = 0x40000001, word = 1;
+
+	return xdr_u_int(xdrs, &count) && xdr_u_int(xdrs, &word) && xdr_u_int(xdrs, &word);
+}
+
+/*
+ * Send SUMPROC and SINKPROC datagrams with an oversized count. The
+ * server must reject them, and still be around to answer a NULL call
+ * afterwards.
+ */
+static void
+rpctest_verify_foodata_udp(void)
+{
+	static const rpcproc_t procs[] = { SUMPROC, SINKPROC, 0 };
+	struct timeval wait = { 2, 0 };
+	rpctest_process_t *proc = NULL;
+	struct sockaddr_in sin;
+	socklen_t alen = sizeof(sin);
+	int sockfd = RPC_ANYSOCK;
+	const rpcproc_t *pp;
+	SVCXPRT *xprt;
+	CLIENT *clnt;
+
+	log_test("Create UDP service with the fast foodata decoders");
+	if ((xprt = svcudp_create(RPC_ANYSOCK)) == NULL
+	 || !svc_register(xprt, rpctest_prog, SQUARE_VERS, rpctest_foodata_dispatch, 0)) {
+		log_fail("unable to create UDP service");
+		goto out;
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	if (getsockname(xprt->xp_fd, (struct sockaddr *) &sin, &alen) < 0) {
+		log_fail("getsockname: %m");
+		goto out;
+	}
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	proc = rpctest_fork_server();
+
+	clnt = clntudp_create(&sin, rpctest_prog, SQUARE_VERS, wait, &sockfd);
+	if (clnt == NULL) {
+		log_fail("clntudp_create failed: %s", clnt_spcreateerror("error"));
+		goto out;
+	}
+
+	for (pp = procs; *pp; ++pp) {
+		enum clnt_stat stat;
+
+		log_test("Verify UDP call to procedure %u with a count of 0x40000001", *pp);
+		stat = clnt_call(clnt, *pp,
+				(xdrproc_t) xdr_foodata_oversized, NULL,
+				(xdrproc_t) xdr_void, NULL, wait);
+		if (stat != RPC_CANTDECODEARGS)
+			log_fail("call returned %s, expected %s",
+					clnt_sperrno(stat), clnt_sperrno(RPC_CANTDECODEARGS));
+
+		stat = clnt_call(clnt, NULLPROC,
+				(xdrproc_t) xdr_void, NULL,
+				(xdrproc_t) xdr_void, NULL, wait);
+		if (stat != RPC_SUCCESS)
+			log_fail("server did not survive: NULL call returned %s", clnt_sperrno(stat));
+	}
+
+	clnt_destroy(clnt);
+
+out:
+	if (proc)
+		rpctest_kill_process(proc);
+	if (xprt) {
+		svc_unregister(rpctest_prog, SQUARE_VERS);
+		svc_destroy(xprt);
+	}
+}